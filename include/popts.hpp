@@ -12,15 +12,37 @@
 
 #include <chrono>
 #include <deque>
+#include <iosfwd>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+// Header-only by default. With POPTS_SEPARATE_COMPILATION the functions that
+// are not templates are compiled once, in the translation unit that defines
+// POPTS_IMPLEMENTATION, see popts.cpp.
+#if !defined(POPTS_SEPARATE_COMPILATION) || defined(POPTS_IMPLEMENTATION)
+#define POPTS_HAS_IMPLEMENTATION
+#endif
+
+// Header-only, the functions that are not templates are defined in every
+// translation unit and have to be inline.
+#ifdef POPTS_SEPARATE_COMPILATION
+#define POPTS_INLINE
+#else
+#define POPTS_INLINE inline
+#endif
+
 namespace popts {
 
 using namespace std::string_literals;
 
 using std::deque;
 using std::string;
+using std::string_view;
+using std::unordered_map;
 using std::vector;
 
 using duration_t = std::chrono::duration<long double>;
@@ -31,558 +53,4192 @@ using duration_t = std::chrono::duration<long double>;
 
 namespace popts {
 
+// Classifies argv once into a name -> positions table, so that registering an
+// option is a lookup instead of a scan over argv.
+//
+// The same pass splits "--name=value" into the views "--name" and "value" if
+// "--name" is a registered name, and with m_hasBundles indexes every flag of a
+// bundle like "-abc" as "-a", "-b" and "-c" at the position of the bundle,
+// once per occurrence, so "-vvv" is "-v" three times.
+//
+// Indexing stops at the terminator "--", the arguments after it are never
+// matched and not even looked at.
+struct ArgvIndex {
+  using argv_t = std::pmr::vector<string_view>;
+
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  explicit ArgvIndex(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  // Replaces argv with its tokens and indexes them, "--name=value" is split
+  // if names has "--name". Without splitting only whole arguments are indexed
+  // and argv is left as is.
+  void Build(argv_t &argv, bool isSplitting = true,
+             const std::pmr::unordered_map<string_view, size_t> *names =
+                 nullptr);
+  // Joins the names and values Build split, argv is as it was before.
+  void Join(argv_t &argv) const;
+
+  // Calls f with every position of name in argv in ascending order.
+  template <typename F> void ForEachPosition(string_view name, F &&f) const;
+  // The first position of name or npos.
+  size_t FirstPosition(string_view name) const;
+  // Whether an argument "name=value" was left whole, Build splits it once
+  // name is registered.
+  bool IsJoined(string_view name) const;
+  // Whether position is a name split from the value that follows it.
+  bool IsSplit(size_t position) const;
+
+  // "-abc": a dash and two or more letters
+  static bool IsBundle(string_view argument);
+  // "-c", views a static table
+  static string_view ShortName(char c);
+
+  struct Node {
+    size_t m_position;
+    size_t m_next;
+    // "name=value" left whole, never matches
+    bool m_isJoined;
+  };
+
+  // first and last node of every distinct name
+  std::pmr::unordered_map<string_view, std::pair<size_t, size_t>> m_names;
+  // a position is in several lists if it is a bundle
+  std::pmr::vector<Node> m_nodes;
+  // positions of the bundles
+  std::pmr::vector<size_t> m_bundles;
+  // by position, whether a name was split from the value that follows it
+  std::pmr::vector<bool> m_isSplit;
+  // position of "--" or npos
+  size_t m_terminator = npos;
+  // whether "-abc" is a bundle or an argument like any other, set once
+  // before the first Build
+  bool m_hasBundles = false;
+
+private:
+  void Add(string_view name, size_t position, bool isJoined = false);
+};
+
+// Values for an option without matches in argv, e.g. from the environment or
+// a config file, in the order of their source.
+struct Fallback {
+  explicit Fallback(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_values(resource), m_source(resource) {}
+
+  std::pmr::vector<string_view> m_values;
+  // names the source in errors, e.g. "environment variable 'NAME'"
+  std::pmr::string m_source;
+};
+
 struct Option {
-  using argv_t = vector<string>;
+  using argv_t = ArgvIndex::argv_t;
 
   static constexpr size_t Single = 1;
   static constexpr size_t Many = std::numeric_limits<size_t>::max();
 
-  vector<string> m_names;
-  string m_description;
-  string m_defaultString;
+  // Everything but the value is allocated from resource, see Options.
+  explicit Option(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  std::pmr::vector<std::pmr::string> m_names;
+  std::pmr::string m_description;
+  std::pmr::string m_defaultString;
   size_t m_count;
   bool m_isFlag;
-  deque<argv_t::const_iterator> m_matches;
-  deque<argv_t::const_iterator> m_parseErrors;
+  // vectors, unlike deques they do not allocate while empty
+  std::pmr::vector<argv_t::const_iterator> m_matches;
+  std::pmr::vector<argv_t::const_iterator> m_parseErrors;
+  // the variable to fall back to without matches in argv, may be empty
+  std::pmr::string m_environmentName;
+  // fallback values that could not be parsed and their source
+  std::pmr::vector<string_view> m_fallbackErrors;
+  std::pmr::string m_fallbackSource;
+  // splits every argument into values, 0 for one value per argument
+  char m_separator = 0;
+  // converted on first access instead of when parsing, see Lazy
+  bool m_isLazy = false;
+  bool m_isResolved = true;
+
+  virtual ~Option() = default;
+
+  // Matches the option in argv and converts the values. The fallback values
+  // are used only if argv has no matches.
+  virtual void ParseArguments(const argv_t &argv, const ArgvIndex &index,
+                              const Fallback &fallback) = 0;
+
+  // Converts the arguments of a lazy option if that has not happened yet.
+  virtual void Resolve() = 0;
+
+  // The object handed out for the option, the value of a single option or the
+  // container of a multiple option.
+  virtual const void *Value() const = 0;
+  // A copy of the object Value() points to.
+  virtual std::shared_ptr<const void> CopyValue() const = 0;
 
 protected:
-  unsigned int ParseMatches(const argv_t &argv);
+  unsigned int ParseMatches(const argv_t &argv, const ArgvIndex &index);
+};
+
+// Destroys an option and returns its memory to the resource it was allocated
+// from.
+struct OptionDeleter {
+  void operator()(Option *option) const;
+
+  std::pmr::memory_resource *m_resource;
+  size_t m_size;
+  size_t m_alignment;
+};
+
+// A vector that keeps up to N elements inline before it allocates. The
+// elements are contiguous either way.
+template <typename T, size_t N = 4> class SmallVector {
+  static_assert(N > 0, "use std::vector without inline elements");
+
+public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T &;
+  using const_reference = const T &;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  SmallVector() = default;
+  SmallVector(const SmallVector &other);
+  SmallVector(SmallVector &&other) noexcept;
+  SmallVector &operator=(const SmallVector &other);
+  SmallVector &operator=(SmallVector &&other) noexcept;
+  ~SmallVector();
+
+  T *data() { return m_data; }
+  const T *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  size_t capacity() const { return m_capacity; }
+  bool empty() const { return m_size == 0; }
+
+  iterator begin() { return m_data; }
+  iterator end() { return m_data + m_size; }
+  const_iterator begin() const { return m_data; }
+  const_iterator end() const { return m_data + m_size; }
+  const_iterator cbegin() const { return m_data; }
+  const_iterator cend() const { return m_data + m_size; }
+
+  T &operator[](size_t i) { return m_data[i]; }
+  const T &operator[](size_t i) const { return m_data[i]; }
+  T &front() { return m_data[0]; }
+  const T &front() const { return m_data[0]; }
+  T &back() { return m_data[m_size - 1]; }
+  const T &back() const { return m_data[m_size - 1]; }
+
+  void reserve(size_t capacity);
+  void push_back(const T &value) { emplace_back(value); }
+  void push_back(T &&value) { emplace_back(std::move(value)); }
+  template <typename... Args> T &emplace_back(Args &&... args);
+  // Keeps the capacity.
+  void clear();
+
+private:
+  bool IsInline() const { return m_data == InlineData(); }
+  T *InlineData() { return reinterpret_cast<T *>(m_inline); }
+  const T *InlineData() const { return reinterpret_cast<const T *>(m_inline); }
+  void MoveFrom(SmallVector &other);
+
+  alignas(T) unsigned char m_inline[N * sizeof(T)];
+  T *m_data = InlineData();
+  size_t m_size = 0;
+  size_t m_capacity = N;
 };
 
-template <typename T> struct OptionImpl : public Option {
+// Conversion of option values, specialize for types that are not streamable.
+template <typename T> struct OptionTraits {
   static T FlagMatchValue();
-  static bool FromString(const std::string &data, T &out);
+  static bool FromString(string_view data, T &out);
   static std::string ToString(const T &data);
+};
+
+template <>
+POPTS_INLINE bool OptionTraits<duration_t>::FromString(string_view data,
+                                                       duration_t &out);
+template <>
+POPTS_INLINE bool OptionTraits<std::string>::FromString(string_view data,
+                                                        std::string &out);
+template <>
+POPTS_INLINE bool OptionTraits<bool>::FromString(string_view data, bool &out);
+template <>
+POPTS_INLINE std::string
+OptionTraits<duration_t>::ToString(const duration_t &data);
+template <> POPTS_INLINE bool OptionTraits<bool>::FlagMatchValue();
 
-  void ParseArguments(const argv_t &argv);
+// Storage has to be a sequence container with push_back, e.g. deque<T> or
+// SmallVector<T> for contiguous values.
+template <typename T, typename Storage = deque<T>>
+struct OptionImpl : public Option, public OptionTraits<T> {
+  using Option::Option;
 
-  deque<T> m_storage;
+  // Parsing again keeps the element of a single option, references to it
+  // stay valid.
+  void ParseArguments(const argv_t &argv, const ArgvIndex &index,
+                      const Fallback &fallback) override;
+  void Resolve() override;
+  const void *Value() const override;
+  std::shared_ptr<const void> CopyValue() const override;
+
+  Storage m_storage;
   T m_defaultArgument;
+
+private:
+  void Convert(const Fallback &fallback);
+
+  // what Resolve converts
+  argv_t::const_iterator m_argvEnd;
+  Fallback m_fallback{m_names.get_allocator().resource()};
+};
+
+// A handle to the value of an option that is converted from its arguments on
+// first access, e.g. for types that are expensive to convert. The first
+// access is not thread-safe. Copies refer to the same option.
+template <typename V> class Lazy {
+public:
+  const V &operator*() const {
+    m_option->Resolve();
+    return *m_value;
+  }
+  const V *operator->() const { return &**this; }
+
+private:
+  friend class Options;
+
+  Lazy(Option &option, const V &value) : m_option(&option), m_value(&value) {}
+
+  Option *m_option;
+  const V *m_value;
 };
 
 } // namespace popts
 
 #include <algorithm>
-#include <cctype>   //std::tolower
+#include <array>
+#include <cfloat>   //FLT_EVAL_METHOD
 #include <charconv> //std::from_chars
-#include <regex>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// no floating point from_chars in this standard library, streams instead
+#if !defined(__cpp_lib_to_chars) || __cpp_lib_to_chars < 201611L
+#define POPTS_NO_FLOAT_FROM_CHARS
+#include <locale>
 #include <sstream>
+#endif
+
+// define POPTS_NO_SIMD for the portable scalar code only
+#if !defined(POPTS_NO_SIMD) &&                                                \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define POPTS_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 namespace popts {
 
-unsigned int Option::ParseMatches(const argv_t &argv) {
-  auto from = std::next(argv.cbegin());
-  auto to = argv.cend();
+namespace detail {
 
-  for (auto match = from;;) {
-    match = std::find_first_of(match, to, m_names.cbegin(), m_names.cend());
+template <typename T>
+constexpr bool IsCharacter =
+    std::is_same<T, char>::value || std::is_same<T, signed char>::value ||
+    std::is_same<T, unsigned char>::value || std::is_same<T, wchar_t>::value ||
+    std::is_same<T, char16_t>::value || std::is_same<T, char32_t>::value;
 
-    if (match == to) {
-      break;
-    };
+// bool and the character types keep their own or the streaming semantics
+template <typename T>
+constexpr bool IsNumber = std::is_arithmetic<T>::value &&
+                          !std::is_same<T, bool>::value && !IsCharacter<T>;
 
-    m_matches.push_back(++match);
-  }
+// The streams are behind function pointers, only the implementation includes
+// <sstream>. Types without conversions of their own are read and written with
+// operator>> and operator<<, which have to be declared where the option is
+// added.
+POPTS_INLINE bool StreamFromString(string_view data, void *out,
+                                   void (*read)(std::istream &, void *));
+POPTS_INLINE std::string StreamToString(const void *data,
+                                        void (*write)(std::ostream &,
+                                                      const void *));
+// the same text as operator<<
+POPTS_INLINE std::string NumberToString(long long data);
+POPTS_INLINE std::string NumberToString(unsigned long long data);
+POPTS_INLINE std::string NumberToString(long double data);
+// the first character that is not whitespace, like operator>>
+POPTS_INLINE bool CharacterFromString(string_view data, char &out);
 
-  return m_matches.size();
+template <typename T> bool StreamFromString(string_view data, T &out) {
+  return StreamFromString(data, &out, [](std::istream &in, void *out) {
+    in >> *static_cast<T *>(out);
+  });
 }
 
 template <typename T>
-// static
-bool OptionImpl<T>::FromString(const std::string &data, T &out) {
-  std::stringstream ss;
-  ss << data;
-  ss >> out;
-  return !ss.fail();
+std::from_chars_result FromChars(const char *first, const char *last,
+                                 T &value) {
+#ifdef POPTS_NO_FLOAT_FROM_CHARS
+  if constexpr (std::is_floating_point<T>::value) {
+    std::istringstream ss(string(first, last));
+    ss.imbue(std::locale::classic());
+    ss >> std::noskipws >> value;
+    if (ss.fail()) {
+      return {first, std::errc::invalid_argument};
+    }
+    return {ss.eof() ? last : first + ss.tellg(), std::errc()};
+  } else
+#endif
+  {
+    return std::from_chars(first, last, value);
+  }
 }
 
-template <>
-// static
-bool OptionImpl<duration_t>::FromString(const std::string &data,
-                                        duration_t &out) {
-  // since C++20 is not out yet...
-  std::regex durationRe("(\\d+)(d|h|m|s|ms|ns)"s);
-  std::smatch m;
-  if (!std::regex_match(data, m, durationRe)) {
-    return false;
+// Locale independent and strict, the whole string has to be a number.
+template <typename T> bool NumberFromString(string_view data, T &out) {
+  const char *first = data.data();
+  const char *last = first + data.size();
+
+  // from_chars does not accept an explicit plus sign
+  if (last - first > 1 && *first == '+' && first[1] != '-') {
+    ++first;
   }
 
-  std::string numbers = m[1].str();
-  std::string unit = m[2].str();
-
-  long double value;
-  std::from_chars(numbers.data(), numbers.data() + numbers.size(), value);
-
-  if (unit == "d"s) {
-    out = std::chrono::duration<long double, std::ratio<86400>>(value);
-  } else if (unit == "h"s) {
-    out = std::chrono::duration<long double, std::ratio<3600>>(value);
-  } else if (unit == "m"s) {
-    out = std::chrono::duration<long double, std::ratio<60>>(value);
-  } else if (unit == "s"s) {
-    out = std::chrono::duration<long double, std::ratio<1>>(value);
-  } else if (unit == "ms"s) {
-    out = std::chrono::duration<long double, std::milli>(value);
-  } else if (unit == "ns"s) {
-    out = std::chrono::duration<long double, std::nano>(value);
-  } else {
+  T value;
+  auto result = FromChars(first, last, value);
+  if (result.ec != std::errc() || result.ptr != last) {
     return false;
   }
 
+  out = value;
   return true;
 }
 
-template <>
-// static
-bool OptionImpl<std::string>::FromString(const std::string &data,
-                                         std::string &out) {
-  out = data;
-  return true;
+#ifdef POPTS_SSE2
+inline unsigned CountTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
 }
 
-template <>
-// static
-bool OptionImpl<bool>::FromString(const std::string &data, bool &out) {
-  static const auto truthy = {"true"s, "1"s, "on"s, "yes"s, "y"s};
-  static const auto falsy = {"false"s, "0"s, "off"s, "no"s, "n"s};
-
-  std::string lowerdata;
-  lowerdata.reserve(data.size());
-
-  std::transform(data.cbegin(), data.cend(), std::back_inserter(lowerdata),
-                 [](int C) { return ::std::tolower(C); });
-
-  if (std::find(std::cbegin(truthy), std::cend(truthy), lowerdata) !=
-      std::cend(truthy)) {
-    out = true;
-    return true;
-  } else if (std::find(std::cbegin(falsy), std::cend(falsy), lowerdata) !=
-             std::cend(falsy)) {
-    out = false;
-    return true;
-  } else {
-    out = true;
-    return false;
-  }
+// x86 is little-endian, the first character is the lowest byte
+inline bool IsEightDigits(uint64_t chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+          (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
 }
 
-template <typename T>
-// static
-std::string OptionImpl<T>::ToString(const T &data) {
-  std::stringstream ss;
-  ss << data;
-  return ss.str();
+inline uint64_t EightDigitsValue(uint64_t chunk) {
+  chunk -= 0x3030303030303030;
+  chunk = chunk * 10 + (chunk >> 8);
+  return (((chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+          (((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+         32;
 }
+#endif
 
-template <>
-// static
-std::string OptionImpl<duration_t>::ToString(const duration_t &data) {
-  std::stringstream ss;
-  ss << data.count() << "s";
-  return ss.str();
+// Accumulates the digits at it into value, eight at a time where possible,
+// and returns how many there were. More than 19 digits overflow value.
+inline size_t ScanDigits(const char *&it, const char *last, uint64_t &value) {
+  const char *first = it;
+#ifdef POPTS_SSE2
+  for (uint64_t chunk; last - it >= 8; it += 8) {
+    std::memcpy(&chunk, it, sizeof(chunk));
+    if (!IsEightDigits(chunk)) {
+      break;
+    }
+    value = value * 100000000 + EightDigitsValue(chunk);
+  }
+#endif
+  for (; it != last; ++it) {
+    const unsigned digit = static_cast<unsigned char>(*it) - '0';
+    if (digit > 9) {
+      break;
+    }
+    value = value * 10 + digit;
+  }
+  return it - first;
 }
 
-template <typename T> void OptionImpl<T>::ParseArguments(const argv_t &argv) {
-  ParseMatches(argv);
+// Like NumberFromString for integers. Anything but a sign and up to 18
+// digits takes the from_chars path.
+template <typename T> bool IntegerFromString(string_view data, T &out) {
+  const char *it = data.data();
+  const char *last = it + data.size();
 
-  m_storage.clear();
-  m_parseErrors.clear();
+  const bool isNegative = it != last && *it == '-';
+  if (it != last && (*it == '-' || *it == '+')) {
+    ++it;
+  }
 
-  if (m_isFlag) {
-    std::fill_n(std::back_inserter(m_storage), m_matches.size(),
-                FlagMatchValue());
-  } else {
-    for (auto match : m_matches) {
-      if (match != argv.cend()) {
-        T value;
-        if (FromString(*match, value)) {
-          m_storage.push_back(value);
-        } else {
-          m_parseErrors.push_back(match);
-        }
-      } else {
-        m_parseErrors.push_back(match);
-      }
-    }
+  uint64_t value = 0;
+  const size_t digits = ScanDigits(it, last, value);
+  if (it != last || digits == 0 || digits > 18 ||
+      (isNegative && std::is_unsigned<T>::value)) {
+    return NumberFromString(data, out);
   }
 
-  if (m_count == Single) {
-    m_storage.push_back(m_defaultArgument);
+  const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) +
+                         (isNegative ? 1 : 0);
+  if (value > limit) {
+    return false;
   }
+
+  out = static_cast<T>(isNegative ? 0 - value : value);
+  return true;
 }
 
-template <typename T> T OptionImpl<T>::FlagMatchValue() { return T(); }
+// The largest power of ten that T represents exactly, at most 10^19.
+template <typename T> constexpr size_t MaxExactPowerOfTen() {
+  // 10^k is exact if 5^k fits into the mantissa
+  const int bits = std::min(std::numeric_limits<T>::digits, 63);
+  uint64_t five = 1;
+  size_t power = 0;
+  while (power < 19 && five * 5 < (uint64_t(1) << bits)) {
+    five *= 5;
+    ++power;
+  }
+  return power;
+}
 
-template <> bool OptionImpl<bool>::FlagMatchValue() { return true; }
+// Like NumberFromString for floating point. A plain decimal with up to 19
+// digits is the quotient of two exactly represented numbers, which the one
+// division rounds correctly, anything else takes the from_chars path.
+template <typename T> bool FloatFromString(string_view data, T &out) {
+#if FLT_EVAL_METHOD == 0
+  constexpr size_t maxPower = MaxExactPowerOfTen<T>();
+  static const auto powers = [] {
+    std::array<T, maxPower + 1> powers{};
+    powers[0] = 1;
+    for (size_t power = 1; power <= maxPower; ++power) {
+      powers[power] = powers[power - 1] * 10;
+    }
+    return powers;
+  }();
 
-} // namespace popts
+  const char *it = data.data();
+  const char *last = it + data.size();
 
-#endif
+  const bool isNegative = it != last && *it == '-';
+  if (it != last && (*it == '-' || *it == '+')) {
+    ++it;
+  }
 
-namespace popts {
+  uint64_t mantissa = 0;
+  const size_t integerDigits = ScanDigits(it, last, mantissa);
+  size_t fractionDigits = 0;
+  if (it != last && *it == '.') {
+    ++it;
+    fractionDigits = ScanDigits(it, last, mantissa);
+  }
 
-class Options {
-public:
-  using argv_t = vector<string>;
+  constexpr int mantissaBits = std::numeric_limits<T>::digits;
+  if (it == last && integerDigits != 0 &&
+      (fractionDigits != 0 || data.back() != '.') &&
+      integerDigits + fractionDigits <= 19 && fractionDigits <= maxPower &&
+      mantissa <= uint64_t(1) << std::min(mantissaBits, 63)) {
+    const T value = static_cast<T>(mantissa) / powers[fractionDigits];
+    out = isNegative ? -value : value;
+    return true;
+  }
+#endif
+  return NumberFromString(data, out);
+}
 
-private:
-  struct tail_t {
-    argv_t::const_iterator cbegin() const { return m_cbegin; }
-    argv_t::const_iterator cend() const { return m_cend; }
-    argv_t::const_iterator m_cbegin, m_cend;
-  };
+// Calls f with every field of data between separators, 16 characters are
+// compared at a time.
+template <typename F>
+void ForEachField(string_view data, char separator, F &&f) {
+  const char *it = data.data();
+  const char *last = it + data.size();
+  const char *field = it;
 
-public:
-  Options(const argv_t &argv);
-  Options(int argc, char **argv);
+#ifdef POPTS_SSE2
+  const __m128i pattern = _mm_set1_epi8(separator);
+  for (; last - it >= 16; it += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+    for (; mask; mask &= mask - 1) {
+      const char *end = it + CountTrailingZeros(mask);
+      f(string_view(field, end - field));
+      field = end + 1;
+    }
+  }
+#endif
+  for (; it != last; ++it) {
+    if (*it == separator) {
+      f(string_view(field, it - field));
+      field = it + 1;
+    }
+  }
 
-  Options &WithHelp();
+  f(string_view(field, last - field));
+}
 
-  bool HasDuplicateNames(std::ostream *out = nullptr) const;
-  bool HasErrorMatches(std::ostream *out = nullptr) const;
-  bool HasConsistentTail(std::ostream *out = nullptr) const;
-  tail_t Tail() const;
-  string Description() const;
+// Converts every field of a delimited list, one that cannot be converted
+// fails the list but the others are still put.
+template <typename T, typename F>
+bool ListFromString(string_view data, char separator, F &&put) {
+  bool isValid = true;
 
-  template <typename T>
-  const T &MakeOption(std::initializer_list<const char *> names,
-                      const T &defaultArgument, const string &description);
+  ForEachField(data, separator, [&isValid, &put](string_view field) {
+    T value;
+    bool isConverted;
+    if constexpr (std::is_integral<T>::value && IsNumber<T>) {
+      isConverted = IntegerFromString(field, value);
+    } else if constexpr (std::is_floating_point<T>::value) {
+      isConverted = FloatFromString(field, value);
+    } else {
+      isConverted = OptionTraits<T>::FromString(field, value);
+    }
 
-  template <typename T>
-  const deque<T> &MakeOptions(std::initializer_list<const char *> names,
-                              const string &description);
+    if (isConverted) {
+      put(value);
+    } else {
+      isValid = false;
+    }
+  });
 
-  const bool &Flag(std::initializer_list<const char *> names,
-                   const string &description);
+  return isValid;
+}
 
-  const deque<bool> &Flags(std::initializer_list<const char *> names,
-                           const string &description);
+} // namespace detail
 
-#define DEFINE_OPTION_FUNC(Type, Name)                                         \
-  const Type &Options::Name(std::initializer_list<const char *> names,         \
-                            const Type &defaultArgument,                       \
-                            const string &description) {                       \
-    return MakeOption<Type>(names, defaultArgument, description);              \
-  }                                                                            \
-                                                                               \
-  const deque<Type> &Options::Name##s(                                         \
-      std::initializer_list<const char *> names, const string &description) {  \
-    return MakeOptions<Type>(names, description);                              \
+template <typename T, size_t N>
+SmallVector<T, N>::SmallVector(const SmallVector &other) {
+  reserve(other.size());
+  for (const auto &value : other) {
+    push_back(value);
   }
+}
 
-  DEFINE_OPTION_FUNC(string, String)
-  DEFINE_OPTION_FUNC(bool, Bool)
-  DEFINE_OPTION_FUNC(int64_t, Int)
-  DEFINE_OPTION_FUNC(long double, Double)
-  DEFINE_OPTION_FUNC(duration_t, Duration)
-
-#undef DEFINE_OPTION_FUNC
+template <typename T, size_t N>
+SmallVector<T, N>::SmallVector(SmallVector &&other) noexcept {
+  MoveFrom(other);
+}
 
-private:
-  template <typename T>
-  OptionImpl<T> &AddOption(std::initializer_list<const char *> names,
-                           const T &defaultArgument, const string &description,
-                           size_t count, bool isFlag);
+template <typename T, size_t N>
+SmallVector<T, N> &SmallVector<T, N>::operator=(const SmallVector &other) {
+  if (this != &other) {
+    clear();
+    reserve(other.size());
+    for (const auto &value : other) {
+      push_back(value);
+    }
+  }
+  return *this;
+}
 
-private:
-  argv_t m_argv;
-  argv_t::const_iterator m_tail = m_argv.cbegin();
-  deque<std::unique_ptr<Option>> m_options;
-};
+template <typename T, size_t N>
+SmallVector<T, N> &SmallVector<T, N>::operator=(SmallVector &&other) noexcept {
+  if (this != &other) {
+    clear();
+    if (!IsInline()) {
+      ::operator delete(m_data);
+      m_data = InlineData();
+      m_capacity = N;
+    }
+    MoveFrom(other);
+  }
+  return *this;
+}
 
-} // namespace popts
+template <typename T, size_t N> SmallVector<T, N>::~SmallVector() {
+  clear();
+  if (!IsInline()) {
+    ::operator delete(m_data);
+  }
+}
 
-#include <cassert>
-#include <chrono>
-#include <filesystem>
-#include <iosfwd>
+template <typename T, size_t N>
+void SmallVector<T, N>::reserve(size_t capacity) {
+  if (capacity <= m_capacity) {
+    return;
+  }
 
-namespace popts {
+  T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+  for (size_t i = 0; i < m_size; ++i) {
+    new (data + i) T(std::move_if_noexcept(m_data[i]));
+    m_data[i].~T();
+  }
 
-Options::Options(int argc, char **argv) : m_argv(argv, argv + argc) {}
+  if (!IsInline()) {
+    ::operator delete(m_data);
+  }
+  m_data = data;
+  m_capacity = capacity;
+}
 
-Options::Options(const argv_t &argv) : m_argv(argv) {}
+template <typename T, size_t N>
+template <typename... Args>
+T &SmallVector<T, N>::emplace_back(Args &&... args) {
+  if (m_size == m_capacity) {
+    // args may refer to an element, construct before moving the elements
+    T value(std::forward<Args>(args)...);
+    reserve(2 * m_capacity);
+    new (m_data + m_size) T(std::move(value));
+  } else {
+    new (m_data + m_size) T(std::forward<Args>(args)...);
+  }
+  return m_data[m_size++];
+}
 
-bool Options::HasDuplicateNames(std::ostream *out) const {
-  vector<string> names;
+template <typename T, size_t N> void SmallVector<T, N>::clear() {
+  for (size_t i = 0; i < m_size; ++i) {
+    m_data[i].~T();
+  }
+  m_size = 0;
+}
 
-  for (const auto &option : m_options) {
-    std::copy(option->m_names.cbegin(), option->m_names.cend(),
-              std::back_inserter(names));
+template <typename T, size_t N>
+void SmallVector<T, N>::MoveFrom(SmallVector &other) {
+  if (other.IsInline()) {
+    for (size_t i = 0; i < other.m_size; ++i) {
+      new (m_data + i) T(std::move(other.m_data[i]));
+    }
+    m_size = other.m_size;
+    other.clear();
+  } else {
+    m_data = std::exchange(other.m_data, other.InlineData());
+    m_size = std::exchange(other.m_size, 0);
+    m_capacity = std::exchange(other.m_capacity, N);
   }
+}
 
-  std::sort(names.begin(), names.end());
+template <typename F>
+void ArgvIndex::ForEachPosition(string_view name, F &&f) const {
+  auto nodes = m_names.find(name);
+  if (nodes == m_names.cend()) {
+    return;
+  }
 
-  auto currentName = names.begin();
-  auto end = names.end();
-  bool hasDuplicates = false;
+  for (size_t node = nodes->second.first; node != npos;
+       node = m_nodes[node].m_next) {
+    if (!m_nodes[node].m_isJoined) {
+      f(m_nodes[node].m_position);
+    }
+  }
+}
 
-  while (currentName != end) {
-    auto prevName = currentName++;
-    if (currentName == end) {
-      break;
+template <typename T>
+// static
+bool OptionTraits<T>::FromString(string_view data, T &out) {
+  if constexpr (detail::IsNumber<T>) {
+    return detail::NumberFromString(data, out);
+  } else if constexpr (detail::IsCharacter<T> && sizeof(T) == 1) {
+    char c;
+    if (!detail::CharacterFromString(data, c)) {
+      return false;
     }
+    out = static_cast<T>(c);
+    return true;
+  } else {
+    return detail::StreamFromString(data, out);
+  }
+}
 
-    if (*prevName == *currentName) {
-      hasDuplicates = true;
+template <typename T>
+// static
+std::string OptionTraits<T>::ToString(const T &data) {
+  if constexpr (std::is_floating_point<T>::value) {
+    return detail::NumberToString(static_cast<long double>(data));
+  } else if constexpr (detail::IsCharacter<T> && sizeof(T) == 1) {
+    return std::string(1, static_cast<char>(data));
+  } else if constexpr (std::is_signed<T>::value) {
+    // bool and the wider characters are written as numbers, too
+    return detail::NumberToString(static_cast<long long>(data));
+  } else if constexpr (std::is_arithmetic<T>::value) {
+    return detail::NumberToString(static_cast<unsigned long long>(data));
+  } else if constexpr (std::is_convertible<const T &, string_view>::value) {
+    return std::string(string_view(data));
+  } else {
+    return detail::StreamToString(&data, [](std::ostream &out,
+                                            const void *data) {
+      out << *static_cast<const T *>(data);
+    });
+  }
+}
 
-      if (out) {
-        (*out) << "Duplicate name: " << *currentName << "\n";
-      } else {
-        break;
-      }
+template <typename T, typename Storage>
+void OptionImpl<T, Storage>::ParseArguments(const argv_t &argv,
+                                            const ArgvIndex &index,
+                                            const Fallback &fallback) {
+  ParseMatches(argv, index);
+  m_argvEnd = argv.cend();
 
-      // fast-forward through the duplicates
-      currentName =
-          std::find_if(currentName, end, [prevName](const auto &name) {
-            return name != *prevName;
-          });
+  if (m_isLazy) {
+    m_fallback = fallback;
+    m_isResolved = false;
+
+    // the handle refers to the element before it is converted
+    if (m_count == Single && m_storage.empty()) {
+      m_storage.push_back(m_defaultArgument);
     }
+    return;
   }
 
-  return hasDuplicates;
+  Convert(fallback);
 }
 
-bool Options::HasErrorMatches(std::ostream *out) const {
-  auto quotedArgument = [this](argv_t::const_iterator it) {
-    if (it == m_argv.cend()) {
-      return "<null>"s;
-    }
-    return "'"s + *it + "'"s;
-  };
+template <typename T, typename Storage>
+void OptionImpl<T, Storage>::Resolve() {
+  if (!m_isResolved) {
+    Convert(m_fallback);
+    m_fallback.m_values.clear();
+    m_fallback.m_source.clear();
+    m_isResolved = true;
+  }
+}
 
-  auto commentSeparatedList = [this, quotedArgument](auto *out,
-                                                     const auto &container) {
-    auto from = std::cbegin(container);
-    auto to = std::cend(container);
+template <typename T, typename Storage>
+void OptionImpl<T, Storage>::Convert(const Fallback &fallback) {
+  // ParseMatches put the values given to flags in m_parseErrors
+  m_fallbackErrors.clear();
+  m_fallbackSource.clear();
 
-    if (from == to) {
-      return;
+  // a single option has exactly one element, the first value wins
+  const bool isSingle = m_count == Single;
+  bool hasValue = false;
+  auto put = [this, isSingle, &hasValue](const T &value) {
+    if (!isSingle) {
+      m_storage.push_back(value);
+    } else if (!hasValue && m_storage.empty()) {
+      m_storage.push_back(value);
+    } else if (!hasValue) {
+      m_storage.front() = value;
     }
+    hasValue = true;
+  };
 
-    (*out) << quotedArgument(*from);
+  // a list option puts every value of the argument
+  auto convert = [this, &put](string_view data) {
+    if (m_separator) {
+      return detail::ListFromString<T>(data, m_separator, put);
+    }
 
-    for (++from; from != to; ++from) {
-      (*out) << ", " << quotedArgument(*from);
+    T value;
+    if (!OptionTraits<T>::FromString(data, value)) {
+      return false;
     }
+    put(value);
+    return true;
   };
 
-  bool hasErrors = false;
-  vector<argv_t::const_iterator> allMatches;
+  if (!isSingle) {
+    m_storage.clear();
+  }
 
-  for (const std::unique_ptr<Option> &option : m_options) {
-    // Check for errors
+  if (m_isFlag) {
+    for (size_t i = 0; i < m_matches.size(); ++i) {
+      put(OptionTraits<T>::FlagMatchValue());
+    }
+  } else {
+    // "--" after a name is the terminator, the first one ends the index
+    for (auto match : m_matches) {
+      if (match != m_argvEnd && *match != "--") {
+        if (!convert(*match)) {
+          m_parseErrors.push_back(match);
+        }
+      } else {
+        m_parseErrors.push_back(match);
+      }
+    }
+  }
+
+  // argv takes precedence over all fallback sources
+  if (m_matches.empty()) {
+    for (auto data : fallback.m_values) {
+      if (!convert(data)) {
+        m_fallbackErrors.push_back(data);
+      }
+    }
+
+    if (!m_fallbackErrors.empty()) {
+      m_fallbackSource = fallback.m_source;
+    }
+  }
+
+  if (isSingle && !hasValue) {
+    put(m_defaultArgument);
+  }
+}
+
+template <typename T, typename Storage>
+const void *OptionImpl<T, Storage>::Value() const {
+  if (m_count == Single) {
+    return &m_storage.front();
+  }
+  return &m_storage;
+}
+
+template <typename T, typename Storage>
+std::shared_ptr<const void> OptionImpl<T, Storage>::CopyValue() const {
+  if (m_count == Single) {
+    return std::make_shared<const T>(m_storage.front());
+  }
+  return std::make_shared<const Storage>(m_storage);
+}
+
+template <typename T> T OptionTraits<T>::FlagMatchValue() { return T(); }
+
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include <cctype>
+#include <sstream>
+
+namespace popts {
+
+namespace detail {
+
+POPTS_INLINE bool StreamFromString(string_view data, void *out,
+                                   void (*read)(std::istream &, void *)) {
+  std::stringstream ss;
+  ss << data;
+  read(ss, out);
+  return !ss.fail();
+}
+
+POPTS_INLINE std::string StreamToString(const void *data,
+                                        void (*write)(std::ostream &,
+                                                      const void *)) {
+  std::stringstream ss;
+  write(ss, data);
+  return ss.str();
+}
+
+POPTS_INLINE std::string NumberToString(long long data) {
+  return std::to_string(data);
+}
+
+POPTS_INLINE std::string NumberToString(unsigned long long data) {
+  return std::to_string(data);
+}
+
+POPTS_INLINE std::string NumberToString(long double data) {
+  std::stringstream ss;
+  ss << data;
+  return ss.str();
+}
+
+POPTS_INLINE bool CharacterFromString(string_view data, char &out) {
+  auto it = std::find_if(data.cbegin(), data.cend(), [](char c) {
+    return !std::isspace(static_cast<unsigned char>(c));
+  });
+  if (it == data.cend()) {
+    return false;
+  }
+  out = *it;
+  return true;
+}
+
+} // namespace detail
+
+POPTS_INLINE ArgvIndex::ArgvIndex(std::pmr::memory_resource *resource)
+    : m_names(resource), m_nodes(resource), m_bundles(resource),
+      m_isSplit(resource) {}
+
+POPTS_INLINE void ArgvIndex::Build(
+    argv_t &argv, bool isSplitting,
+    const std::pmr::unordered_map<string_view, size_t> *names) {
+  m_names.clear();
+  m_names.reserve(argv.size());
+  m_nodes.clear();
+  m_nodes.reserve(argv.size());
+  m_bundles.clear();
+  m_isSplit.clear();
+  m_terminator = npos;
+
+  if (!isSplitting) {
+    for (size_t arg = 1; arg < argv.size(); ++arg) {
+      if (argv[arg] == "--") {
+        m_terminator = arg;
+        break;
+      }
+      Add(argv[arg], arg);
+    }
+    return;
+  }
+
+  argv_t tokens(argv.get_allocator());
+  tokens.reserve(argv.size());
+
+  // argv[0] is the command and never a name
+  if (!argv.empty()) {
+    tokens.push_back(argv[0]);
+  }
+
+  for (size_t arg = 1; arg < argv.size(); ++arg) {
+    const string_view argument = argv[arg];
+
+    // the rest are positional, copied as they are
+    if (argument == "--") {
+      m_terminator = tokens.size();
+      tokens.insert(tokens.end(), std::next(argv.cbegin(), arg), argv.cend());
+      break;
+    }
+
+    const size_t equals = argument.find('=');
+
+    if (argument.size() > 2 && argument[0] == '-' && argument[1] == '-' &&
+        equals != string_view::npos && equals > 2) {
+      const string_view name = argument.substr(0, equals);
+      // an unknown name stays one argument, e.g. for the tail
+      if (!names || names->find(name) == names->cend()) {
+        Add(name, tokens.size(), true);
+        tokens.push_back(argument);
+        continue;
+      }
+
+      m_isSplit.resize(tokens.size() + 1);
+      m_isSplit[tokens.size()] = true;
+      Add(name, tokens.size());
+      tokens.push_back(name);
+      tokens.push_back(argument.substr(equals + 1));
+      continue;
+    }
+
+    if (m_hasBundles && IsBundle(argument)) {
+      m_bundles.push_back(tokens.size());
+      for (char c : argument.substr(1)) {
+        Add(ShortName(c), tokens.size());
+      }
+    } else {
+      Add(argument, tokens.size());
+    }
+    tokens.push_back(argument);
+  }
+
+  if (!m_isSplit.empty()) {
+    m_isSplit.resize(tokens.size());
+  }
+  argv.swap(tokens);
+}
+
+POPTS_INLINE void ArgvIndex::Join(argv_t &argv) const {
+  if (m_isSplit.empty()) {
+    return;
+  }
+
+  // the name and the value are views into the same argument
+  argv_t arguments(argv.get_allocator());
+  arguments.reserve(argv.size());
+  for (size_t token = 0; token < argv.size(); ++token) {
+    if (token < m_isSplit.size() && m_isSplit[token]) {
+      const string_view name = argv[token];
+      const string_view value = argv[++token];
+      arguments.emplace_back(name.data(),
+                             value.data() + value.size() - name.data());
+    } else {
+      arguments.push_back(argv[token]);
+    }
+  }
+  argv.swap(arguments);
+}
+
+POPTS_INLINE void ArgvIndex::Add(string_view name, size_t position,
+                                 bool isJoined) {
+  m_nodes.push_back(Node{position, npos, isJoined});
+  const size_t node = m_nodes.size() - 1;
+
+  auto inserted = m_names.try_emplace(name, node, node);
+  if (!inserted.second) {
+    m_nodes[inserted.first->second.second].m_next = node;
+    inserted.first->second.second = node;
+  }
+}
+
+POPTS_INLINE size_t ArgvIndex::FirstPosition(string_view name) const {
+  size_t position = npos;
+  ForEachPosition(name, [&position](size_t pos) {
+    position = std::min(position, pos);
+  });
+  return position;
+}
+
+POPTS_INLINE bool ArgvIndex::IsSplit(size_t position) const {
+  return position < m_isSplit.size() && m_isSplit[position];
+}
+
+POPTS_INLINE bool ArgvIndex::IsJoined(string_view name) const {
+  auto nodes = m_names.find(name);
+  if (nodes == m_names.cend()) {
+    return false;
+  }
+
+  for (size_t node = nodes->second.first; node != npos;
+       node = m_nodes[node].m_next) {
+    if (m_nodes[node].m_isJoined) {
+      return true;
+    }
+  }
+  return false;
+}
+
+POPTS_INLINE bool ArgvIndex::IsBundle(string_view argument) {
+  return argument.size() > 2 && argument[0] == '-' &&
+         std::all_of(std::next(argument.cbegin()), argument.cend(),
+                     [](char c) {
+                       return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+                     });
+}
+
+POPTS_INLINE string_view ArgvIndex::ShortName(char c) {
+  static const std::array<char, 512> names = [] {
+    std::array<char, 512> names{};
+    for (size_t i = 0; i < 256; ++i) {
+      names[2 * i] = '-';
+      names[2 * i + 1] = static_cast<char>(i);
+    }
+    return names;
+  }();
+
+  return string_view(names.data() + 2 * static_cast<unsigned char>(c), 2);
+}
+
+POPTS_INLINE Option::Option(std::pmr::memory_resource *resource)
+    : m_names(resource), m_description(resource), m_defaultString(resource),
+      m_matches(resource), m_parseErrors(resource),
+      m_environmentName(resource), m_fallbackErrors(resource),
+      m_fallbackSource(resource) {}
+
+POPTS_INLINE void OptionDeleter::operator()(Option *option) const {
+  // the start of the OptionImpl, which need not be where Option is
+  void *block = dynamic_cast<void *>(option);
+  option->~Option();
+  m_resource->deallocate(block, m_size, m_alignment);
+}
+
+POPTS_INLINE unsigned int Option::ParseMatches(const argv_t &argv,
+                                               const ArgvIndex &index) {
+  m_matches.clear();
+  m_parseErrors.clear();
+
+  for (auto name = m_names.cbegin(); name != m_names.cend(); ++name) {
+    if (std::find(m_names.cbegin(), name, *name) != name) {
+      continue;
+    }
+    index.ForEachPosition(*name, [this, &argv, &index](size_t pos) {
+      // a flag takes no value, "--flag=value" is an error
+      if (m_isFlag && index.IsSplit(pos)) {
+        m_parseErrors.push_back(std::next(argv.cbegin(), pos + 1));
+      } else {
+        m_matches.push_back(std::next(argv.cbegin(), pos + 1));
+      }
+    });
+  }
+
+  // several names interleave, restore argv order. A bundle like "-ab" matches
+  // several names at the same position, each counts.
+  if (m_names.size() > 1) {
+    std::sort(m_matches.begin(), m_matches.end());
+    std::sort(m_parseErrors.begin(), m_parseErrors.end());
+  }
+
+  return m_matches.size();
+}
+
+template <>
+// static
+POPTS_INLINE bool OptionTraits<duration_t>::FromString(string_view data,
+                                                       duration_t &out) {
+  // a sequence of <number><unit>, e.g. 5ms, 1.5h or 1h30m
+  using std::chrono::duration;
+
+  const char *it = data.data();
+  const char *last = it + data.size();
+
+  auto unit = [&it, last](string_view symbol) {
+    if (string_view(it, last - it).substr(0, symbol.size()) != symbol) {
+      return false;
+    }
+    it += symbol.size();
+    return true;
+  };
+
+  if (it == last) {
+    return false;
+  }
+
+  duration_t sum(0);
+  while (it != last) {
+    // from_chars would also accept a sign, inf and nan
+    if (!std::isdigit(static_cast<unsigned char>(*it)) && *it != '.') {
+      return false;
+    }
+
+    long double value;
+    auto result = detail::FromChars(it, last, value);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+    it = result.ptr;
+
+    if (unit("d")) {
+      sum += duration<long double, std::ratio<86400>>(value);
+    } else if (unit("h")) {
+      sum += duration<long double, std::ratio<3600>>(value);
+    } else if (unit("ms")) {
+      sum += duration<long double, std::milli>(value);
+    } else if (unit("m")) {
+      sum += duration<long double, std::ratio<60>>(value);
+    } else if (unit("s")) {
+      sum += duration<long double, std::ratio<1>>(value);
+    } else if (unit("us") || unit("\xC2\xB5s") || unit("\xCE\xBCs")) {
+      // 'u', micro sign and greek small letter mu
+      sum += duration<long double, std::micro>(value);
+    } else if (unit("ns")) {
+      sum += duration<long double, std::nano>(value);
+    } else {
+      return false;
+    }
+  }
+
+  out = sum;
+  return true;
+}
+
+template <>
+// static
+POPTS_INLINE bool OptionTraits<std::string>::FromString(string_view data,
+                                                        std::string &out) {
+  out.assign(data.data(), data.size());
+  return true;
+}
+
+template <>
+// static
+POPTS_INLINE bool OptionTraits<bool>::FromString(string_view data, bool &out) {
+  static const string_view truthy[] = {"true", "1", "on", "yes", "y"};
+  static const string_view falsy[] = {"false", "0", "off", "no", "n"};
+
+  // compares without a lowercase copy, so that parsing does not allocate
+  auto equalsData = [data](string_view word) {
+    return data.size() == word.size() &&
+           std::equal(data.cbegin(), data.cend(), word.cbegin(),
+                      [](char lhs, char rhs) {
+                        return ::std::tolower(
+                                   static_cast<unsigned char>(lhs)) == rhs;
+                      });
+  };
+
+  if (std::any_of(std::cbegin(truthy), std::cend(truthy), equalsData)) {
+    out = true;
+    return true;
+  } else if (std::any_of(std::cbegin(falsy), std::cend(falsy), equalsData)) {
+    out = false;
+    return true;
+  } else {
+    out = true;
+    return false;
+  }
+}
+
+template <>
+// static
+POPTS_INLINE std::string
+OptionTraits<duration_t>::ToString(const duration_t &data) {
+  std::stringstream ss;
+  ss << data.count() << "s";
+  return ss.str();
+}
+
+template <> POPTS_INLINE bool OptionTraits<bool>::FlagMatchValue() {
+  return true;
+}
+
+} // namespace popts
+#endif
+
+#endif
+#pragma once
+#ifndef POPTS_SOURCES_H_INCLUDED
+#define POPTS_SOURCES_H_INCLUDED
+
+
+namespace popts {
+
+// A whole file mapped into memory. The mapping is private, writing to it
+// modifies the process' copy only, which lets tokenizers unescape in place.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  ~MappedFile();
+
+  bool Open(const char *path);
+  void Close();
+
+  char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+// Splits a response file into arguments. Arguments are separated by
+// whitespace or newlines and may be quoted shell-style with '...' or "...",
+// a backslash escapes the next character outside single quotes.
+//
+// Quotes and escapes are removed in place, emit is called with a view into
+// [first, last) for every argument. Returns false on an unterminated quote.
+template <typename F>
+bool TokenizeResponseFile(char *first, char *last, F &&emit);
+
+// The end of the last complete argument of a response file in [first, last),
+// just past the last separator outside quotes, or first if there is none. A
+// prefix of a file read in pieces can be tokenized up to here.
+POPTS_INLINE char *ResponseFileBoundary(char *first, char *last);
+
+// Splits a config file in a subset of INI and TOML into values:
+//
+//   # comments start with '#' or ';'
+//   key = value
+//   [section]
+//   key = "quoted \"value\"" # basic strings unescape \" \\ \t \n
+//   key = 'literal'
+//   key = [1, 2, "three"]      # one value per element, may span lines
+//
+// Escapes are removed in place, emit is called with views into [first, last)
+// as emit(section, key, value), error with the line of malformed lines.
+template <typename Emit, typename Error>
+void TokenizeConfigFile(char *first, char *last, Emit &&emit, Error &&error);
+
+// The values of all config files by section and key. Keys repeat, a key
+// has the values of all lines in the order of the files.
+class ConfigIndex {
+public:
+  explicit ConfigIndex(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_slots(resource), m_entries(resource) {}
+
+  void Reserve(size_t values);
+  void Add(string_view section, string_view key, string_view value,
+           size_t file);
+
+  // Calls f(value, file) with every value of name, which is "key" or
+  // "section.key" for a key in a section.
+  template <typename F> void ForEachValue(string_view name, F &&f) const;
+
+private:
+  struct Key {
+    string_view m_section;
+    string_view m_key;
+    bool operator==(const Key &other) const {
+      return m_section == other.m_section && m_key == other.m_key;
+    }
+  };
+
+  struct Entry {
+    Key m_key;
+    string_view m_value;
+    uint32_t m_file;
+    uint32_t m_next;
+  };
+
+  // first and last entry of a key, the entries of a key are chained
+  struct Slot {
+    size_t m_hash;
+    uint32_t m_first;
+    uint32_t m_last;
+  };
+
+  static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+  static size_t Hash(const Key &key);
+  size_t FindSlot(const Key &key, size_t hash) const;
+  void Rehash(size_t slotCount);
+
+  // Open addressing with linear probing, at most half full. A config has
+  // millions of keys, nodes of a std::unordered_map would be allocated and
+  // visited one by one.
+  std::pmr::vector<Slot> m_slots;
+  size_t m_keyCount = 0;
+  std::pmr::vector<Entry> m_entries;
+};
+
+// A copy of the environment taken once and indexed by variable name, so that
+// options look their variable up instead of scanning the environment.
+class Environment {
+public:
+  explicit Environment(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_buffer(resource), m_variables(resource) {}
+
+  // envp is a null-terminated array of "NAME=value" like environ, or null
+  // for an empty environment.
+  void Load(const char *const *envp);
+  bool IsLoaded() const { return m_isLoaded; }
+
+  // The value of the variable or nullptr if it is not set.
+  const string_view *Find(string_view name) const;
+
+private:
+  std::pmr::vector<char> m_buffer;
+  std::pmr::unordered_map<string_view, string_view> m_variables;
+  bool m_isLoaded = false;
+};
+
+// The environment of the process.
+POPTS_INLINE const char *const *SystemEnvironment();
+
+} // namespace popts
+
+namespace popts {
+
+template <typename Emit, typename Error>
+void TokenizeConfigFile(char *first, char *last, Emit &&emit, Error &&error) {
+  auto isBlank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+
+  char *in = first;
+  size_t line = 1;
+  string_view section;
+
+  auto skipBlanks = [&in, last, &isBlank]() {
+    while (in != last && isBlank(*in)) {
+      ++in;
+    }
+  };
+
+  auto skipLine = [&in, last]() {
+    while (in != last && *in != '\n') {
+      ++in;
+    }
+  };
+
+  // arrays may span lines and contain comments
+  auto skipSpace = [&in, last, &line, &skipBlanks, &skipLine]() {
+    for (skipBlanks(); in != last && (*in == '\n' || *in == '#');
+         skipBlanks()) {
+      if (*in == '\n') {
+        ++line;
+        ++in;
+      } else {
+        skipLine();
+      }
+    }
+  };
+
+  auto isEndOfLine = [&in, last]() {
+    return in == last || *in == '\n' || *in == '#';
+  };
+
+  // a quoted or bare value at in, bare elements of arrays end at ',' or ']'
+  auto parseValue = [&in, last, &isBlank, &isEndOfLine](bool isElement,
+                                                        string_view &value) {
+    char *begin = in;
+    if (*in == '"') {
+      // only write when something has been removed, untouched pages of a
+      // private mapping are then never copied
+      char *out = ++begin;
+      for (++in; in != last && *in != '"' && *in != '\n'; ++in, ++out) {
+        char c = *in;
+        if (c == '\\' && std::next(in) != last) {
+          switch (*++in) {
+          case 'n':
+            c = '\n';
+            break;
+          case 't':
+            c = '\t';
+            break;
+          case '"':
+          case '\\':
+            c = *in;
+            break;
+          default:
+            return false;
+          }
+        }
+        if (out != in) {
+          *out = c;
+        }
+      }
+      if (in == last || *in != '"') {
+        return false;
+      }
+      ++in;
+      value = string_view(begin, out - begin);
+      return true;
+    }
+
+    if (*in == '\'') {
+      for (++begin, ++in; in != last && *in != '\'' && *in != '\n';) {
+        ++in;
+      }
+      if (in == last || *in != '\'') {
+        return false;
+      }
+      value = string_view(begin, in - begin);
+      ++in;
+      return true;
+    }
+
+    while (!isEndOfLine() && !(isElement && (*in == ',' || *in == ']'))) {
+      ++in;
+    }
+    char *end = in;
+    while (end != begin && isBlank(end[-1])) {
+      --end;
+    }
+    value = string_view(begin, end - begin);
+    return !value.empty();
+  };
+
+  while (in != last) {
+    skipBlanks();
+    if (in == last) {
+      break;
+    }
+    if (*in == '\n') {
+      ++line;
+      ++in;
+      continue;
+    }
+    if (*in == '#' || *in == ';') {
+      skipLine();
+      continue;
+    }
+
+    const size_t firstLine = line;
+    bool isValid = true;
+
+    if (*in == '[') {
+      ++in;
+      skipBlanks();
+      char *begin = in;
+      while (in != last && *in != ']' && *in != '\n') {
+        ++in;
+      }
+      char *end = in;
+      while (end != begin && isBlank(end[-1])) {
+        --end;
+      }
+
+      isValid = in != last && *in == ']' && end != begin;
+      if (isValid) {
+        section = string_view(begin, end - begin);
+        ++in;
+      }
+    } else {
+      char *begin = in;
+      while (in != last && *in != '=' && *in != '\n' && !isBlank(*in)) {
+        ++in;
+      }
+      const string_view key(begin, in - begin);
+
+      skipBlanks();
+      isValid = !key.empty() && in != last && *in == '=';
+      if (isValid) {
+        ++in;
+        skipBlanks();
+      }
+
+      string_view value;
+      if (isValid && in != last && *in == '[') {
+        ++in;
+        skipSpace();
+        while (isValid && in != last && *in != ']') {
+          isValid = parseValue(true, value);
+          if (isValid) {
+            emit(section, key, value);
+            skipSpace();
+            if (in != last && *in == ',') {
+              ++in;
+              skipSpace();
+            } else {
+              isValid = in != last && *in == ']';
+            }
+          }
+        }
+        isValid = isValid && in != last;
+        if (isValid) {
+          ++in;
+        }
+      } else if (isValid) {
+        isValid = !isEndOfLine() && parseValue(false, value);
+        if (isValid) {
+          emit(section, key, value);
+        }
+      }
+    }
+
+    skipBlanks();
+    if (!isValid || !isEndOfLine()) {
+      error(firstLine);
+    }
+    skipLine();
+  }
+}
+
+template <typename F>
+void ConfigIndex::ForEachValue(string_view name, F &&f) const {
+  if (m_slots.empty()) {
+    return;
+  }
+
+  auto forEach = [this, &f](const Key &key) {
+    const Slot &slot = m_slots[FindSlot(key, Hash(key))];
+    for (uint32_t entry = slot.m_first; entry != npos;
+         entry = m_entries[entry].m_next) {
+      f(m_entries[entry].m_value, m_entries[entry].m_file);
+    }
+  };
+
+  // any dot may separate the section, "a.b.c" is also key "b.c" in "[a]"
+  forEach(Key{string_view(), name});
+  for (size_t dot = name.find('.'); dot != string_view::npos;
+       dot = name.find('.', dot + 1)) {
+    forEach(Key{name.substr(0, dot), name.substr(dot + 1)});
+  }
+}
+
+template <typename F>
+bool TokenizeResponseFile(char *first, char *last, F &&emit) {
+  auto isSpace = [](char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  };
+
+  char *in = first;
+  char *out = first;
+
+  // only write when something has been removed, untouched pages of a private
+  // mapping are then never copied
+  auto put = [&out, &in]() {
+    if (out != in) {
+      *out = *in;
+    }
+    ++out;
+    ++in;
+  };
+
+  while (in != last) {
+    while (in != last && isSpace(*in)) {
+      ++in;
+    }
+    if (in == last) {
+      break;
+    }
+
+    out = in;
+    char *token = out;
+
+    while (in != last && !isSpace(*in)) {
+      if (*in == '\'') {
+        ++in;
+        while (in != last && *in != '\'') {
+          put();
+        }
+        if (in == last) {
+          return false;
+        }
+        ++in;
+      } else if (*in == '"') {
+        ++in;
+        while (in != last && *in != '"') {
+          if (*in == '\\' && std::next(in) != last &&
+              (in[1] == '"' || in[1] == '\\')) {
+            ++in;
+          }
+          put();
+        }
+        if (in == last) {
+          return false;
+        }
+        ++in;
+      } else {
+        if (*in == '\\' && std::next(in) != last) {
+          ++in;
+        }
+        put();
+      }
+    }
+
+    emit(string_view(token, out - token));
+  }
+
+  return true;
+}
+
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include <cstdlib>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+namespace popts {
+
+POPTS_INLINE MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {}
+
+POPTS_INLINE MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    Close();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+POPTS_INLINE MappedFile::~MappedFile() { Close(); }
+
+POPTS_INLINE bool MappedFile::Open(const char *path) {
+  Close();
+
+#ifdef _WIN32
+  HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(file, &size)) {
+    ::CloseHandle(file);
+    return false;
+  }
+
+  // an empty file cannot be mapped, but is a valid empty file
+  if (size.QuadPart > 0) {
+    HANDLE mapping =
+        ::CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping) {
+      m_data = static_cast<char *>(
+          ::MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+      ::CloseHandle(mapping);
+    }
+    m_size = m_data ? static_cast<size_t>(size.QuadPart) : 0;
+  }
+
+  ::CloseHandle(file);
+  return m_data || size.QuadPart == 0;
+#else
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // an empty file cannot be mapped, but is a valid empty file
+  bool isOpen = info.st_size == 0;
+  if (info.st_size > 0) {
+    void *data = ::mmap(nullptr, static_cast<size_t>(info.st_size),
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      ::madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+      m_data = static_cast<char *>(data);
+      m_size = static_cast<size_t>(info.st_size);
+      isOpen = true;
+    }
+  }
+
+  ::close(fd);
+  return isOpen;
+#endif
+}
+
+POPTS_INLINE void MappedFile::Close() {
+  if (m_data) {
+#ifdef _WIN32
+    ::UnmapViewOfFile(m_data);
+#else
+    ::munmap(m_data, m_size);
+#endif
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+POPTS_INLINE void ConfigIndex::Reserve(size_t values) {
+  m_entries.reserve(m_entries.size() + values);
+
+  size_t slotCount = 16;
+  while (slotCount < 2 * (m_keyCount + values)) {
+    slotCount *= 2;
+  }
+  if (slotCount > m_slots.size()) {
+    Rehash(slotCount);
+  }
+}
+
+POPTS_INLINE void ConfigIndex::Add(string_view section, string_view key,
+                                   string_view value, size_t file) {
+  if (2 * (m_keyCount + 1) > m_slots.size()) {
+    Rehash(std::max<size_t>(16, 2 * m_slots.size()));
+  }
+
+  const Key entryKey{section, key};
+  const auto entry = static_cast<uint32_t>(m_entries.size());
+  m_entries.push_back(
+      Entry{entryKey, value, static_cast<uint32_t>(file), npos});
+
+  const size_t hash = Hash(entryKey);
+  Slot &slot = m_slots[FindSlot(entryKey, hash)];
+  if (slot.m_first == npos) {
+    slot = Slot{hash, entry, entry};
+    ++m_keyCount;
+  } else {
+    m_entries[slot.m_last].m_next = entry;
+    slot.m_last = entry;
+  }
+}
+
+POPTS_INLINE size_t ConfigIndex::Hash(const Key &key) {
+  const std::hash<string_view> hash;
+  return hash(key.m_section) * 31 + hash(key.m_key);
+}
+
+POPTS_INLINE size_t ConfigIndex::FindSlot(const Key &key, size_t hash) const {
+  const size_t mask = m_slots.size() - 1;
+  size_t slot = hash & mask;
+  while (m_slots[slot].m_first != npos &&
+         (m_slots[slot].m_hash != hash ||
+          !(m_entries[m_slots[slot].m_first].m_key == key))) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+POPTS_INLINE void ConfigIndex::Rehash(size_t slotCount) {
+  std::pmr::vector<Slot> slots(slotCount, Slot{0, npos, npos},
+                               m_slots.get_allocator());
+  m_slots.swap(slots);
+
+  for (const Slot &slot : slots) {
+    if (slot.m_first != npos) {
+      m_slots[FindSlot(m_entries[slot.m_first].m_key, slot.m_hash)] = slot;
+    }
+  }
+}
+
+POPTS_INLINE void Environment::Load(const char *const *envp) {
+  // environ is null after clearenv, that is an empty environment
+  static const char *const empty[] = {nullptr};
+  if (!envp) {
+    envp = empty;
+  }
+
+  size_t bufferSize = 0;
+  for (auto variable = envp; *variable; ++variable) {
+    bufferSize += std::char_traits<char>::length(*variable);
+  }
+
+  m_buffer.assign(bufferSize, '\0');
+  m_variables.clear();
+
+  // one block for all variables, the views stay valid if the process changes
+  // its environment later
+  char *out = m_buffer.data();
+  for (auto variable = envp; *variable; ++variable) {
+    const size_t size = std::char_traits<char>::length(*variable);
+    const string_view copy(out, size);
+    out = std::copy(*variable, *variable + size, out);
+
+    // Windows has variables like "=C:=C:\dir", the name cannot be empty
+    const size_t equals = copy.find('=', 1);
+    if (equals != string_view::npos) {
+      m_variables.try_emplace(copy.substr(0, equals),
+                              copy.substr(equals + 1));
+    }
+  }
+
+  m_isLoaded = true;
+}
+
+POPTS_INLINE const string_view *Environment::Find(string_view name) const {
+  auto variable = m_variables.find(name);
+  return variable != m_variables.cend() ? &variable->second : nullptr;
+}
+
+POPTS_INLINE const char *const *SystemEnvironment() {
+#ifdef _WIN32
+  return _environ;
+#else
+  return environ;
+#endif
+}
+
+POPTS_INLINE char *ResponseFileBoundary(char *first, char *last) {
+  char *boundary = first;
+  char quote = 0;
+
+  for (char *in = first; in != last; ++in) {
+    if (quote) {
+      if (*in == quote) {
+        quote = 0;
+      } else if (quote == '"' && *in == '\\' && std::next(in) != last &&
+                 (in[1] == '"' || in[1] == '\\')) {
+        ++in;
+      }
+    } else if (*in == '\'' || *in == '"') {
+      quote = *in;
+    } else if (*in == '\\') {
+      if (std::next(in) == last) {
+        break;
+      }
+      ++in;
+    } else if (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n') {
+      boundary = std::next(in);
+    }
+  }
+
+  return boundary;
+}
+
+} // namespace popts
+#endif
+
+#endif
+
+#include <atomic>
+
+namespace popts {
+
+class Snapshot;
+
+// What an argument has been claimed as during parsing, see
+// Options::Ownership().
+struct ArgOwner {
+  enum class Role : uint8_t { None, Name, Argument, Terminator };
+
+  static constexpr uint32_t NoOption = std::numeric_limits<uint32_t>::max();
+
+  // registration index of the option that claimed the argument first
+  uint32_t m_option = NoOption;
+  Role m_role = Role::None;
+  // claimed again, e.g. a name consumed as the argument of another option
+  bool m_isConflict = false;
+};
+
+// What checks and the description need of every option, in arrays indexed
+// by registration order. Walking them touches a few contiguous blocks instead
+// of every Option. The views point into the options, whose names, description
+// and default are not modified after registration.
+struct OptionRegistry {
+  explicit OptionRegistry(std::pmr::memory_resource *resource);
+
+  // Appends a registered option.
+  void Add(const Option &option);
+  // Takes the errors of an option that has been parsed.
+  void Update(size_t index, const Option &option);
+
+  size_t size() const { return m_descriptions.size(); }
+  // The first option from index on that has errors or is lazy, or size().
+  size_t NextToCheck(size_t index) const;
+
+  static bool IsSet(const std::pmr::vector<uint64_t> &bits, size_t index) {
+    return (bits[index / 64] >> (index % 64)) & 1;
+  }
+
+  // the names of option i are [m_nameBegin[i], m_nameBegin[i + 1])
+  std::pmr::vector<string_view> m_names;
+  std::pmr::vector<uint32_t> m_nameBegin;
+  std::pmr::vector<string_view> m_descriptions;
+  std::pmr::vector<string_view> m_defaults;
+  // of "names, ... (...) [=default]"
+  std::pmr::vector<uint32_t> m_namesWidths;
+  // one bit per option
+  std::pmr::vector<uint64_t> m_isFlag;
+  std::pmr::vector<uint64_t> m_isMultiple;
+  std::pmr::vector<uint64_t> m_isLazy;
+  // known after parsing, lazy options only know after Resolve
+  std::pmr::vector<uint64_t> m_hasErrors;
+
+private:
+  static void Assign(std::pmr::vector<uint64_t> &bits, size_t index,
+                     bool value);
+};
+
+class Options {
+public:
+  using argv_t = Option::argv_t;
+
+private:
+  struct tail_t {
+    argv_t::const_iterator cbegin() const { return m_cbegin; }
+    argv_t::const_iterator cend() const { return m_cend; }
+    argv_t::const_iterator m_cbegin, m_cend;
+  };
+
+  // destroys a subcommand allocated from the resource of its parent
+  struct CommandDeleter {
+    void operator()(Options *command) const;
+
+    std::pmr::memory_resource *m_resource;
+  };
+
+  // an occurrence of the name of a subcommand in the uncut argv
+  struct CommandCandidate {
+    size_t m_position;
+    const Options *m_command;
+    // the value of an option, e.g. "build" in "--name build"
+    bool m_isValue;
+  };
+
+public:
+  // Everything Options keeps is allocated from resource, e.g. a
+  // std::pmr::monotonic_buffer_resource, subcommands included. It has to
+  // outlive the Options. The values handed out and the cached Description use
+  // the default allocator.
+  Options(const vector<string> &argv, std::pmr::memory_resource *resource =
+                                          std::pmr::get_default_resource());
+  Options(int argc, char **argv,
+          std::pmr::memory_resource *resource =
+              std::pmr::get_default_resource());
+  // The references handed out stay valid. Not assignable, the arguments
+  // could be copied to a different resource then.
+  Options(Options &&other);
+
+  Options &WithHelp();
+
+  // Replaces every argument '@path' with the arguments in the file at path,
+  // recursively. Call before adding options.
+  Options &WithResponseFiles();
+
+  // Reads every argument of a dash and two or more letters as a bundle of
+  // short options, "-abc" is "-a -b -c". Names of more than one letter need
+  // two dashes then. Call before adding subcommands and options, the
+  // subcommands bundle as well.
+  Options &WithBundles();
+
+  // Takes the environment variables of options from envp, a null-terminated
+  // array of "NAME=value" like the third argument of main, null is empty.
+  // Without it the environment of the process is read when the first option
+  // needs it. Call before adding options.
+  Options &WithEnvironment(const char *const *envp);
+
+  // Reads values for options without matches in argv from the config file at
+  // path, see TokenizeConfigFile. Keys are option names without leading
+  // dashes, "section.key" for keys in sections. argv and the environment take
+  // precedence. Values of earlier files come first, single options take the
+  // first value. Call before adding options.
+  Options &WithConfigFile(const char *path);
+
+  // Adds a subcommand with its own options and returns them, e.g.
+  // `tool [options] build [build options]`. The first argument that is the
+  // name of a subcommand selects it. The options of this table only match
+  // before it, the options of the subcommand only after it, and Tail and
+  // Description are scoped the same way. Call before adding options.
+  Options &Subcommand(const char *name, const string &description);
+  // The selected subcommand or nullptr.
+  const Options *SelectedSubcommand() const;
+
+  // Parses argv again for the options registered so far, without registering
+  // them again. Response files, config files and the process environment are
+  // read again as well.
+  //
+  // The values are updated in place: the reference of a single option sees
+  // the new value, the container of a multiple option is refilled. Reading
+  // values while Reparse runs is a data race, readers on other threads have
+  // to be synchronized with the caller.
+  Options &Reparse(const vector<string> &argv);
+  Options &Reparse(int argc, char **argv);
+
+  // Incremented by every Reparse, readers can poll it to detect a change.
+  uint64_t Generation() const;
+  // Copies all values for readers on other threads, see SnapshotPublisher.
+  std::shared_ptr<const Snapshot> MakeSnapshot() const;
+
+  bool HasDuplicateNames(std::ostream *out = nullptr) const;
+  // The option registered first under name or nullptr.
+  const Option *FindOption(string_view name) const;
+  bool HasErrorMatches(std::ostream *out = nullptr) const;
+  bool HasConsistentTail(std::ostream *out = nullptr) const;
+  tail_t Tail() const;
+  // One entry per argument in argv, argv[0] is never claimed.
+  const std::pmr::vector<ArgOwner> &Ownership() const;
+  // The help text, built once and cached until the next option is added.
+  const string &Description() const;
+  // Writes the help text to out without building it in memory first.
+  void Description(std::ostream &out) const;
+
+  // An option without matches in argv takes its value from the environment
+  // variable environmentName if it is set, before falling back to the default.
+  template <typename T>
+  const T &MakeOption(std::initializer_list<const char *> names,
+                      const T &defaultArgument, const string &description,
+                      const char *environmentName = nullptr);
+
+  // Storage may be any container OptionImpl accepts, e.g. SmallVector<T>.
+  template <typename T, typename Storage = deque<T>>
+  const Storage &MakeOptions(std::initializer_list<const char *> names,
+                             const string &description,
+                             const char *environmentName = nullptr);
+
+  // Like MakeOptions, but every argument is a list of values separated by
+  // separator, e.g. "--weights 0.1,0.2,0.3". The values are contiguous.
+  template <typename T>
+  const vector<T> &MakeListOptions(std::initializer_list<const char *> names,
+                                   char separator, const string &description,
+                                   const char *environmentName = nullptr);
+
+  // Like MakeOption and MakeOptions, but the arguments are converted on the
+  // first access of the handle. HasErrorMatches converts all lazy options.
+  template <typename T>
+  Lazy<T> MakeLazyOption(std::initializer_list<const char *> names,
+                         const T &defaultArgument, const string &description,
+                         const char *environmentName = nullptr);
+
+  template <typename T, typename Storage = deque<T>>
+  Lazy<Storage> MakeLazyOptions(std::initializer_list<const char *> names,
+                                const string &description,
+                                const char *environmentName = nullptr);
+
+  const bool &Flag(std::initializer_list<const char *> names,
+                   const string &description,
+                   const char *environmentName = nullptr);
+
+  const deque<bool> &Flags(std::initializer_list<const char *> names,
+                           const string &description,
+                           const char *environmentName = nullptr);
+
+#define DEFINE_OPTION_FUNC(Type, Name)                                         \
+  const Type &Name(std::initializer_list<const char *> names,                  \
+                   const Type &defaultArgument, const string &description,     \
+                   const char *environmentName = nullptr) {                    \
+    return MakeOption<Type>(names, defaultArgument, description,               \
+                            environmentName);                                  \
+  }                                                                            \
+                                                                               \
+  const deque<Type> &Name##s(std::initializer_list<const char *> names,        \
+                             const string &description,                        \
+                             const char *environmentName = nullptr) {          \
+    return MakeOptions<Type>(names, description, environmentName);             \
+  }
+
+  DEFINE_OPTION_FUNC(string, String)
+  DEFINE_OPTION_FUNC(bool, Bool)
+  DEFINE_OPTION_FUNC(int64_t, Int)
+  DEFINE_OPTION_FUNC(long double, Double)
+  DEFINE_OPTION_FUNC(duration_t, Duration)
+
+#undef DEFINE_OPTION_FUNC
+
+// not for bool, vector<bool> has no references to its elements
+#define DEFINE_LIST_OPTION_FUNC(Type, Name)                                    \
+  const vector<Type> &Name##s(std::initializer_list<const char *> names,       \
+                              char separator, const string &description,       \
+                              const char *environmentName = nullptr) {         \
+    return MakeListOptions<Type>(names, separator, description,                \
+                                 environmentName);                             \
+  }
+
+  DEFINE_LIST_OPTION_FUNC(string, String)
+  DEFINE_LIST_OPTION_FUNC(int64_t, Int)
+  DEFINE_LIST_OPTION_FUNC(long double, Double)
+  DEFINE_LIST_OPTION_FUNC(duration_t, Duration)
+
+#undef DEFINE_LIST_OPTION_FUNC
+
+private:
+  friend class TailReader;
+
+  // a subcommand of parent, with argv[0] the name of the command
+  Options(const Options &parent, const char *name, const string &description);
+
+  void AssignArgv(const vector<string> &argv);
+  // Splits and indexes argv and resets the claims on it.
+  void BuildIndex();
+  void ResetClaims();
+  // Parses the first count options again, from a clean ownership table.
+  void ParseOptions(size_t count);
+  // Cuts argv at the first candidate that is no value and passes the rest to
+  // its subcommand. The others see no arguments, forced parses them again
+  // either way. Returns whether the cut moved.
+  bool SelectSubcommand(bool isForced);
+  // Adds the positions of the name of command to the candidates.
+  void AddCandidates(const Options &command);
+  // Checks the candidates again that a new option can turn into values or
+  // back: those at its names and in the run of values after them. Returns
+  // whether any changed.
+  bool RecheckCandidates(const Option &option);
+  // Whether the argument at position of the uncut argv is the value of an
+  // option of this table, e.g. "build" in "--name build".
+  bool IsOptionValue(size_t position) const;
+  // Whether argument is a name of an option of this table that takes a
+  // value, or a bundle that ends with one.
+  bool TakesValue(string_view argument) const;
+  string CommandPath() const;
+  void ExpandResponseFiles();
+  void ExpandResponseFile(string_view argument, argv_t &expanded,
+                          vector<string> &openFiles);
+
+  void LoadConfigFile(size_t fileIndex);
+
+  // Parses every option again, from scratch, after argv or sources changed.
+  void ReparseAll();
+  // Records the matches of an option in the ownership table, the registry and
+  // the tail.
+  void ClaimMatches(size_t optionIndex);
+  void Claim(size_t position, size_t option, ArgOwner::Role role);
+
+  Fallback FindFallback(const Option &option);
+
+  template <typename Put> void WriteDescription(Put &&put) const;
+
+  template <typename T, typename Storage = deque<T>>
+  OptionImpl<T, Storage> &AddOption(std::initializer_list<const char *> names,
+                                    const T &defaultArgument,
+                                    const string &description, size_t count,
+                                    bool isFlag, const char *environmentName,
+                                    bool isLazy = false, char separator = 0);
+
+private:
+  // first, the members below are allocated from it
+  std::pmr::memory_resource *m_resource;
+  // owns the arguments if they were not passed as argc/argv
+  std::pmr::vector<char> m_argvBuffer{m_resource};
+  argv_t m_argv{m_resource};
+  argv_t::const_iterator m_tail = m_argv.cbegin();
+  // built on the first registration, constructing Options does not allocate
+  // more than the argument table
+  ArgvIndex m_index{m_resource};
+  bool m_isIndexed = false;
+  // indexed like m_argv, replaces collecting and sorting matches for checks
+  std::pmr::vector<ArgOwner> m_owners{m_resource};
+  mutable string m_description;
+  mutable bool m_isDescriptionCached = false;
+  std::pmr::vector<std::unique_ptr<Option, OptionDeleter>> m_options{
+      m_resource};
+  OptionRegistry m_registry{m_resource};
+  // option index by name, keys point into Option::m_names
+  std::pmr::unordered_map<string_view, size_t> m_nameIndex{m_resource};
+  // names registered more than once, each listed once
+  std::pmr::vector<string_view> m_duplicateNames{m_resource};
+  // response and config files the arguments point into
+  std::pmr::vector<MappedFile> m_mappedFiles{m_resource};
+  bool m_hasResponseFiles = false;
+  // errors of argument sources other than argv, e.g. unreadable files
+  std::pmr::vector<std::pmr::string> m_sourceErrors{m_resource};
+  Environment m_environment{m_resource};
+  // read again by Reparse, unlike an environment passed in
+  bool m_isSystemEnvironment = false;
+  ConfigIndex m_config{m_resource};
+  std::pmr::vector<std::pmr::string> m_configFiles{m_resource};
+  std::atomic<uint64_t> m_generation{0};
+  // subcommands, argv up to the selected one is in m_argv
+  std::pmr::vector<std::unique_ptr<Options, CommandDeleter>> m_commands{
+      m_resource};
+  argv_t m_commandArgv{m_resource};
+  ArgvIndex m_commandIndex{m_resource};
+  // sorted by position, found once per subcommand and argv
+  std::pmr::vector<CommandCandidate> m_commandCandidates{m_resource};
+  const Options *m_selectedCommand = nullptr;
+  size_t m_commandPosition = ArgvIndex::npos;
+  // for a subcommand
+  const Options *m_parent = nullptr;
+  std::pmr::string m_commandName{m_resource};
+  std::pmr::string m_commandDescription{m_resource};
+};
+
+} // namespace popts
+
+#include <cassert>
+
+namespace popts {
+
+template <typename Put> void Options::WriteDescription(Put &&put) const {
+  const auto &registry = m_registry;
+
+  size_t colWidth = 0;
+  for (auto width : registry.m_namesWidths) {
+    colWidth = std::max<size_t>(colWidth, width);
+  }
+  for (const auto &command : m_commands) {
+    colWidth = std::max(colWidth, command->m_commandName.size());
+  }
+
+  put("Usage '");
+  put(CommandPath());
+  put(m_commands.empty() ? "' [options]\n" : "' [options] command ...\n");
+
+  const string_view spaces = "                ";
+  auto pad = [&put, &spaces](size_t padding) {
+    while (padding > 0) {
+      const size_t chunk = std::min(padding, spaces.size());
+      put(spaces.substr(0, chunk));
+      padding -= chunk;
+    }
+  };
+  for (size_t index = 0; index < registry.size(); ++index) {
+    const size_t firstName = registry.m_nameBegin[index];
+    for (size_t name = firstName; name < registry.m_nameBegin[index + 1];
+         ++name) {
+      if (name != firstName) {
+        put(", ");
+      }
+      put(registry.m_names[name]);
+    }
+
+    const bool isMultiple = registry.IsSet(registry.m_isMultiple, index);
+    if (isMultiple) {
+      put(" (...)");
+    }
+
+    if (!isMultiple && !registry.IsSet(registry.m_isFlag, index)) {
+      put(" [=");
+      put(registry.m_defaults[index]);
+      put("]");
+    }
+
+    pad(colWidth + 4 - registry.m_namesWidths[index]);
+    put(registry.m_descriptions[index]);
+    put("\n");
+  }
+
+  if (!m_commands.empty()) {
+    put("\nCommands\n");
+  }
+  for (const auto &command : m_commands) {
+    put(command->m_commandName);
+    pad(colWidth + 4 - command->m_commandName.size());
+    put(command->m_commandDescription);
+    put("\n");
+  }
+}
+
+template <typename T>
+const T &Options::MakeOption(std::initializer_list<const char *> names,
+                             const T &defaultArgument,
+                             const string &description,
+                             const char *environmentName) {
+  auto &option = AddOption(names, defaultArgument, description, Option::Single,
+                           false, environmentName);
+  return option.m_storage.front();
+}
+
+template <typename T, typename Storage>
+const Storage &Options::MakeOptions(std::initializer_list<const char *> names,
+                                    const string &description,
+                                    const char *environmentName) {
+  auto &option = AddOption<T, Storage>(names, T(), description, Option::Many,
+                                       false, environmentName);
+  return option.m_storage;
+}
+
+template <typename T>
+const vector<T> &
+Options::MakeListOptions(std::initializer_list<const char *> names,
+                         char separator, const string &description,
+                         const char *environmentName) {
+  static_assert(!std::is_same<T, bool>::value,
+                "vector<bool> has no references to its elements");
+
+  auto &option = AddOption<T, vector<T>>(names, T(), description, Option::Many,
+                                         false, environmentName, false,
+                                         separator);
+  return option.m_storage;
+}
+
+template <typename T>
+Lazy<T> Options::MakeLazyOption(std::initializer_list<const char *> names,
+                                const T &defaultArgument,
+                                const string &description,
+                                const char *environmentName) {
+  auto &option = AddOption(names, defaultArgument, description, Option::Single,
+                           false, environmentName, true);
+  return Lazy<T>(option, option.m_storage.front());
+}
+
+template <typename T, typename Storage>
+Lazy<Storage>
+Options::MakeLazyOptions(std::initializer_list<const char *> names,
+                         const string &description,
+                         const char *environmentName) {
+  auto &option = AddOption<T, Storage>(names, T(), description, Option::Many,
+                                       false, environmentName, true);
+  return Lazy<Storage>(option, option.m_storage);
+}
+
+template <typename T, typename Storage>
+OptionImpl<T, Storage> &
+Options::AddOption(std::initializer_list<const char *> names,
+                   const T &defaultArgument, const string &description,
+                   size_t count, bool isFlag, const char *environmentName,
+                   bool isLazy, char separator) {
+  using Impl = OptionImpl<T, Storage>;
+  void *block = m_resource->allocate(sizeof(Impl), alignof(Impl));
+  std::unique_ptr<Option, OptionDeleter> owner(
+      new (block) Impl(m_resource),
+      OptionDeleter{m_resource, sizeof(Impl), alignof(Impl)});
+  m_options.push_back(std::move(owner));
+
+  auto &option = static_cast<Impl &>(*m_options.back());
+  std::copy(std::cbegin(names), std::cend(names),
+            std::back_inserter(option.m_names));
+
+  // the names are not modified after this, the index can refer to them
+  for (const auto &name : option.m_names) {
+    assert(!(m_index.m_hasBundles && ArgvIndex::IsBundle(name)) &&
+           "names of several letters need two dashes with bundles");
+    if (!m_nameIndex.try_emplace(name, m_options.size() - 1).second &&
+        std::find(m_duplicateNames.cbegin(), m_duplicateNames.cend(), name) ==
+            m_duplicateNames.cend()) {
+      m_duplicateNames.push_back(name);
+    }
+  }
+
+  option.m_count = count;
+  option.m_isFlag = isFlag;
+  option.m_isLazy = isLazy;
+  option.m_separator = separator;
+  option.m_defaultArgument = defaultArgument;
+  option.m_defaultString = OptionTraits<T>::ToString(defaultArgument);
+  option.m_description = description;
+  option.m_environmentName = environmentName ? environmentName : "";
+  m_registry.Add(option);
+  m_isDescriptionCached = false;
+
+  // a value of the new option is not a subcommand, that can move the cut
+  const bool isCut = !isFlag && !m_commands.empty() &&
+                     RecheckCandidates(option) && SelectSubcommand(false);
+  if (!m_isIndexed) {
+    BuildIndex();
+  }
+  // "--name=value" is split once "--name" is registered
+  const bool isSplit =
+      std::any_of(option.m_names.cbegin(), option.m_names.cend(),
+                  [this](const auto &name) { return m_index.IsJoined(name); });
+  if (isSplit) {
+    m_index.Join(m_argv);
+    BuildIndex();
+  }
+  if (isCut || isSplit) {
+    ParseOptions(m_options.size() - 1);
+  }
+
+  option.ParseArguments(m_argv, m_index, FindFallback(option));
+  ClaimMatches(m_options.size() - 1);
+
+  assert(!HasDuplicateNames());
+
+  return option;
+}
+
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include <cassert>
+#include <filesystem>
+#include <ostream>
+
+namespace popts {
+
+POPTS_INLINE OptionRegistry::OptionRegistry(
+    std::pmr::memory_resource *resource)
+    : m_names(resource), m_nameBegin(resource),
+      m_descriptions(resource), m_defaults(resource),
+      m_namesWidths(resource), m_isFlag(resource), m_isMultiple(resource),
+      m_isLazy(resource), m_hasErrors(resource) {}
+
+POPTS_INLINE void OptionRegistry::Add(const Option &option) {
+  const size_t index = size();
+  const bool isMultiple = option.m_count > Option::Single;
+  const bool hasDefault = !option.m_isFlag && !isMultiple;
+
+  size_t width = 0;
+  for (const auto &name : option.m_names) {
+    m_names.push_back(name);
+    width += name.size() + 2;
+  }
+  width -= std::min<size_t>(width, 2);
+  if (isMultiple) {
+    width += string_view(" (...)").size();
+  }
+  if (hasDefault) {
+    width += string_view(" [=]").size() + option.m_defaultString.size();
+  }
+
+  // the sentinel comes with the first option, construction allocates nothing
+  if (m_nameBegin.empty()) {
+    m_nameBegin.push_back(0);
+  }
+  m_nameBegin.push_back(static_cast<uint32_t>(m_names.size()));
+  m_descriptions.push_back(option.m_description);
+  m_defaults.push_back(hasDefault ? string_view(option.m_defaultString)
+                                  : string_view());
+  m_namesWidths.push_back(static_cast<uint32_t>(width));
+  Assign(m_isFlag, index, option.m_isFlag);
+  Assign(m_isMultiple, index, isMultiple);
+  Assign(m_isLazy, index, option.m_isLazy);
+  Assign(m_hasErrors, index, false);
+}
+
+POPTS_INLINE void OptionRegistry::Update(size_t index, const Option &option) {
+  Assign(m_hasErrors, index,
+         !option.m_parseErrors.empty() || !option.m_fallbackErrors.empty() ||
+             (option.m_count == Option::Single &&
+              option.m_matches.size() > 1));
+}
+
+POPTS_INLINE size_t OptionRegistry::NextToCheck(size_t index) const {
+  const size_t count = size();
+  while (index < count) {
+    const uint64_t bits =
+        (m_hasErrors[index / 64] | m_isLazy[index / 64]) >> (index % 64);
+    if (bits & 1) {
+      return index;
+    }
+    // skips the rest of the word if it has no candidates
+    index = bits ? index + 1 : (index / 64 + 1) * 64;
+  }
+  return count;
+}
+
+POPTS_INLINE void OptionRegistry::Assign(std::pmr::vector<uint64_t> &bits,
+                                         size_t index, bool value) {
+  if (index / 64 >= bits.size()) {
+    bits.resize(index / 64 + 1);
+  }
+  const uint64_t mask = uint64_t(1) << (index % 64);
+  bits[index / 64] = value ? bits[index / 64] | mask : bits[index / 64] & ~mask;
+}
+
+// argv outlives main, so the arguments are referenced instead of copied
+POPTS_INLINE Options::Options(int argc, char **argv,
+                              std::pmr::memory_resource *resource)
+    : m_resource(resource), m_argv(argv, argv + argc, resource) {}
+
+POPTS_INLINE Options::Options(const vector<string> &argv,
+                              std::pmr::memory_resource *resource)
+    : m_resource(resource) {
+  AssignArgv(argv);
+}
+
+// std::atomic cannot be moved, the generation is copied
+POPTS_INLINE Options::Options(Options &&other)
+    : m_resource(other.m_resource),
+      m_argvBuffer(std::move(other.m_argvBuffer)),
+      m_argv(std::move(other.m_argv)), m_tail(other.m_tail),
+      m_index(std::move(other.m_index)), m_isIndexed(other.m_isIndexed),
+      m_owners(std::move(other.m_owners)),
+      m_description(std::move(other.m_description)),
+      m_isDescriptionCached(other.m_isDescriptionCached),
+      m_options(std::move(other.m_options)),
+      m_registry(std::move(other.m_registry)),
+      m_nameIndex(std::move(other.m_nameIndex)),
+      m_duplicateNames(std::move(other.m_duplicateNames)),
+      m_mappedFiles(std::move(other.m_mappedFiles)),
+      m_hasResponseFiles(other.m_hasResponseFiles),
+      m_sourceErrors(std::move(other.m_sourceErrors)),
+      m_environment(std::move(other.m_environment)),
+      m_isSystemEnvironment(other.m_isSystemEnvironment),
+      m_config(std::move(other.m_config)),
+      m_configFiles(std::move(other.m_configFiles)),
+      m_generation(other.m_generation.load()),
+      m_commands(std::move(other.m_commands)),
+      m_commandArgv(std::move(other.m_commandArgv)),
+      m_commandIndex(std::move(other.m_commandIndex)),
+      m_commandCandidates(std::move(other.m_commandCandidates)),
+      m_selectedCommand(other.m_selectedCommand),
+      m_commandPosition(other.m_commandPosition), m_parent(other.m_parent),
+      m_commandName(std::move(other.m_commandName)),
+      m_commandDescription(std::move(other.m_commandDescription)) {
+  // the subcommands are not moved, only their parent
+  for (auto &command : m_commands) {
+    command->m_parent = this;
+  }
+  // the first argument of a subcommand is its name
+  if (m_parent && !m_argv.empty()) {
+    m_argv[0] = m_commandName;
+  }
+}
+
+POPTS_INLINE Options::Options(const Options &parent, const char *name,
+                              const string &description)
+    : m_resource(parent.m_resource), m_parent(&parent),
+      m_commandName(name, m_resource),
+      m_commandDescription(description, m_resource) {
+  m_index.m_hasBundles = parent.m_index.m_hasBundles;
+  m_argv.push_back(m_commandName);
+  m_tail = m_argv.cbegin();
+}
+
+POPTS_INLINE void Options::CommandDeleter::operator()(Options *command) const {
+  command->~Options();
+  m_resource->deallocate(command, sizeof(Options), alignof(Options));
+}
+
+POPTS_INLINE void Options::AssignArgv(const vector<string> &argv) {
+  size_t bufferSize = 0;
+  for (const auto &arg : argv) {
+    bufferSize += arg.size() + 1;
+  }
+
+  // one block for all arguments, each null-terminated like argv
+  m_argvBuffer.resize(bufferSize);
+  m_argv.clear();
+  m_argv.reserve(argv.size());
+
+  char *out = m_argvBuffer.data();
+  for (const auto &arg : argv) {
+    m_argv.emplace_back(out, arg.size());
+    out = std::copy(arg.cbegin(), arg.cend(), out);
+    *out++ = '\0';
+  }
+
+  m_tail = m_argv.cbegin();
+}
+
+POPTS_INLINE Options &Options::WithResponseFiles() {
+  assert(m_options.empty() && "expand response files before adding options");
+  assert(m_commands.empty() && "expand response files before subcommands");
+
+  m_hasResponseFiles = true;
+  ExpandResponseFiles();
+
+  return *this;
+}
+
+POPTS_INLINE Options &Options::WithBundles() {
+  assert(m_options.empty() && "enable bundles before adding options");
+  assert(m_commands.empty() && "enable bundles before subcommands");
+
+  m_index.m_hasBundles = true;
+  return *this;
+}
+
+POPTS_INLINE void Options::ExpandResponseFiles() {
+  argv_t expanded(m_resource);
+  expanded.reserve(m_argv.size());
+
+  vector<string> openFiles;
+  auto arg = m_argv.cbegin();
+  if (arg != m_argv.cend()) {
+    expanded.push_back(*arg++);
+  }
+  // behind "--" they are left to TailReader
+  for (; arg != m_argv.cend() && *arg != "--"; ++arg) {
+    ExpandResponseFile(*arg, expanded, openFiles);
+  }
+  expanded.insert(expanded.end(), arg, m_argv.cend());
+
+  m_argv = std::move(expanded);
+  m_tail = m_argv.cbegin();
+  m_isIndexed = false;
+}
+
+POPTS_INLINE Options &Options::WithEnvironment(const char *const *envp) {
+  // the fallbacks of options refer to the loaded environment
+  assert(m_options.empty() && "set the environment before adding options");
+
+  m_environment.Load(envp);
+  return *this;
+}
+
+POPTS_INLINE Options &Options::WithConfigFile(const char *path) {
+  assert(m_options.empty() && "read config files before adding options");
+
+  m_configFiles.emplace_back(path);
+  LoadConfigFile(m_configFiles.size() - 1);
+
+  return *this;
+}
+
+POPTS_INLINE void Options::LoadConfigFile(size_t fileIndex) {
+  const string path(m_configFiles[fileIndex]);
+
+  MappedFile file;
+  if (!file.Open(path.c_str())) {
+    m_sourceErrors.emplace_back("cannot read config file '" + path + "'");
+    return;
+  }
+
+  // typical lines are longer than 32 bytes, this avoids most rehashing
+  m_config.Reserve(file.size() / 32);
+
+  TokenizeConfigFile(
+      file.data(), file.data() + file.size(),
+      [this, fileIndex](string_view section, string_view key,
+                        string_view value) {
+        m_config.Add(section, key, value, fileIndex);
+      },
+      [this, &path](size_t line) {
+        m_sourceErrors.emplace_back("malformed line " +
+                                    std::to_string(line) +
+                                    " in config file '" + path + "'");
+      });
+
+  m_mappedFiles.push_back(std::move(file));
+}
+
+POPTS_INLINE Options &Options::Subcommand(const char *name,
+                                          const string &description) {
+  assert(m_options.empty() && "add subcommands before options");
+
+  if (m_commands.empty()) {
+    m_commandArgv = m_argv;
+    // the subcommand and this table split their slices themselves
+    m_commandIndex.Build(m_commandArgv, false);
+  }
+
+  void *block = m_resource->allocate(sizeof(Options), alignof(Options));
+  m_commands.push_back(std::unique_ptr<Options, CommandDeleter>(
+      new (block) Options(*this, name, description),
+      CommandDeleter{m_resource}));
+  m_isDescriptionCached = false;
+  AddCandidates(*m_commands.back());
+  SelectSubcommand(false);
+
+  return *m_commands.back();
+}
+
+POPTS_INLINE const Options *Options::SelectedSubcommand() const {
+  return m_selectedCommand;
+}
+
+POPTS_INLINE bool Options::SelectSubcommand(bool isForced) {
+  size_t position = m_commandArgv.size();
+  const Options *selected = nullptr;
+  for (const auto &candidate : m_commandCandidates) {
+    if (!candidate.m_isValue) {
+      position = candidate.m_position;
+      selected = candidate.m_command;
+      break;
+    }
+  }
+
+  if (!isForced && position == m_commandPosition &&
+      selected == m_selectedCommand) {
+    return false;
+  }
+
+  m_argv.assign(m_commandArgv.cbegin(), m_commandArgv.cbegin() + position);
+  m_tail = m_argv.cbegin();
+  m_isIndexed = false;
+  m_selectedCommand = selected;
+  m_commandPosition = position;
+
+  for (const auto &command : m_commands) {
+    argv_t argv({command->m_commandName}, m_resource);
+    if (command.get() == selected) {
+      argv.assign(m_commandArgv.cbegin() + position, m_commandArgv.cend());
+    }
+
+    // only the previously and newly selected commands change
+    if (isForced || argv != command->m_argv) {
+      command->m_argv = std::move(argv);
+      command->m_tail = command->m_argv.cbegin();
+      command->ReparseAll();
+    }
+  }
+  return true;
+}
+
+POPTS_INLINE void Options::AddCandidates(const Options &command) {
+  m_commandIndex.ForEachPosition(
+      command.m_commandName, [this, &command](size_t position) {
+        // after the candidates at the same position, the first command wins
+        auto next = std::upper_bound(
+            m_commandCandidates.cbegin(), m_commandCandidates.cend(), position,
+            [](size_t position, const CommandCandidate &candidate) {
+              return position < candidate.m_position;
+            });
+        const bool isValue = IsOptionValue(position);
+        m_commandCandidates.insert(
+            next, CommandCandidate{position, &command, isValue});
+      });
+}
+
+POPTS_INLINE bool Options::RecheckCandidates(const Option &option) {
+  bool isChanged = false;
+  auto recheck = [this, &isChanged](size_t first, size_t last) {
+    auto candidate = std::lower_bound(
+        m_commandCandidates.begin(), m_commandCandidates.end(), first,
+        [](const CommandCandidate &candidate, size_t position) {
+          return candidate.m_position < position;
+        });
+    for (; candidate != m_commandCandidates.end() &&
+           candidate->m_position <= last;
+         ++candidate) {
+      const bool isValue = IsOptionValue(candidate->m_position);
+      isChanged = isChanged || isValue != candidate->m_isValue;
+      candidate->m_isValue = isValue;
+    }
+  };
+
+  for (const auto &name : option.m_names) {
+    // a letter may end any bundle, the index only knows whole arguments
+    if (m_index.m_hasBundles && name.size() == 2) {
+      recheck(0, ArgvIndex::npos);
+      return isChanged;
+    }
+
+    // the name shifts every second value of the run that follows it
+    m_commandIndex.ForEachPosition(name, [this, &recheck](size_t position) {
+      size_t last = position + 1;
+      while (last < m_commandArgv.size() &&
+             TakesValue(m_commandArgv[last])) {
+        ++last;
+      }
+      recheck(position, last);
+    });
+  }
+  return isChanged;
+}
+
+POPTS_INLINE bool Options::TakesValue(string_view argument) const {
+  const Option *option = FindOption(argument);
+  // a bundle may end with an option that takes the next argument
+  if (!option && m_index.m_hasBundles && ArgvIndex::IsBundle(argument)) {
+    option = FindOption(ArgvIndex::ShortName(argument.back()));
+  }
+  return option && !option->m_isFlag;
+}
+
+POPTS_INLINE bool Options::IsOptionValue(size_t position) const {
+  // in a run of arguments that take values, every second one is a value
+  size_t first = position;
+  while (first > 1 && TakesValue(m_commandArgv[first - 1])) {
+    --first;
+  }
+  return (position - first) % 2 == 1;
+}
+
+POPTS_INLINE string Options::CommandPath() const {
+  if (m_parent) {
+    return m_parent->CommandPath().append(" ").append(m_commandName);
+  }
+
+  string_view cmdName = m_argv.empty() ? string_view() : m_argv[0];
+  size_t slashPos = cmdName.find_last_of("/\\");
+  if (slashPos != string_view::npos) {
+    cmdName.remove_prefix(slashPos + 1);
+  }
+  return string(cmdName);
+}
+
+POPTS_INLINE Options &Options::Reparse(const vector<string> &argv) {
+  AssignArgv(argv);
+  ReparseAll();
+  return *this;
+}
+
+POPTS_INLINE Options &Options::Reparse(int argc, char **argv) {
+  m_argvBuffer = std::pmr::vector<char>(m_resource);
+  m_argv.assign(argv, argv + argc);
+  m_tail = m_argv.cbegin();
+  ReparseAll();
+  return *this;
+}
+
+POPTS_INLINE uint64_t Options::Generation() const {
+  return m_generation.load(std::memory_order_acquire);
+}
+
+POPTS_INLINE void Options::BuildIndex() {
+  m_index.Build(m_argv, true, &m_nameIndex);
+  ResetClaims();
+  m_isIndexed = true;
+}
+
+POPTS_INLINE void Options::ResetClaims() {
+  m_tail = m_argv.cbegin();
+  m_owners.assign(m_argv.size(), ArgOwner());
+  if (m_index.m_terminator != ArgvIndex::npos) {
+    m_owners[m_index.m_terminator].m_role = ArgOwner::Role::Terminator;
+  }
+}
+
+POPTS_INLINE void Options::ParseOptions(size_t count) {
+  ResetClaims();
+  for (size_t option = 0; option < count; ++option) {
+    m_options[option]->ParseArguments(m_argv, m_index,
+                                      FindFallback(*m_options[option]));
+    ClaimMatches(option);
+  }
+}
+
+POPTS_INLINE void Options::ReparseAll() {
+  // the old mappings are not referenced once every source is read again
+  m_sourceErrors.clear();
+  m_mappedFiles.clear();
+
+  if (m_hasResponseFiles) {
+    ExpandResponseFiles();
+  }
+
+  m_config = ConfigIndex(m_resource);
+  for (size_t file = 0; file < m_configFiles.size(); ++file) {
+    LoadConfigFile(file);
+  }
+
+  if (m_isSystemEnvironment) {
+    m_environment.Load(SystemEnvironment());
+  }
+
+  if (!m_commands.empty()) {
+    m_commandArgv = m_argv;
+    m_commandIndex.Build(m_commandArgv, false);
+    m_commandCandidates.clear();
+    for (const auto &command : m_commands) {
+      AddCandidates(*command);
+    }
+    SelectSubcommand(true);
+  }
+
+  BuildIndex();
+  m_isDescriptionCached = false;
+  ParseOptions(m_options.size());
+
+  m_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+POPTS_INLINE void Options::ExpandResponseFile(string_view argument,
+                                              argv_t &expanded,
+                                              vector<string> &openFiles) {
+  if (argument.size() < 2 || argument[0] != '@') {
+    expanded.push_back(argument);
+    return;
+  }
+
+  const string path(argument.substr(1));
+
+  std::error_code error;
+  const string canonicalPath =
+      std::filesystem::canonical(path, error).string();
+
+  // kept as it is like GCC and Clang do, e.g. the value of "--mention @bob"
+  MappedFile file;
+  if (error || !file.Open(path.c_str())) {
+    expanded.push_back(argument);
+    return;
+  }
+
+  // the open files are the current nesting, a file inside itself is a cycle
+  if (std::find(openFiles.cbegin(), openFiles.cend(), canonicalPath) !=
+      openFiles.cend()) {
+    m_sourceErrors.emplace_back("response file includes itself: '" + path +
+                                "'");
+    return;
+  }
+
+  openFiles.push_back(canonicalPath);
+  bool isComplete =
+      TokenizeResponseFile(file.data(), file.data() + file.size(),
+                           [this, &expanded, &openFiles](string_view arg) {
+                             ExpandResponseFile(arg, expanded, openFiles);
+                           });
+  openFiles.pop_back();
+
+  if (!isComplete) {
+    m_sourceErrors.emplace_back("unterminated quote in response file '" +
+                                path + "'");
+  }
+
+  m_mappedFiles.push_back(std::move(file));
+}
+
+POPTS_INLINE bool Options::HasDuplicateNames(std::ostream *out) const {
+  if (out) {
+    for (auto name : m_duplicateNames) {
+      (*out) << "Duplicate name: " << name << "\n";
+    }
+  }
+
+  return !m_duplicateNames.empty();
+}
+
+POPTS_INLINE const Option *Options::FindOption(string_view name) const {
+  auto option = m_nameIndex.find(name);
+  return option != m_nameIndex.cend() ? m_options[option->second].get()
+                                      : nullptr;
+}
+
+POPTS_INLINE bool Options::HasErrorMatches(std::ostream *out) const {
+  auto quotedArgument = [this](argv_t::const_iterator it) {
+    if (it == m_argv.cend()) {
+      return "<null>"s;
+    }
+    return "'"s + string(*it) + "'"s;
+  };
+
+  auto commentSeparatedList = [this, quotedArgument](auto *out,
+                                                     const auto &container) {
+    auto from = std::cbegin(container);
+    auto to = std::cend(container);
+
+    if (from == to) {
+      return;
+    }
+
+    (*out) << quotedArgument(*from);
+
+    for (++from; from != to; ++from) {
+      (*out) << ", " << quotedArgument(*from);
+    }
+  };
+
+  bool hasErrors = !m_sourceErrors.empty();
+  if (out) {
+    for (const auto &error : m_sourceErrors) {
+      (*out) << error << "\n";
+    }
+  }
+
+  // options without errors are not looked at
+  for (size_t index = m_registry.NextToCheck(0); index < m_registry.size();
+       index = m_registry.NextToCheck(index + 1)) {
+    const auto &option = m_options[index];
+    option->Resolve();
+
+    // Check for errors
     if (!option->m_parseErrors.empty()) {
       hasErrors = true;
 
-      if (!out) {
-        break;
-      }
-      (*out) << "error matches for option '" << option->m_names[0] << "': ";
-      commentSeparatedList(out, option->m_parseErrors);
-      (*out) << "\n";
+      if (!out) {
+        break;
+      }
+      (*out) << "error matches for option '" << option->m_names[0] << "': ";
+      commentSeparatedList(out, option->m_parseErrors);
+      (*out) << "\n";
+    }
+
+    // Only reported if argv did not take precedence
+    if (!option->m_fallbackErrors.empty()) {
+      hasErrors = true;
+      if (!out) {
+        break;
+      }
+
+      (*out) << "error in " << option->m_fallbackSource << " for option '"
+             << option->m_names[0] << "': ";
+      for (auto value = option->m_fallbackErrors.cbegin();
+           value != option->m_fallbackErrors.cend(); ++value) {
+        (*out) << (value == option->m_fallbackErrors.cbegin() ? "'" : ", '")
+               << *value << "'";
+      }
+      (*out) << "\n";
+    }
+
+    // Check if only one is allowed
+    if (option->m_count == Option::Single && option->m_matches.size() > 1) {
+      hasErrors = true;
+      if (!out) {
+        break;
+      }
+
+      (*out) << "multiple matches for single option '" << option->m_names[0]
+             << "'";
+
+      if (!option->m_isFlag) {
+        (*out) << ": ";
+        commentSeparatedList(out, option->m_matches);
+      }
+
+      (*out) << "\n";
+    }
+  }
+
+  // Check the letters of bundles, only the last may take a value
+  for (size_t position : m_index.m_bundles) {
+    if (!out && hasErrors) {
+      break;
+    }
+
+    const string_view bundle = m_argv[position];
+    for (size_t letter = 1; letter < bundle.size(); ++letter) {
+      const string_view name = ArgvIndex::ShortName(bundle[letter]);
+      const Option *option = FindOption(name);
+      if (option && (option->m_isFlag || letter + 1 == bundle.size())) {
+        continue;
+      }
+
+      hasErrors = true;
+      if (!out) {
+        break;
+      }
+      if (option) {
+        (*out) << "option '" << name << "' takes a value, not last in bundle '"
+               << bundle << "'\n";
+      } else {
+        (*out) << "unknown option '" << name << "' in bundle '" << bundle
+               << "'\n";
+      }
+    }
+  }
+
+  // Check if match has been used as a argument value
+  for (size_t pos = 0; pos < m_owners.size() && (out || !hasErrors); ++pos) {
+    if (m_owners[pos].m_isConflict) {
+      hasErrors = true;
+      if (out) {
+        (*out) << "Name consumed as argument before: '" << m_argv[pos]
+               << "'\n";
+      }
+    }
+  }
+
+  return hasErrors;
+}
+
+POPTS_INLINE bool Options::HasConsistentTail(std::ostream *out) const {
+  bool hasHoles = false;
+  bool hasClaimed = false;
+  size_t holeBegin = 0;
+
+  // unclaimed arguments between claimed ones are holes
+  for (size_t pos = 0; pos < m_owners.size(); ++pos) {
+    if (m_owners[pos].m_role == ArgOwner::Role::None) {
+      if (hasClaimed && !holeBegin) {
+        holeBegin = pos;
+      }
+      continue;
+    }
+
+    if (holeBegin) {
+      hasHoles = true;
+
+      if (!out) {
+        break;
+      }
+
+      for (size_t hole = holeBegin; hole < pos; ++hole) {
+        (*out) << "unparsed argument '" << m_argv[hole] << "' before parsed '";
+        (*out) << m_argv[pos] << "'\n";
+      }
+      holeBegin = 0;
+    }
+
+    hasClaimed = true;
+  }
+
+  return !hasHoles;
+}
+
+POPTS_INLINE Options::tail_t Options::Tail() const {
+  // everything after "--" is positional, whatever has been matched before
+  if (m_isIndexed && m_index.m_terminator != ArgvIndex::npos) {
+    return tail_t{std::next(m_argv.cbegin(), m_index.m_terminator + 1),
+                  m_argv.cend()};
+  }
+  return tail_t{m_tail, m_argv.cend()};
+}
+
+POPTS_INLINE const std::pmr::vector<ArgOwner> &Options::Ownership() const {
+  return m_owners;
+}
+
+POPTS_INLINE Fallback Options::FindFallback(const Option &option) {
+  Fallback fallback(m_resource);
+
+  if (!option.m_environmentName.empty()) {
+    if (!m_environment.IsLoaded()) {
+      m_environment.Load(SystemEnvironment());
+      m_isSystemEnvironment = true;
+    }
+    if (auto value = m_environment.Find(option.m_environmentName)) {
+      fallback.m_values.push_back(*value);
+      fallback.m_source.append("environment variable '")
+          .append(option.m_environmentName)
+          .append("'");
+      return fallback;
+    }
+  }
+
+  // the values of the first name that has any
+  for (string_view name : option.m_names) {
+    const size_t dashes = std::min(name.find_first_not_of('-'), name.size());
+    m_config.ForEachValue(name.substr(dashes),
+                          [this, &fallback](string_view value, size_t file) {
+                            if (fallback.m_values.empty()) {
+                              fallback.m_source.append("config file '")
+                                  .append(m_configFiles[file])
+                                  .append("'");
+                            }
+                            fallback.m_values.push_back(value);
+                          });
+    if (!fallback.m_values.empty()) {
+      break;
+    }
+  }
+
+  return fallback;
+}
+
+POPTS_INLINE void Options::ClaimMatches(size_t optionIndex) {
+  const Option &option = *m_options[optionIndex];
+
+  for (auto match : option.m_matches) {
+    const size_t argument = match - m_argv.cbegin();
+    Claim(argument - 1, optionIndex, ArgOwner::Role::Name);
+    if (!option.m_isFlag && match != m_argv.cend() &&
+        m_owners[argument].m_role != ArgOwner::Role::Terminator) {
+      Claim(argument, optionIndex, ArgOwner::Role::Argument);
+    }
+  }
+
+  // a flag given a value claims both, the value is reported as an error
+  if (option.m_isFlag) {
+    for (auto value : option.m_parseErrors) {
+      const size_t argument = value - m_argv.cbegin();
+      Claim(argument - 1, optionIndex, ArgOwner::Role::Name);
+      Claim(argument, optionIndex, ArgOwner::Role::Argument);
+      m_tail = std::max(value + 1, m_tail);
+    }
+  }
+
+  m_registry.Update(optionIndex, option);
+
+  if (option.m_matches.size() > 0) {
+    // a match points past the name. Flags have no argument to skip, nor has
+    // an option whose argument is missing at the end of argv.
+    auto last = option.m_matches.back();
+    if (!option.m_isFlag && last != m_argv.cend()) {
+      ++last;
+    }
+    m_tail = std::max(last, m_tail);
+  }
+}
+
+POPTS_INLINE void Options::Claim(size_t position, size_t option,
+                                 ArgOwner::Role role) {
+  ArgOwner &owner = m_owners[position];
+  if (owner.m_role == ArgOwner::Role::None) {
+    owner.m_option = static_cast<uint32_t>(option);
+    owner.m_role = role;
+  } else if (role != ArgOwner::Role::Name ||
+             owner.m_role != ArgOwner::Role::Name ||
+             !ArgvIndex::IsBundle(m_argv[position])) {
+    // the names in a bundle share its position
+    owner.m_isConflict = true;
+  }
+}
+
+POPTS_INLINE const string &Options::Description() const {
+  if (!m_isDescriptionCached) {
+    m_description.clear();
+    WriteDescription([this](string_view text) { m_description.append(text); });
+    m_isDescriptionCached = true;
+  }
+
+  return m_description;
+}
+
+POPTS_INLINE void Options::Description(std::ostream &out) const {
+  WriteDescription(
+      [&out](string_view text) { out.write(text.data(), text.size()); });
+}
+
+POPTS_INLINE const bool &
+Options::Flag(std::initializer_list<const char *> names,
+              const string &description, const char *environmentName) {
+  auto &option = AddOption(names, false, description, Option::Single, true,
+                           environmentName);
+  return option.m_storage.front();
+}
+
+POPTS_INLINE const deque<bool> &
+Options::Flags(std::initializer_list<const char *> names,
+               const string &description, const char *environmentName) {
+  auto &option = AddOption(names, false, description, Option::Many, true,
+                           environmentName);
+  return option.m_storage;
+}
+
+} // namespace popts
+#endif
+
+#pragma once
+#ifndef POPTS_SCHEMA_H_INCLUDED
+#define POPTS_SCHEMA_H_INCLUDED
+
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+///////////////////////////////////////////////////////////////////////////////
+// Compile-time option schema
+//
+// All options are declared up front as one constexpr value. The compiler
+// builds a perfect hash table of all names and every option is stored in a
+// plain member of the parse result, so parsing flags and fixed-size values
+// does not allocate.
+//
+//   constexpr auto schema = popts::MakeSchema(
+//       popts::StaticFlag({"-v", "--verbose"}, "Toggle verbosity"),
+//       popts::StaticOption<int64_t>({"-j", "--jobs"}, 1, "Parallel jobs"),
+//       popts::StaticOptions<string_view, 8>({"-I"}, "Include directory"));
+//
+//   auto opts = schema.Parse(argc, argv);
+//   bool verbose = opts.Get<0>();
+//
+
+namespace popts {
+
+namespace detail {
+
+// Not constexpr on purpose, reaching it during constant evaluation turns an
+// invalid schema into a compile error.
+inline void SchemaError(const char *message) {
+  (void)message;
+  assert(!"invalid schema");
+}
+
+// Writes the parts one after the other, the templates do not need <ostream>.
+POPTS_INLINE void WriteParts(std::ostream &out,
+                             std::initializer_list<string_view> parts);
+
+constexpr uint64_t Hash(string_view name, uint64_t seed) {
+  uint64_t hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+  for (char c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash ^ (hash >> 29);
+}
+
+constexpr size_t NextPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+template <size_t N, size_t... Is>
+constexpr std::array<string_view, N> ToArray(const string_view (&names)[N],
+                                             std::index_sequence<Is...>) {
+  return {{names[Is]...}};
+}
+
+template <typename T> bool StaticFromString(string_view data, T &out) {
+  if constexpr (std::is_same<T, string_view>::value) {
+    out = data;
+    return true;
+  } else {
+    return OptionTraits<T>::FromString(data, out);
+  }
+}
+
+} // namespace detail
+
+// Storage of an option with up to Capacity values.
+template <typename T, size_t Capacity> struct FixedValues {
+  const T *begin() const { return m_values.data(); }
+  const T *end() const { return m_values.data() + m_size; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  const T &operator[](size_t i) const { return m_values[i]; }
+
+  std::array<T, Capacity> m_values{};
+  size_t m_size = 0;
+};
+
+template <typename T, size_t NameCount_, size_t Count_, bool IsFlag_>
+struct SchemaOption {
+  using value_type = T;
+
+  static constexpr size_t NameCount = NameCount_;
+  static constexpr size_t Count = Count_;
+  static constexpr bool IsFlag = IsFlag_;
+
+  // single flags are a bool, multiple flags are counted
+  using storage_type = std::conditional_t<
+      IsFlag, std::conditional_t<Count == Option::Single, bool, size_t>,
+      std::conditional_t<Count == Option::Single, T, FixedValues<T, Count>>>;
+
+  std::array<string_view, NameCount> m_names;
+  T m_defaultArgument;
+  string_view m_description;
+};
+
+template <size_t N>
+constexpr SchemaOption<bool, N, Option::Single, true>
+StaticFlag(const string_view (&names)[N], string_view description) {
+  return {detail::ToArray(names, std::make_index_sequence<N>()), false,
+          description};
+}
+
+template <size_t N>
+constexpr SchemaOption<bool, N, Option::Many, true>
+StaticFlags(const string_view (&names)[N], string_view description) {
+  return {detail::ToArray(names, std::make_index_sequence<N>()), false,
+          description};
+}
+
+template <typename T, size_t N>
+constexpr SchemaOption<T, N, Option::Single, false>
+StaticOption(const string_view (&names)[N], const T &defaultArgument,
+             string_view description) {
+  return {detail::ToArray(names, std::make_index_sequence<N>()),
+          defaultArgument, description};
+}
+
+template <typename T, size_t Capacity, size_t N>
+constexpr SchemaOption<T, N, Capacity, false>
+StaticOptions(const string_view (&names)[N], string_view description) {
+  static_assert(Capacity > 0 && Capacity < Option::Many,
+                "StaticOptions needs a fixed capacity");
+  return {detail::ToArray(names, std::make_index_sequence<N>()), T(),
+          description};
+}
+
+template <typename... Opts> class ParsedOptions;
+
+template <typename... Opts> class Schema {
+public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+  static constexpr size_t OptionCount = sizeof...(Opts);
+  static constexpr size_t NameCount = (Opts::NameCount + ... + 0);
+  // half empty, so that a displacement for every bucket is found quickly
+  static constexpr size_t TableSize = detail::NextPowerOfTwo(2 * NameCount);
+  static constexpr size_t BucketCount = TableSize / 2 + (TableSize == 1);
+
+  constexpr explicit Schema(const Opts &... options);
+
+  // Index of the option with the given name or npos.
+  constexpr size_t Find(string_view name) const;
+
+  ParsedOptions<Opts...> Parse(int argc, const char *const *argv) const;
+
+  std::tuple<Opts...> m_options;
+  std::array<string_view, OptionCount> m_primaryNames{};
+
+  // hash and displace: the bucket of a name selects the seed of its slot
+  std::array<uint64_t, BucketCount> m_seeds{};
+  std::array<string_view, TableSize> m_slotNames{};
+  std::array<size_t, TableSize> m_slotOptions{};
+};
+
+template <typename... Opts>
+constexpr Schema<Opts...> MakeSchema(const Opts &... options) {
+  return Schema<Opts...>(options...);
+}
+
+template <typename... Opts> class ParsedOptions {
+  struct tail_t {
+    const char *const *cbegin() const { return m_cbegin; }
+    const char *const *cend() const { return m_cend; }
+    const char *const *m_cbegin;
+    const char *const *m_cend;
+  };
+
+public:
+  enum class Error : uint8_t {
+    MissingArgument,
+    InvalidArgument,
+    MultipleMatches,
+    TooManyArguments
+  };
+
+  struct ErrorMatch {
+    size_t m_position;
+    size_t m_option;
+    Error m_error;
+  };
+
+  // errors beyond this are counted but not recorded
+  static constexpr size_t MaxRecordedErrors = 8;
+
+  template <size_t I> const auto &Get() const { return std::get<I>(m_values); }
+
+  bool HasErrorMatches(std::ostream *out = nullptr) const;
+  tail_t Tail() const;
+
+private:
+  friend class Schema<Opts...>;
+
+  template <size_t... Is>
+  ParsedOptions(const Schema<Opts...> &schema, int argc,
+                const char *const *argv, std::index_sequence<Is...>);
+
+  template <size_t... Is>
+  size_t Consume(size_t option, size_t pos, std::index_sequence<Is...>);
+
+  template <size_t I> size_t Consume(size_t pos);
+
+  void AddError(size_t pos, size_t option, Error error);
+
+  std::tuple<typename Opts::storage_type...> m_values;
+  std::array<bool, sizeof...(Opts)> m_isMatched{};
+  std::array<string_view, sizeof...(Opts)> m_primaryNames;
+  const char *const *m_argv;
+  size_t m_argc;
+  size_t m_tail = 1;
+
+  std::array<ErrorMatch, MaxRecordedErrors> m_errors{};
+  size_t m_errorCount = 0;
+};
+
+template <typename... Opts>
+constexpr Schema<Opts...>::Schema(const Opts &... options)
+    : m_options(options...) {
+  constexpr size_t tableMask = TableSize - 1;
+
+  // flatten all names, remembering their options
+  std::array<string_view, NameCount> names{};
+  std::array<size_t, NameCount> owners{};
+  size_t nameCount = 0;
+  size_t optionIndex = 0;
+
+  auto addNames = [&](const auto &option) {
+    m_primaryNames[optionIndex] = option.m_names[0];
+    for (string_view name : option.m_names) {
+      names[nameCount] = name;
+      owners[nameCount] = optionIndex;
+      ++nameCount;
     }
+    ++optionIndex;
+  };
+  (addNames(options), ...);
 
-    // Check if only one is allowed
-    if (option->m_count == Option::Single && option->m_matches.size() > 1) {
-      hasErrors = true;
-      if (!out) {
-        break;
-      }
+  // group names by bucket
+  std::array<size_t, NameCount> buckets{};
+  std::array<size_t, BucketCount + 1> bucketStart{};
+  for (size_t i = 0; i < NameCount; ++i) {
+    buckets[i] = detail::Hash(names[i], 0) % BucketCount;
+    ++bucketStart[buckets[i] + 1];
+  }
 
-      (*out) << "multiple matches for single option '" << option->m_names[0]
-             << "'";
+  size_t largestBucket = 0;
+  for (size_t b = 0; b < BucketCount; ++b) {
+    largestBucket = std::max(largestBucket, bucketStart[b + 1]);
+    bucketStart[b + 1] += bucketStart[b];
+  }
 
-      if (!option->m_isFlag) {
-        (*out) << ": ";
-        commentSeparatedList(out, option->m_matches);
+  std::array<size_t, NameCount> byBucket{};
+  std::array<size_t, BucketCount> filled{};
+  for (size_t i = 0; i < NameCount; ++i) {
+    byBucket[bucketStart[buckets[i]] + filled[buckets[i]]++] = i;
+  }
+
+  for (size_t slot = 0; slot < TableSize; ++slot) {
+    m_slotOptions[slot] = npos;
+  }
+
+  // place the largest buckets first, they are the hardest to fit
+  for (size_t size = largestBucket; size > 0; --size) {
+    for (size_t b = 0; b < BucketCount; ++b) {
+      const size_t first = bucketStart[b];
+      const size_t last = bucketStart[b + 1];
+      if (last - first != size) {
+        continue;
       }
 
-      (*out) << "\n";
-    }
+      for (size_t i = first; i < last; ++i) {
+        for (size_t j = i + 1; j < last; ++j) {
+          if (names[byBucket[i]] == names[byBucket[j]]) {
+            detail::SchemaError("duplicate option name");
+          }
+        }
+      }
 
-    // Check if match has been used as a argument value
-    for (auto match : option->m_matches) {
-      if (!option->m_isFlag) {
-        allMatches.push_back(match);
+      bool isPlaced = false;
+      for (uint64_t seed = 1; !isPlaced && seed < (1u << 20); ++seed) {
+        isPlaced = true;
+        for (size_t i = first; isPlaced && i < last; ++i) {
+          size_t slot = detail::Hash(names[byBucket[i]], seed) & tableMask;
+          isPlaced = m_slotOptions[slot] == npos;
+
+          for (size_t j = first; isPlaced && j < i; ++j) {
+            isPlaced = slot != (detail::Hash(names[byBucket[j]], seed) &
+                                tableMask);
+          }
+        }
+
+        if (isPlaced) {
+          m_seeds[b] = seed;
+          for (size_t i = first; i < last; ++i) {
+            size_t slot = detail::Hash(names[byBucket[i]], seed) & tableMask;
+            m_slotNames[slot] = names[byBucket[i]];
+            m_slotOptions[slot] = owners[byBucket[i]];
+          }
+        }
+      }
+
+      if (!isPlaced) {
+        detail::SchemaError("no perfect hash for the option names");
       }
-      allMatches.push_back(--match);
     }
   }
+}
+
+template <typename... Opts>
+constexpr size_t Schema<Opts...>::Find(string_view name) const {
+  if (NameCount == 0) {
+    return npos;
+  }
+
+  uint64_t seed = m_seeds[detail::Hash(name, 0) % BucketCount];
+  size_t slot = detail::Hash(name, seed) & (TableSize - 1);
+
+  return (m_slotOptions[slot] != npos && m_slotNames[slot] == name)
+             ? m_slotOptions[slot]
+             : npos;
+}
+
+template <typename... Opts>
+ParsedOptions<Opts...> Schema<Opts...>::Parse(int argc,
+                                              const char *const *argv) const {
+  ParsedOptions<Opts...> parsed(*this, argc, argv,
+                                std::index_sequence_for<Opts...>());
 
-  std::sort(allMatches.begin(), allMatches.end());
-  auto duplicateIt = std::adjacent_find(allMatches.cbegin(), allMatches.cend());
-  while (duplicateIt != allMatches.cend()) {
-    hasErrors = true;
-    if (!out) {
+  for (size_t pos = 1; pos < parsed.m_argc; ++pos) {
+    // "--" ends the options like in Options, the tail starts behind it
+    if (string_view(argv[pos]) == "--") {
+      parsed.m_tail = pos + 1;
       break;
     }
 
-    (*out) << "Name consumed as argument before: '" << **duplicateIt << "'\n";
+    size_t option = Find(argv[pos]);
+    if (option == npos) {
+      continue;
+    }
 
-    duplicateIt = std::adjacent_find(++duplicateIt, allMatches.cend());
+    pos = parsed.Consume(option, pos, std::index_sequence_for<Opts...>());
+    parsed.m_tail = pos + 1;
   }
 
-  return hasErrors;
+  return parsed;
 }
 
-bool Options::HasConsistentTail(std::ostream *out) const {
-  vector<argv_t::const_iterator> allConsumed;
-  for (const auto &option : m_options) {
-    for (auto it = option->m_matches.cbegin(); it != option->m_matches.cend();
-         ++it) {
-      allConsumed.push_back(std::prev(*it));
-      if (!option->m_isFlag) {
-        assert(*it != m_argv.cend());
-        allConsumed.push_back(*it);
+template <typename... Opts>
+template <size_t... Is>
+ParsedOptions<Opts...>::ParsedOptions(const Schema<Opts...> &schema, int argc,
+                                      const char *const *argv,
+                                      std::index_sequence<Is...>)
+    : m_primaryNames(schema.m_primaryNames), m_argv(argv),
+      m_argc(argc > 0 ? argc : 0) {
+  auto setDefault = [](const auto &option, auto &storage) {
+    using option_t = std::decay_t<decltype(option)>;
+    if constexpr (!option_t::IsFlag && option_t::Count == Option::Single) {
+      storage = option.m_defaultArgument;
+    }
+  };
+  (setDefault(std::get<Is>(schema.m_options), std::get<Is>(m_values)), ...);
+}
+
+template <typename... Opts>
+template <size_t... Is>
+size_t ParsedOptions<Opts...>::Consume(size_t option, size_t pos,
+                                       std::index_sequence<Is...>) {
+  (void)((option == Is && ((pos = Consume<Is>(pos)), true)) || ...);
+  return pos;
+}
+
+template <typename... Opts>
+template <size_t I>
+size_t ParsedOptions<Opts...>::Consume(size_t pos) {
+  using option_t = std::tuple_element_t<I, std::tuple<Opts...>>;
+  auto &storage = std::get<I>(m_values);
+
+  const bool isFirstMatch = !m_isMatched[I];
+  m_isMatched[I] = true;
+
+  if constexpr (option_t::IsFlag) {
+    if constexpr (option_t::Count == Option::Single) {
+      if (!isFirstMatch) {
+        AddError(pos, I, Error::MultipleMatches);
+      }
+      storage = true;
+    } else {
+      ++storage;
+    }
+    return pos;
+  } else {
+    // an option right before "--" has no value
+    if (pos + 1 >= m_argc || string_view(m_argv[pos + 1]) == "--") {
+      AddError(pos + 1, I, Error::MissingArgument);
+      return pos;
+    }
+
+    ++pos;
+    typename option_t::value_type value{};
+    if (!detail::StaticFromString(m_argv[pos], value)) {
+      AddError(pos, I, Error::InvalidArgument);
+      return pos;
+    }
+
+    if constexpr (option_t::Count == Option::Single) {
+      // the first occurrence wins, like Options::MakeOption
+      if (isFirstMatch) {
+        storage = value;
+      } else {
+        AddError(pos, I, Error::MultipleMatches);
+      }
+    } else {
+      if (storage.m_size == option_t::Count) {
+        AddError(pos, I, Error::TooManyArguments);
+      } else {
+        storage.m_values[storage.m_size++] = value;
       }
     }
+    return pos;
   }
+}
 
-  if (allConsumed.size() == 0) {
-    return true;
+template <typename... Opts>
+void ParsedOptions<Opts...>::AddError(size_t pos, size_t option, Error error) {
+  if (m_errorCount < MaxRecordedErrors) {
+    m_errors[m_errorCount] = ErrorMatch{pos, option, error};
+  }
+  ++m_errorCount;
+}
+
+template <typename... Opts>
+bool ParsedOptions<Opts...>::HasErrorMatches(std::ostream *out) const {
+  if (!out) {
+    return m_errorCount > 0;
   }
 
-  // remove duplicates
-  std::sort(allConsumed.begin(), allConsumed.end());
-  allConsumed.erase(std::unique(allConsumed.begin(), allConsumed.end()),
-                    allConsumed.end());
+  const size_t recorded = std::min(m_errorCount, MaxRecordedErrors);
+  for (size_t i = 0; i < recorded; ++i) {
+    const ErrorMatch &match = m_errors[i];
+    const string_view name = m_primaryNames[match.m_option];
 
-  bool hasHoles = false;
-  // a slightly modified adjacent_find
-  auto it = allConsumed.cbegin();
-  auto end = allConsumed.cend();
-  auto nextArg = std::next(it);
-
-  for (; nextArg != end; ++nextArg, ++it) {
-    auto nextArgv = std::next(*it);
-    if (nextArgv == m_argv.cend()) {
+    switch (match.m_error) {
+    case Error::MissingArgument:
+      detail::WriteParts(*out,
+                         {"error matches for option '", name, "': <null>\n"});
+      break;
+    case Error::InvalidArgument:
+      detail::WriteParts(*out, {"error matches for option '", name, "': '",
+                                m_argv[match.m_position], "'\n"});
+      break;
+    case Error::MultipleMatches:
+      detail::WriteParts(
+          *out, {"multiple matches for single option '", name, "'\n"});
+      break;
+    case Error::TooManyArguments:
+      detail::WriteParts(*out, {"too many arguments for option '", name,
+                                "': '", m_argv[match.m_position], "'\n"});
       break;
     }
+  }
 
-    if (*nextArg != nextArgv) {
-      hasHoles = true;
+  if (m_errorCount > recorded) {
+    detail::WriteParts(*out, {"... and ",
+                              std::to_string(m_errorCount - recorded),
+                              " more errors\n"});
+  }
 
-      if (!out) {
-        break;
-      }
+  return m_errorCount > 0;
+}
 
-      while (nextArgv != *nextArg && nextArgv != m_argv.cend()) {
-        (*out) << "unparsed argument '" << *nextArgv++ << "' before parsed '";
-        (*out) << **nextArg << "'\n";
-      }
-    }
-  }
+template <typename... Opts>
+typename ParsedOptions<Opts...>::tail_t ParsedOptions<Opts...>::Tail() const {
+  const size_t tail = std::min(m_tail, m_argc);
+  return tail_t{m_argv + tail, m_argv + m_argc};
+}
 
-  return !hasHoles;
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include <ostream>
+
+namespace popts {
+
+namespace detail {
+
+POPTS_INLINE void WriteParts(std::ostream &out,
+                             std::initializer_list<string_view> parts) {
+  for (string_view part : parts) {
+    out << part;
+  }
 }
 
-Options::tail_t Options::Tail() const { return tail_t{m_tail, m_argv.cend()}; }
+} // namespace detail
 
-string Options::Description() const {
-  vector<string> namesAndDefaults;
-  namesAndDefaults.reserve(m_options.size());
+} // namespace popts
+#endif
 
-  std::stringstream ss;
-  for (const auto &option : m_options) {
-    auto nameIt = std::cbegin(option->m_names);
+#endif
+#pragma once
+#ifndef POPTS_SNAPSHOT_H_INCLUDED
+#define POPTS_SNAPSHOT_H_INCLUDED
 
-    ss << *nameIt++;
 
-    for (; nameIt != std::cend(option->m_names); ++nameIt) {
-      ss << ", " << *nameIt;
-    }
+#include <atomic>
+#include <functional>
+#include <mutex>
 
-    if (option->m_count > Option::Single) {
-      ss << " (...)";
-    }
+namespace popts {
 
-    if (!option->m_isFlag == option->m_count == Option::Single) {
-      ss << " [=" << option->m_defaultString << "]";
-    }
+class Options;
+
+// An immutable copy of all option values at one generation of Options. Any
+// number of threads can read a snapshot while Options parses again.
+class Snapshot {
+public:
+  uint64_t Generation() const { return m_generation; }
+
+  // The copy of value, which is a reference returned by Options for an option
+  // registered before the snapshot was made, e.g. snapshot.Find(port) for
+  // `auto &port = popts.Int(...)`. nullptr for anything else, e.g. a copy of
+  // the value.
+  template <typename T> const T *Find(const T &value) const;
+
+private:
+  friend class Options;
+
+  struct Entry {
+    const void *m_key;
+    std::shared_ptr<const void> m_value;
+  };
+
+  uint64_t m_generation = 0;
+  // sorted by the address of the value the entry was copied from
+  vector<Entry> m_values;
+};
+
+// Publishes snapshots RCU-style: a control thread publishes a new snapshot
+// after Reparse, readers keep using the one they hold until they look again.
+// The current snapshot is an atomic pointer, SnapshotReader reads it without
+// locks and marks the snapshot it uses so that Publish does not free it.
+class SnapshotPublisher {
+public:
+  // Publishes the first snapshot, readers never see none.
+  explicit SnapshotPublisher(const Options &options);
+
+  // Frees the snapshots no reader uses anymore, takes a lock.
+  void Publish(const Options &options);
+
+  // The latest snapshot, takes a lock.
+  std::shared_ptr<const Snapshot> Load() const;
+  // Incremented by every Publish, cheap to poll.
+  uint64_t Published() const;
+
+private:
+  friend class SnapshotReader;
+
+  mutable std::mutex m_mutex;
+  // the owners of the current and the retired snapshots, guarded by m_mutex
+  std::shared_ptr<const Snapshot> m_snapshot;
+  vector<std::shared_ptr<const Snapshot>> m_retired;
+  // the snapshot every reader uses, guarded by m_mutex
+  mutable vector<const std::atomic<const Snapshot *> *> m_hazards;
+
+  std::atomic<const Snapshot *> m_current;
+  std::atomic<uint64_t> m_published{0};
+};
+
+// The view of one thread on a publisher, which has to outlive it. Reading the
+// current snapshot is a load of the publish counter, the snapshot pointer is
+// loaded only after something has been published. Neither takes a lock.
+class SnapshotReader {
+public:
+  explicit SnapshotReader(const SnapshotPublisher &publisher);
+  ~SnapshotReader();
 
-    namesAndDefaults.push_back(ss.str());
-    ss.str(""s);
+  const Snapshot &Current();
+
+private:
+  const SnapshotPublisher &m_publisher;
+  uint64_t m_published = 0;
+  // the snapshot this reader uses, Publish does not free it
+  std::atomic<const Snapshot *> m_hazard{nullptr};
+};
+
+} // namespace popts
+
+#include <algorithm>
+
+namespace popts {
+
+template <typename T> const T *Snapshot::Find(const T &value) const {
+  auto entry = std::lower_bound(
+      m_values.cbegin(), m_values.cend(), static_cast<const void *>(&value),
+      [](const Entry &entry, const void *key) {
+        return std::less<const void *>()(entry.m_key, key);
+      });
+
+  if (entry == m_values.cend() || entry->m_key != &value) {
+    return nullptr;
   }
+  return static_cast<const T *>(entry->m_value.get());
+}
 
-  size_t slashPos = m_argv[0].find_last_of("/\\");
-  const string &cmdName = (slashPos == string::npos)
-                              ? (m_argv[0])
-                              : (m_argv[0].data() + slashPos + 1);
+} // namespace popts
 
-  ss << "Usage '" << cmdName << "' [options]\n";
+#ifdef POPTS_HAS_IMPLEMENTATION
+namespace popts {
 
-  const size_t colWidth =
-      std::max_element(namesAndDefaults.cbegin(), namesAndDefaults.cend(),
-                       [](const string &lhs, const string &rhs) {
-                         return lhs.size() < rhs.size();
-                       })
-          ->size();
+POPTS_INLINE std::shared_ptr<const Snapshot> Options::MakeSnapshot() const {
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->m_generation = Generation();
+  snapshot->m_values.reserve(m_options.size());
 
-  auto nameIt = namesAndDefaults.cbegin();
   for (const auto &option : m_options) {
-    ss << std::left << std::setw(colWidth + 4) << *nameIt++
-       << option->m_description << "\n";
+    option->Resolve();
+    snapshot->m_values.push_back(
+        Snapshot::Entry{option->Value(), option->CopyValue()});
   }
 
-  return ss.str();
+  std::sort(snapshot->m_values.begin(), snapshot->m_values.end(),
+            [](const Snapshot::Entry &a, const Snapshot::Entry &b) {
+              return std::less<const void *>()(a.m_key, b.m_key);
+            });
+
+  return snapshot;
 }
 
-template <typename T>
-const T &Options::MakeOption(std::initializer_list<const char *> names,
-                             const T &defaultArgument,
-                             const string &description) {
-  auto &option =
-      AddOption(names, defaultArgument, description, Option::Single, false);
-  return option.m_storage.front();
+POPTS_INLINE SnapshotPublisher::SnapshotPublisher(const Options &options)
+    : m_snapshot(options.MakeSnapshot()), m_current(m_snapshot.get()) {}
+
+POPTS_INLINE void SnapshotPublisher::Publish(const Options &options) {
+  auto snapshot = options.MakeSnapshot();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_retired.push_back(std::move(m_snapshot));
+  m_snapshot = std::move(snapshot);
+  m_current.store(m_snapshot.get());
+  m_published.fetch_add(1, std::memory_order_release);
+
+  // a reader that marked a retired snapshot before the store above is seen
+  // here, one that marks it later sees the new snapshot and marks again
+  m_retired.erase(
+      std::remove_if(m_retired.begin(), m_retired.end(),
+                     [this](const std::shared_ptr<const Snapshot> &retired) {
+                       return std::none_of(
+                           m_hazards.cbegin(), m_hazards.cend(),
+                           [&retired](const auto *hazard) {
+                             return hazard->load() == retired.get();
+                           });
+                     }),
+      m_retired.end());
 }
 
-template <typename T>
-const deque<T> &Options::MakeOptions(std::initializer_list<const char *> names,
-                                     const string &description) {
-  auto &option = AddOption(names, T(), description, Option::Many, false);
-  return option.m_storage;
+POPTS_INLINE std::shared_ptr<const Snapshot> SnapshotPublisher::Load() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_snapshot;
 }
 
-const bool &Options::Flag(std::initializer_list<const char *> names,
-                          const string &description) {
-  auto &option = AddOption(names, false, description, Option::Single, true);
-  return option.m_storage.front();
+POPTS_INLINE uint64_t SnapshotPublisher::Published() const {
+  return m_published.load(std::memory_order_acquire);
 }
 
-const deque<bool> &Options::Flags(std::initializer_list<const char *> names,
-                                  const string &description) {
-  auto &option = AddOption(names, false, description, Option::Many, true);
-  return option.m_storage;
+POPTS_INLINE SnapshotReader::SnapshotReader(const SnapshotPublisher &publisher)
+    : m_publisher(publisher) {
+  // Publish takes the lock as well, the current snapshot stays until marked
+  std::lock_guard<std::mutex> lock(m_publisher.m_mutex);
+  m_published = m_publisher.Published();
+  m_hazard.store(m_publisher.m_current.load());
+  m_publisher.m_hazards.push_back(&m_hazard);
 }
 
-template <typename T>
-OptionImpl<T> &Options::AddOption(std::initializer_list<const char *> names,
-                                  const T &defaultArgument,
-                                  const string &description, size_t count,
-                                  bool isFlag) {
-  m_options.push_back(std::make_unique<OptionImpl<T>>());
+POPTS_INLINE SnapshotReader::~SnapshotReader() {
+  std::lock_guard<std::mutex> lock(m_publisher.m_mutex);
+  auto &hazards = m_publisher.m_hazards;
+  hazards.erase(std::find(hazards.begin(), hazards.end(), &m_hazard));
+}
 
-  auto &option = static_cast<OptionImpl<T> &>(*m_options.back());
-  std::copy(std::cbegin(names), std::cend(names),
-            std::back_inserter(option.m_names));
-  option.m_count = count;
-  option.m_isFlag = isFlag;
-  option.m_defaultArgument = defaultArgument;
-  option.m_defaultString = OptionImpl<T>::ToString(defaultArgument);
-  option.m_description = description;
+POPTS_INLINE const Snapshot &SnapshotReader::Current() {
+  // the counter is incremented after the store, a snapshot loaded early is
+  // only loaded once more
+  const uint64_t published = m_publisher.Published();
+  if (published != m_published) {
+    const Snapshot *current = m_publisher.m_current.load();
+    const Snapshot *marked = nullptr;
+    // the snapshot is safe once it is marked and still current, otherwise
+    // Publish might not have seen the mark before freeing it
+    while (current != marked) {
+      m_hazard.store(current);
+      marked = current;
+      current = m_publisher.m_current.load();
+    }
+    m_published = published;
+  }
+  return *m_hazard.load(std::memory_order_relaxed);
+}
+
+} // namespace popts
+#endif
 
-  option.ParseArguments(m_argv);
+#endif
+#pragma once
+#ifndef POPTS_TAIL_H_INCLUDED
+#define POPTS_TAIL_H_INCLUDED
 
-  if (option.m_matches.size() > 0) {
-    m_tail = std::max(std::next(option.m_matches.back()), m_tail);
+
+#include <iosfwd>
+
+namespace popts {
+
+class Options;
+
+// Reads the tail of Options in chunks of at most chunkSize arguments, so a
+// long list of positional arguments can be processed while it is read.
+//
+// An argument '-' is replaced by the NUL-separated arguments read from input,
+// like `xargs -0`. With response files, an argument '@path' behind "--" is
+// replaced by the arguments in the file. Both are read through one buffer
+// that only grows for an argument longer than it, arguments read this way
+// are not expanded again.
+//
+// The reader points into argv of options, Reparse invalidates it.
+class TailReader {
+public:
+  using argv_t = vector<string_view>;
+
+  // Reads '-' from standard input.
+  explicit TailReader(const Options &options, size_t chunkSize = 1024);
+  TailReader(const Options &options, size_t chunkSize, std::istream &input);
+  // where std::istream is complete
+  TailReader(TailReader &&other);
+  ~TailReader();
+
+  // The next chunk, empty when the tail is exhausted. The views are valid
+  // until the next call.
+  const argv_t &Next();
+
+  bool HasErrors(std::ostream *out = nullptr) const;
+
+private:
+  static constexpr size_t BufferSize = 64 * 1024;
+
+  void Open(string_view argument);
+  // Reads until the buffer holds at least one complete argument, false at the
+  // end of the stream. Only waits for the stream while the buffer holds none.
+  bool Refill();
+
+  // the tail of options
+  Option::argv_t::const_iterator m_next, m_end;
+  size_t m_chunkSize;
+  bool m_hasResponseFiles;
+
+  std::istream &m_input;
+  // the response file being read
+  std::unique_ptr<std::istream> m_file;
+  std::istream *m_stream = nullptr;
+  bool m_isNulSeparated = false;
+  string m_path;
+
+  vector<char> m_buffer;
+  // bytes [m_consumed, m_filled) are the start of an incomplete argument
+  size_t m_consumed = 0;
+  size_t m_filled = 0;
+  // complete arguments in the buffer not yet handed out
+  argv_t m_pending;
+  size_t m_pendingIndex = 0;
+
+  argv_t m_chunk;
+  vector<string> m_errors;
+};
+
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace popts {
+
+POPTS_INLINE TailReader::TailReader(const Options &options, size_t chunkSize)
+    : TailReader(options, chunkSize, std::cin) {}
+
+POPTS_INLINE TailReader::TailReader(const Options &options, size_t chunkSize,
+                                    std::istream &input)
+    : m_next(options.Tail().cbegin()), m_end(options.Tail().cend()),
+      m_chunkSize(std::max<size_t>(chunkSize, 1)),
+      m_hasResponseFiles(options.m_hasResponseFiles), m_input(input) {
+  m_chunk.reserve(m_chunkSize);
+}
+
+POPTS_INLINE TailReader::TailReader(TailReader &&other) = default;
+
+POPTS_INLINE TailReader::~TailReader() = default;
+
+POPTS_INLINE const TailReader::argv_t &TailReader::Next() {
+  m_chunk.clear();
+
+  while (m_chunk.size() < m_chunkSize) {
+    if (m_pendingIndex < m_pending.size()) {
+      const size_t count = std::min(m_chunkSize - m_chunk.size(),
+                                    m_pending.size() - m_pendingIndex);
+      auto first = std::next(m_pending.cbegin(), m_pendingIndex);
+      m_chunk.insert(m_chunk.end(), first, std::next(first, count));
+      m_pendingIndex += count;
+      continue;
+    }
+
+    if (m_stream) {
+      // refilling moves the buffer the chunk may point into
+      if (!m_chunk.empty()) {
+        break;
+      }
+      if (!Refill()) {
+        m_file.reset();
+        m_stream = nullptr;
+      }
+      continue;
+    }
+
+    if (m_next == m_end) {
+      break;
+    }
+
+    const string_view argument = *m_next++;
+    if (argument == "-" ||
+        (m_hasResponseFiles && argument.size() > 1 && argument[0] == '@')) {
+      Open(argument);
+    } else {
+      m_chunk.push_back(argument);
+    }
   }
 
-  assert(!HasDuplicateNames());
+  return m_chunk;
+}
 
-  return option;
+POPTS_INLINE bool TailReader::HasErrors(std::ostream *out) const {
+  if (out) {
+    for (const auto &error : m_errors) {
+      (*out) << error << "\n";
+    }
+  }
+
+  return !m_errors.empty();
+}
+
+POPTS_INLINE void TailReader::Open(string_view argument) {
+  m_consumed = 0;
+  m_filled = 0;
+  if (m_buffer.empty()) {
+    m_buffer.resize(BufferSize);
+  }
+
+  if (argument == "-") {
+    m_stream = &m_input;
+    m_isNulSeparated = true;
+    m_path = "standard input";
+    return;
+  }
+
+  m_path = string(argument.substr(1));
+  m_file = std::make_unique<std::ifstream>(m_path, std::ios::binary);
+  if (!*m_file) {
+    m_errors.push_back("cannot read response file '" + m_path + "'");
+    return;
+  }
+
+  m_stream = m_file.get();
+  m_isNulSeparated = false;
+}
+
+POPTS_INLINE bool TailReader::Refill() {
+  m_pending.clear();
+  m_pendingIndex = 0;
+
+  // keep the incomplete argument at the end
+  std::memmove(m_buffer.data(), m_buffer.data() + m_consumed,
+               m_filled - m_consumed);
+  m_filled -= m_consumed;
+  m_consumed = 0;
+
+  while (m_pending.empty()) {
+    // getline needs room for its terminator
+    if (m_buffer.size() - m_filled < 2) {
+      m_buffer.resize(m_buffer.size() * 2);
+    }
+
+    // takes what the stream has without waiting, a pipe or a terminal is only
+    // waited for when nothing is there
+    char *const out = m_buffer.data() + m_filled;
+    const auto space = static_cast<std::streamsize>(m_buffer.size() - m_filled);
+    std::streamsize count = m_stream->readsome(out, space);
+    if (count == 0 && *m_stream) {
+      if (m_isNulSeparated) {
+        // up to and with the next NUL, which getline stores as its terminator
+        m_stream->getline(out, space, '\0');
+        count = m_stream->gcount();
+        if (m_stream->fail() && !m_stream->eof()) {
+          // the buffer is full, the argument continues
+          m_stream->clear();
+        }
+      } else {
+        m_stream->read(out, 1);
+        count = m_stream->gcount();
+        if (count > 0) {
+          count += m_stream->readsome(out + 1, space - 1);
+        }
+      }
+    }
+    m_filled += static_cast<size_t>(count);
+    const bool isEnd = !*m_stream;
+
+    char *first = m_buffer.data();
+    char *last = first + m_filled;
+    char *boundary = last;
+
+    if (m_isNulSeparated) {
+      if (!isEnd) {
+        auto nul = std::find(std::make_reverse_iterator(last),
+                             std::make_reverse_iterator(first), '\0');
+        boundary = nul.base();
+      }
+
+      for (char *arg = first; arg != boundary;) {
+        char *nul = std::find(arg, boundary, '\0');
+        m_pending.emplace_back(arg, nul - arg);
+        arg = nul == boundary ? nul : std::next(nul);
+      }
+    } else {
+      if (!isEnd) {
+        boundary = ResponseFileBoundary(first, last);
+      }
+
+      if (!TokenizeResponseFile(first, boundary, [this](string_view arg) {
+            m_pending.push_back(arg);
+          })) {
+        m_errors.push_back("unterminated quote in response file '" + m_path +
+                           "'");
+      }
+    }
+
+    m_consumed = boundary - first;
+    if (isEnd) {
+      return !m_pending.empty();
+    }
+  }
+
+  return true;
 }
 
 } // namespace popts
+#endif
+
+#endif
 
 #endif
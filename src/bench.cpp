@@ -0,0 +1,521 @@
+#include "opts.h"
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Micro benchmarks
+//
+// Every benchmark reports the time of one iteration, averaged over as many
+// iterations as fit into a fixed time budget. The output is a table, or JSON
+// in the format of Google Benchmark with `--benchmark_format json`, which
+// existing tools can compare across releases.
+//
+// bench [--benchmark_format console|json] [--benchmark_filter substring]
+//       [--benchmark_min_time duration]
+//
+
+using namespace std;
+
+namespace {
+
+volatile size_t g_sink;
+
+struct Result {
+  string m_name;
+  size_t m_items;
+  size_t m_iterations;
+  double m_realNs;
+  double m_cpuNs;
+};
+
+struct Settings {
+  string m_filter;
+  chrono::nanoseconds m_minTime = chrono::milliseconds(200);
+  // the table goes to stderr when stdout is JSON
+  FILE *m_table = stdout;
+};
+
+Settings g_settings;
+vector<Result> g_results;
+
+// Runs fn until the time budget is spent, n is the number of items one
+// iteration processes.
+template <typename F> void Run(const string &name, size_t n, F &&fn) {
+  if (name.find(g_settings.m_filter) == string::npos) {
+    return;
+  }
+
+  using steady = chrono::steady_clock;
+
+  size_t iterations = 0;
+  const clock_t cpuStart = clock();
+  const auto start = steady::now();
+  auto elapsed = steady::duration::zero();
+  do {
+    fn();
+    ++iterations;
+    elapsed = steady::now() - start;
+  } while (elapsed < g_settings.m_minTime);
+  const clock_t cpuElapsed = clock() - cpuStart;
+
+  const double realNs = chrono::duration<double, nano>(elapsed).count();
+  const double cpuNs = 1e9 * cpuElapsed / CLOCKS_PER_SEC;
+  g_results.push_back(
+      {name, n, iterations, realNs / iterations, cpuNs / iterations});
+
+  const Result &result = g_results.back();
+  fprintf(g_settings.m_table, "%-40s %10zu %14.0f ns %10.2f ns/item\n",
+          name.c_str(), n, result.m_realNs, result.m_realNs / n);
+}
+
+string JsonString(string_view data) {
+  string out = "\"";
+  for (char c : data) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out + "\"";
+}
+
+void WriteJson(string_view executable) {
+  char date[32] = "";
+  const time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+  printf("{\n");
+  printf("  \"context\": {\n");
+  printf("    \"date\": %s,\n", JsonString(date).c_str());
+  printf("    \"executable\": %s,\n", JsonString(executable).c_str());
+#ifdef NDEBUG
+  printf("    \"library_build_type\": \"release\"\n");
+#else
+  printf("    \"library_build_type\": \"debug\"\n");
+#endif
+  printf("  },\n");
+  printf("  \"benchmarks\": [");
+
+  for (size_t i = 0; i < g_results.size(); ++i) {
+    const Result &result = g_results[i];
+    printf(i == 0 ? "\n" : ",\n");
+    printf("    {\n");
+    printf("      \"name\": %s,\n", JsonString(result.m_name).c_str());
+    printf("      \"run_name\": %s,\n", JsonString(result.m_name).c_str());
+    printf("      \"run_type\": \"iteration\",\n");
+    printf("      \"iterations\": %zu,\n", result.m_iterations);
+    printf("      \"real_time\": %.3f,\n", result.m_realNs);
+    printf("      \"cpu_time\": %.3f,\n", result.m_cpuNs);
+    printf("      \"time_unit\": \"ns\",\n");
+    printf("      \"items_per_second\": %.3f\n",
+           result.m_items * 1e9 / result.m_realNs);
+    printf("    }");
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+const size_t g_optionCount = 200;
+const size_t g_argcs[] = {10, 100, 1000, 10000, 100000, 1000000};
+
+// `cmd --opt0 v0 --opt1 v1 ... file file ...`, half options, half tail
+vector<string> MakeArgv(size_t argc, size_t optionCount) {
+  vector<string> argv{"path/cmd"};
+  argv.reserve(argc);
+  for (size_t i = 0; argv.size() + 1 < argc / 2; ++i) {
+    argv.push_back("--opt" + to_string(i % optionCount));
+    argv.push_back("v" + to_string(i));
+  }
+  while (argv.size() < argc) {
+    argv.push_back("file" + to_string(argv.size()));
+  }
+  return argv;
+}
+
+vector<string> MakeNames(size_t optionCount) {
+  vector<string> names;
+  for (size_t i = 0; i < optionCount; ++i) {
+    names.push_back("--opt" + to_string(i));
+  }
+  return names;
+}
+
+void AddOptions(popts::Options &popts, const vector<string> &names) {
+  for (const auto &name : names) {
+    g_sink = popts.Strings({name.c_str()}, "Option " + name).size();
+  }
+}
+
+void BenchConstruct() {
+  for (size_t argc : g_argcs) {
+    const auto argv = MakeArgv(argc, g_optionCount);
+
+    vector<char *> pointers;
+    for (const auto &arg : argv) {
+      pointers.push_back(const_cast<char *>(arg.c_str()));
+    }
+
+    Run("Construct/vector/" + to_string(argc), argc, [&] {
+      popts::Options popts(argv);
+      g_sink = popts.Tail().cend() - popts.Tail().cbegin();
+    });
+
+    Run("Construct/argv/" + to_string(argc), argc, [&] {
+      popts::Options popts(static_cast<int>(argc), pointers.data());
+      g_sink = popts.Tail().cend() - popts.Tail().cbegin();
+    });
+  }
+}
+
+void BenchAddOption() {
+  const auto names = MakeNames(g_optionCount);
+  // reused by every run, larger tables continue on the heap
+  vector<char> buffer(1 << 20);
+
+  for (size_t argc : g_argcs) {
+    const auto argv = MakeArgv(argc, g_optionCount);
+    Run("AddOption/200 options/" + to_string(argc), argc, [&] {
+      popts::Options popts(argv);
+      AddOptions(popts, names);
+    });
+
+    Run("AddOption/200 options/arena/" + to_string(argc), argc, [&] {
+      std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+      popts::Options popts(argv, &arena);
+      AddOptions(popts, names);
+    });
+
+    // the tail behind "--" is not indexed
+    auto terminated = argv;
+    terminated.insert(std::find(terminated.begin(), terminated.end(),
+                                "file" + to_string(argc / 2 - 1)),
+                      "--");
+    Run("AddOption/200 options/terminated/" + to_string(argc), argc, [&] {
+      popts::Options popts(terminated);
+      AddOptions(popts, names);
+    });
+  }
+}
+
+void BenchChecks() {
+  const auto names = MakeNames(g_optionCount);
+
+  for (size_t argc : g_argcs) {
+    const auto argv = MakeArgv(argc, g_optionCount);
+    popts::Options popts(argv);
+    AddOptions(popts, names);
+
+    Run("HasErrorMatches/" + to_string(argc), argc,
+        [&] { g_sink = popts.HasErrorMatches(); });
+
+    Run("HasConsistentTail/" + to_string(argc), argc,
+        [&] { g_sink = popts.HasConsistentTail(); });
+  }
+
+  // large tables and a short command line, every option is checked
+  for (size_t optionCount : {1000, 10000}) {
+    popts::Options popts(MakeArgv(10, optionCount));
+    AddOptions(popts, MakeNames(optionCount));
+
+    Run("HasErrorMatches/options/" + to_string(optionCount), optionCount,
+        [&] { g_sink = popts.HasErrorMatches(); });
+  }
+}
+
+void BenchDescription() {
+  for (size_t optionCount : {10, 100, 1000, 10000}) {
+    popts::Options popts(vector<string>{"path/cmd"});
+    AddOptions(popts, MakeNames(optionCount));
+
+    Run("Description/" + to_string(optionCount), optionCount, [&] {
+      std::ostringstream out;
+      popts.Description(out);
+      g_sink = out.tellp();
+    });
+
+    Run("Description/cached/" + to_string(optionCount), optionCount,
+        [&] { g_sink = popts.Description().size(); });
+  }
+}
+
+// registering expensive to convert options that are never read
+void BenchLazy() {
+  const auto names = MakeNames(g_optionCount);
+
+  vector<string> argv{"path/cmd"};
+  for (const auto &name : names) {
+    argv.push_back(name);
+    argv.push_back("(1.5,2.5)");
+  }
+
+  Run("MakeOption<complex<double>>/200 options", argv.size(), [&] {
+    popts::Options popts(argv);
+    for (const auto &name : names) {
+      g_sink = popts.MakeOption<complex<double>>({name.c_str()}, {}, "").real();
+    }
+  });
+
+  Run("MakeLazyOption<complex<double>>/200 options", argv.size(), [&] {
+    popts::Options popts(argv);
+    for (const auto &name : names) {
+      auto value =
+          popts.MakeLazyOption<complex<double>>({name.c_str()}, {}, "");
+      g_sink = sizeof(value);
+    }
+  });
+}
+
+template <typename T>
+void BenchFromString(const string &type, const vector<string> &values) {
+  Run("FromString<" + type + ">", values.size(), [&] {
+    T value;
+    for (const auto &data : values) {
+      g_sink = popts::OptionTraits<T>::FromString(data, value);
+    }
+  });
+}
+
+// FromString against the generic stringstream path it replaces
+template <typename T>
+void BenchNumberFromString(const string &type, const vector<string> &values) {
+  BenchFromString<T>(type, values);
+
+  Run("StreamFromString<" + type + ">", values.size(), [&] {
+    T value;
+    for (const auto &data : values) {
+      g_sink = popts::detail::StreamFromString(data, value);
+    }
+  });
+}
+
+void BenchFromString() {
+  vector<string> strings, bools, integers, floats, complexes;
+  const char *boolValues[] = {"true", "false", "yes", "no", "1", "0"};
+  for (size_t i = 0; i < 10000; ++i) {
+    strings.push_back("value" + to_string(i));
+    bools.push_back(boolValues[i % 6]);
+    integers.push_back(to_string(static_cast<int64_t>(i) * 7919 - 5000000));
+    floats.push_back(to_string(i * 0.37 - 1000.0));
+    complexes.push_back("(" + floats.back() + "," + to_string(i) + ")");
+  }
+
+  BenchFromString<string>("string", strings);
+  BenchFromString<bool>("bool", bools);
+  BenchNumberFromString<int>("int", integers);
+  BenchNumberFromString<int64_t>("int64_t", integers);
+  BenchNumberFromString<double>("double", floats);
+  BenchNumberFromString<long double>("long double", floats);
+  BenchFromString<complex<double>>("complex<double>", complexes);
+}
+
+// the regex based parser FromString<duration_t> used to be
+bool RegexDurationFromString(string_view data, popts::duration_t &out) {
+  regex durationRe("(\\d+)(d|h|m|s|ms|ns)"s);
+  cmatch m;
+  if (!regex_match(data.data(), data.data() + data.size(), m, durationRe)) {
+    return false;
+  }
+
+  long double value = stold(m[1].str());
+  string unit = m[2].str();
+
+  if (unit == "d"s) {
+    out = chrono::duration<long double, ratio<86400>>(value);
+  } else if (unit == "h"s) {
+    out = chrono::duration<long double, ratio<3600>>(value);
+  } else if (unit == "m"s) {
+    out = chrono::duration<long double, ratio<60>>(value);
+  } else if (unit == "s"s) {
+    out = chrono::duration<long double, ratio<1>>(value);
+  } else if (unit == "ms"s) {
+    out = chrono::duration<long double, milli>(value);
+  } else if (unit == "ns"s) {
+    out = chrono::duration<long double, nano>(value);
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+void BenchDurationFromString() {
+  const char *units[] = {"d", "h", "m", "s", "ms", "ns"};
+
+  vector<string> values;
+  for (size_t i = 0; i < 5000; ++i) {
+    values.push_back(to_string(i) + units[i % 6]);
+  }
+
+  BenchFromString<popts::duration_t>("duration_t", values);
+
+  Run("RegexDurationFromString", values.size(), [&] {
+    popts::duration_t value;
+    for (const auto &data : values) {
+      g_sink = RegexDurationFromString(data, value);
+    }
+  });
+}
+
+// a generated config with 100 keys per section, 1000 of them are options
+void BenchConfigFile() {
+  const size_t size = 50 << 20;
+  const auto path = filesystem::temp_directory_path() / "popts_bench.toml";
+
+  {
+    ofstream out(path, ios::binary);
+    for (size_t key = 0; out.tellp() < static_cast<streamoff>(size); ++key) {
+      if (key % 100 == 0) {
+        out << "\n[section" << key / 100 << "]\n";
+      }
+      out << "key" << key % 100 << " = \"value " << key << "\" # comment\n";
+    }
+  }
+
+  vector<string> names;
+  for (size_t i = 0; i < 1000; ++i) {
+    names.push_back("--section" + to_string(i * 7) + ".key" +
+                    to_string(i % 100));
+  }
+
+  const string file = path.string();
+  Run("WithConfigFile/50MB/1000 options", size, [&] {
+    popts::Options popts(vector<string>{"path/cmd"});
+    popts.WithConfigFile(file.c_str());
+    AddOptions(popts, names);
+  });
+
+  filesystem::remove(path);
+}
+
+// a delimited list option against splitting the argument and converting every
+// element on its own
+template <typename T>
+void BenchList(const string &type, const vector<string> &values) {
+  string list;
+  for (const auto &value : values) {
+    list += (list.empty() ? "" : ",") + value;
+  }
+
+  const char *argv[] = {"path/cmd", "--list", list.c_str(), nullptr};
+  const string count = to_string(values.size());
+
+  Run("MakeListOptions<" + type + ">/" + count, values.size(), [&] {
+    popts::Options popts(3, const_cast<char **>(argv));
+    g_sink = popts.MakeListOptions<T>({"--list"}, ',', "").size();
+  });
+
+  Run("FromString<" + type + ">/per element/" + count, values.size(), [&] {
+    vector<T> out;
+    T value;
+    string_view data = list;
+    for (size_t end = 0; end != string_view::npos;
+         data.remove_prefix(end + 1)) {
+      end = data.find(',');
+      if (popts::OptionTraits<T>::FromString(data.substr(0, end), value)) {
+        out.push_back(value);
+      }
+    }
+    g_sink = out.size();
+  });
+
+  Run("StreamFromString<" + type + ">/per element/" + count, values.size(),
+      [&] {
+        vector<T> out;
+        T value;
+        string_view data = list;
+        for (size_t end = 0; end != string_view::npos;
+             data.remove_prefix(end + 1)) {
+          end = data.find(',');
+          if (popts::detail::StreamFromString(data.substr(0, end), value)) {
+            out.push_back(value);
+          }
+        }
+        g_sink = out.size();
+      });
+}
+
+void BenchLists() {
+  vector<string> integers, floats;
+  for (size_t i = 0; i < 200000; ++i) {
+    integers.push_back(to_string(static_cast<int64_t>(i) * 7919 - 5000000));
+    floats.push_back(to_string(i * 0.37 - 1000.0));
+  }
+
+  BenchList<int64_t>("int64_t", integers);
+  BenchList<long double>("long double", floats);
+}
+
+void BenchTailReader() {
+  string names;
+  const size_t count = 1000000;
+  for (size_t i = 0; i < count; ++i) {
+    names += "path/to/file" + to_string(i);
+    names += '\0';
+  }
+
+  popts::Options popts(vector<string>{"path/cmd", "-v", "--", "-"});
+  g_sink = popts.Flag({"-v"}, "");
+
+  Run("TailReader/stdin/" + to_string(count), count, [&] {
+    istringstream input(names);
+    popts::TailReader reader(popts, 4096, input);
+    for (auto *chunk = &reader.Next(); !chunk->empty();
+         chunk = &reader.Next()) {
+      g_sink += chunk->size();
+    }
+  });
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  popts::Options popts(argc, argv);
+
+  auto &help = popts.Flag({"-h", "--help"}, "Show this help");
+  auto &format = popts.String({"--benchmark_format"}, "console",
+                              "Output format, console or json");
+  auto &filter = popts.String({"--benchmark_filter"}, "",
+                              "Run benchmarks with this in their name only");
+  auto &minTime = popts.Duration({"--benchmark_min_time"}, 200ms,
+                                 "Time budget of every benchmark");
+
+  if (help || popts.HasErrorMatches(&cerr) ||
+      (format != "console" && format != "json")) {
+    cerr << popts.Description();
+    return help ? 0 : 1;
+  }
+
+  g_settings.m_filter = filter;
+  g_settings.m_minTime = chrono::duration_cast<chrono::nanoseconds>(minTime);
+  if (format == "json") {
+    g_settings.m_table = stderr;
+  }
+
+  BenchConstruct();
+  BenchAddOption();
+  BenchChecks();
+  BenchDescription();
+  BenchLazy();
+  BenchFromString();
+  BenchDurationFromString();
+  BenchLists();
+  BenchConfigFile();
+  BenchTailReader();
+
+  if (format == "json") {
+    WriteJson(argv[0]);
+  }
+
+  return 0;
+}
@@ -17,11 +17,11 @@ int main(int argc, char **argv) {
 
   auto help = popts.Flag({"-h", "--help"}, "Show this help");
 
-  auto infile = popts.String({"-i", "--infile"}, "--",
-                             "Specify input file or '--' for stdin");
+  auto infile = popts.String({"-i", "--infile"}, "-",
+                             "Specify input file or '-' for stdin");
 
-  auto outfile = popts.String({"-o", "--outfile"}, "--",
-                              "Specify output file or '--' for stdout");
+  auto outfile = popts.String({"-o", "--outfile"}, "-",
+                              "Specify output file or '-' for stdout");
 
   auto verbose = popts.Flag({"-v"}, "Toggle verbosity");
 
@@ -35,12 +35,12 @@ int main(int argc, char **argv) {
   ifstream filein;
   ofstream fileout;
 
-  if (infile != "--") {
+  if (infile != "-") {
     filein.open(infile);
     in = &filein;
   }
 
-  if (outfile != "--") {
+  if (outfile != "-") {
     fileout.open(outfile);
     out = &fileout;
   }
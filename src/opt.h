@@ -6,37 +6,274 @@
 
 namespace popts {
 
+// Classifies argv once into a name -> positions table, so that registering an
+// option is a lookup instead of a scan over argv.
+//
+// The same pass splits "--name=value" into the views "--name" and "value" if
+// "--name" is a registered name, and with m_hasBundles indexes every flag of a
+// bundle like "-abc" as "-a", "-b" and "-c" at the position of the bundle,
+// once per occurrence, so "-vvv" is "-v" three times.
+//
+// Indexing stops at the terminator "--", the arguments after it are never
+// matched and not even looked at.
+struct ArgvIndex {
+  using argv_t = std::pmr::vector<string_view>;
+
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  explicit ArgvIndex(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  // Replaces argv with its tokens and indexes them, "--name=value" is split
+  // if names has "--name". Without splitting only whole arguments are indexed
+  // and argv is left as is.
+  void Build(argv_t &argv, bool isSplitting = true,
+             const std::pmr::unordered_map<string_view, size_t> *names =
+                 nullptr);
+  // Joins the names and values Build split, argv is as it was before.
+  void Join(argv_t &argv) const;
+
+  // Calls f with every position of name in argv in ascending order.
+  template <typename F> void ForEachPosition(string_view name, F &&f) const;
+  // The first position of name or npos.
+  size_t FirstPosition(string_view name) const;
+  // Whether an argument "name=value" was left whole, Build splits it once
+  // name is registered.
+  bool IsJoined(string_view name) const;
+  // Whether position is a name split from the value that follows it.
+  bool IsSplit(size_t position) const;
+
+  // "-abc": a dash and two or more letters
+  static bool IsBundle(string_view argument);
+  // "-c", views a static table
+  static string_view ShortName(char c);
+
+  struct Node {
+    size_t m_position;
+    size_t m_next;
+    // "name=value" left whole, never matches
+    bool m_isJoined;
+  };
+
+  // first and last node of every distinct name
+  std::pmr::unordered_map<string_view, std::pair<size_t, size_t>> m_names;
+  // a position is in several lists if it is a bundle
+  std::pmr::vector<Node> m_nodes;
+  // positions of the bundles
+  std::pmr::vector<size_t> m_bundles;
+  // by position, whether a name was split from the value that follows it
+  std::pmr::vector<bool> m_isSplit;
+  // position of "--" or npos
+  size_t m_terminator = npos;
+  // whether "-abc" is a bundle or an argument like any other, set once
+  // before the first Build
+  bool m_hasBundles = false;
+
+private:
+  void Add(string_view name, size_t position, bool isJoined = false);
+};
+
+// Values for an option without matches in argv, e.g. from the environment or
+// a config file, in the order of their source.
+struct Fallback {
+  explicit Fallback(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_values(resource), m_source(resource) {}
+
+  std::pmr::vector<string_view> m_values;
+  // names the source in errors, e.g. "environment variable 'NAME'"
+  std::pmr::string m_source;
+};
+
 struct Option {
-  using argv_t = vector<string>;
+  using argv_t = ArgvIndex::argv_t;
 
   static constexpr size_t Single = 1;
   static constexpr size_t Many = std::numeric_limits<size_t>::max();
 
-  vector<string> m_names;
-  string m_description;
-  string m_defaultString;
+  // Everything but the value is allocated from resource, see Options.
+  explicit Option(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  std::pmr::vector<std::pmr::string> m_names;
+  std::pmr::string m_description;
+  std::pmr::string m_defaultString;
   size_t m_count;
   bool m_isFlag;
-  deque<argv_t::const_iterator> m_matches;
-  deque<argv_t::const_iterator> m_parseErrors;
+  // vectors, unlike deques they do not allocate while empty
+  std::pmr::vector<argv_t::const_iterator> m_matches;
+  std::pmr::vector<argv_t::const_iterator> m_parseErrors;
+  // the variable to fall back to without matches in argv, may be empty
+  std::pmr::string m_environmentName;
+  // fallback values that could not be parsed and their source
+  std::pmr::vector<string_view> m_fallbackErrors;
+  std::pmr::string m_fallbackSource;
+  // splits every argument into values, 0 for one value per argument
+  char m_separator = 0;
+  // converted on first access instead of when parsing, see Lazy
+  bool m_isLazy = false;
+  bool m_isResolved = true;
+
+  virtual ~Option() = default;
+
+  // Matches the option in argv and converts the values. The fallback values
+  // are used only if argv has no matches.
+  virtual void ParseArguments(const argv_t &argv, const ArgvIndex &index,
+                              const Fallback &fallback) = 0;
+
+  // Converts the arguments of a lazy option if that has not happened yet.
+  virtual void Resolve() = 0;
+
+  // The object handed out for the option, the value of a single option or the
+  // container of a multiple option.
+  virtual const void *Value() const = 0;
+  // A copy of the object Value() points to.
+  virtual std::shared_ptr<const void> CopyValue() const = 0;
 
 protected:
-  unsigned int ParseMatches(const argv_t &argv);
+  unsigned int ParseMatches(const argv_t &argv, const ArgvIndex &index);
 };
 
-template <typename T> struct OptionImpl : public Option {
+// Destroys an option and returns its memory to the resource it was allocated
+// from.
+struct OptionDeleter {
+  void operator()(Option *option) const;
+
+  std::pmr::memory_resource *m_resource;
+  size_t m_size;
+  size_t m_alignment;
+};
+
+// A vector that keeps up to N elements inline before it allocates. The
+// elements are contiguous either way.
+template <typename T, size_t N = 4> class SmallVector {
+  static_assert(N > 0, "use std::vector without inline elements");
+
+public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T &;
+  using const_reference = const T &;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  SmallVector() = default;
+  SmallVector(const SmallVector &other);
+  SmallVector(SmallVector &&other) noexcept;
+  SmallVector &operator=(const SmallVector &other);
+  SmallVector &operator=(SmallVector &&other) noexcept;
+  ~SmallVector();
+
+  T *data() { return m_data; }
+  const T *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  size_t capacity() const { return m_capacity; }
+  bool empty() const { return m_size == 0; }
+
+  iterator begin() { return m_data; }
+  iterator end() { return m_data + m_size; }
+  const_iterator begin() const { return m_data; }
+  const_iterator end() const { return m_data + m_size; }
+  const_iterator cbegin() const { return m_data; }
+  const_iterator cend() const { return m_data + m_size; }
+
+  T &operator[](size_t i) { return m_data[i]; }
+  const T &operator[](size_t i) const { return m_data[i]; }
+  T &front() { return m_data[0]; }
+  const T &front() const { return m_data[0]; }
+  T &back() { return m_data[m_size - 1]; }
+  const T &back() const { return m_data[m_size - 1]; }
+
+  void reserve(size_t capacity);
+  void push_back(const T &value) { emplace_back(value); }
+  void push_back(T &&value) { emplace_back(std::move(value)); }
+  template <typename... Args> T &emplace_back(Args &&... args);
+  // Keeps the capacity.
+  void clear();
+
+private:
+  bool IsInline() const { return m_data == InlineData(); }
+  T *InlineData() { return reinterpret_cast<T *>(m_inline); }
+  const T *InlineData() const { return reinterpret_cast<const T *>(m_inline); }
+  void MoveFrom(SmallVector &other);
+
+  alignas(T) unsigned char m_inline[N * sizeof(T)];
+  T *m_data = InlineData();
+  size_t m_size = 0;
+  size_t m_capacity = N;
+};
+
+// Conversion of option values, specialize for types that are not streamable.
+template <typename T> struct OptionTraits {
   static T FlagMatchValue();
-  static bool FromString(const std::string &data, T &out);
+  static bool FromString(string_view data, T &out);
   static std::string ToString(const T &data);
+};
+
+template <>
+POPTS_INLINE bool OptionTraits<duration_t>::FromString(string_view data,
+                                                       duration_t &out);
+template <>
+POPTS_INLINE bool OptionTraits<std::string>::FromString(string_view data,
+                                                        std::string &out);
+template <>
+POPTS_INLINE bool OptionTraits<bool>::FromString(string_view data, bool &out);
+template <>
+POPTS_INLINE std::string
+OptionTraits<duration_t>::ToString(const duration_t &data);
+template <> POPTS_INLINE bool OptionTraits<bool>::FlagMatchValue();
 
-  void ParseArguments(const argv_t &argv);
+// Storage has to be a sequence container with push_back, e.g. deque<T> or
+// SmallVector<T> for contiguous values.
+template <typename T, typename Storage = deque<T>>
+struct OptionImpl : public Option, public OptionTraits<T> {
+  using Option::Option;
 
-  deque<T> m_storage;
+  // Parsing again keeps the element of a single option, references to it
+  // stay valid.
+  void ParseArguments(const argv_t &argv, const ArgvIndex &index,
+                      const Fallback &fallback) override;
+  void Resolve() override;
+  const void *Value() const override;
+  std::shared_ptr<const void> CopyValue() const override;
+
+  Storage m_storage;
   T m_defaultArgument;
+
+private:
+  void Convert(const Fallback &fallback);
+
+  // what Resolve converts
+  argv_t::const_iterator m_argvEnd;
+  Fallback m_fallback{m_names.get_allocator().resource()};
+};
+
+// A handle to the value of an option that is converted from its arguments on
+// first access, e.g. for types that are expensive to convert. The first
+// access is not thread-safe. Copies refer to the same option.
+template <typename V> class Lazy {
+public:
+  const V &operator*() const {
+    m_option->Resolve();
+    return *m_value;
+  }
+  const V *operator->() const { return &**this; }
+
+private:
+  friend class Options;
+
+  Lazy(Option &option, const V &value) : m_option(&option), m_value(&value) {}
+
+  Option *m_option;
+  const V *m_value;
 };
 
 } // namespace popts
 
 #include "opt.inl.h"
 
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include "opt.impl.h"
+#endif
+
 #endif
@@ -0,0 +1,364 @@
+#include <cctype>
+#include <sstream>
+
+namespace popts {
+
+namespace detail {
+
+POPTS_INLINE bool StreamFromString(string_view data, void *out,
+                                   void (*read)(std::istream &, void *)) {
+  std::stringstream ss;
+  ss << data;
+  read(ss, out);
+  return !ss.fail();
+}
+
+POPTS_INLINE std::string StreamToString(const void *data,
+                                        void (*write)(std::ostream &,
+                                                      const void *)) {
+  std::stringstream ss;
+  write(ss, data);
+  return ss.str();
+}
+
+POPTS_INLINE std::string NumberToString(long long data) {
+  return std::to_string(data);
+}
+
+POPTS_INLINE std::string NumberToString(unsigned long long data) {
+  return std::to_string(data);
+}
+
+POPTS_INLINE std::string NumberToString(long double data) {
+  std::stringstream ss;
+  ss << data;
+  return ss.str();
+}
+
+POPTS_INLINE bool CharacterFromString(string_view data, char &out) {
+  auto it = std::find_if(data.cbegin(), data.cend(), [](char c) {
+    return !std::isspace(static_cast<unsigned char>(c));
+  });
+  if (it == data.cend()) {
+    return false;
+  }
+  out = *it;
+  return true;
+}
+
+} // namespace detail
+
+POPTS_INLINE ArgvIndex::ArgvIndex(std::pmr::memory_resource *resource)
+    : m_names(resource), m_nodes(resource), m_bundles(resource),
+      m_isSplit(resource) {}
+
+POPTS_INLINE void ArgvIndex::Build(
+    argv_t &argv, bool isSplitting,
+    const std::pmr::unordered_map<string_view, size_t> *names) {
+  m_names.clear();
+  m_names.reserve(argv.size());
+  m_nodes.clear();
+  m_nodes.reserve(argv.size());
+  m_bundles.clear();
+  m_isSplit.clear();
+  m_terminator = npos;
+
+  if (!isSplitting) {
+    for (size_t arg = 1; arg < argv.size(); ++arg) {
+      if (argv[arg] == "--") {
+        m_terminator = arg;
+        break;
+      }
+      Add(argv[arg], arg);
+    }
+    return;
+  }
+
+  argv_t tokens(argv.get_allocator());
+  tokens.reserve(argv.size());
+
+  // argv[0] is the command and never a name
+  if (!argv.empty()) {
+    tokens.push_back(argv[0]);
+  }
+
+  for (size_t arg = 1; arg < argv.size(); ++arg) {
+    const string_view argument = argv[arg];
+
+    // the rest are positional, copied as they are
+    if (argument == "--") {
+      m_terminator = tokens.size();
+      tokens.insert(tokens.end(), std::next(argv.cbegin(), arg), argv.cend());
+      break;
+    }
+
+    const size_t equals = argument.find('=');
+
+    if (argument.size() > 2 && argument[0] == '-' && argument[1] == '-' &&
+        equals != string_view::npos && equals > 2) {
+      const string_view name = argument.substr(0, equals);
+      // an unknown name stays one argument, e.g. for the tail
+      if (!names || names->find(name) == names->cend()) {
+        Add(name, tokens.size(), true);
+        tokens.push_back(argument);
+        continue;
+      }
+
+      m_isSplit.resize(tokens.size() + 1);
+      m_isSplit[tokens.size()] = true;
+      Add(name, tokens.size());
+      tokens.push_back(name);
+      tokens.push_back(argument.substr(equals + 1));
+      continue;
+    }
+
+    if (m_hasBundles && IsBundle(argument)) {
+      m_bundles.push_back(tokens.size());
+      for (char c : argument.substr(1)) {
+        Add(ShortName(c), tokens.size());
+      }
+    } else {
+      Add(argument, tokens.size());
+    }
+    tokens.push_back(argument);
+  }
+
+  if (!m_isSplit.empty()) {
+    m_isSplit.resize(tokens.size());
+  }
+  argv.swap(tokens);
+}
+
+POPTS_INLINE void ArgvIndex::Join(argv_t &argv) const {
+  if (m_isSplit.empty()) {
+    return;
+  }
+
+  // the name and the value are views into the same argument
+  argv_t arguments(argv.get_allocator());
+  arguments.reserve(argv.size());
+  for (size_t token = 0; token < argv.size(); ++token) {
+    if (token < m_isSplit.size() && m_isSplit[token]) {
+      const string_view name = argv[token];
+      const string_view value = argv[++token];
+      arguments.emplace_back(name.data(),
+                             value.data() + value.size() - name.data());
+    } else {
+      arguments.push_back(argv[token]);
+    }
+  }
+  argv.swap(arguments);
+}
+
+POPTS_INLINE void ArgvIndex::Add(string_view name, size_t position,
+                                 bool isJoined) {
+  m_nodes.push_back(Node{position, npos, isJoined});
+  const size_t node = m_nodes.size() - 1;
+
+  auto inserted = m_names.try_emplace(name, node, node);
+  if (!inserted.second) {
+    m_nodes[inserted.first->second.second].m_next = node;
+    inserted.first->second.second = node;
+  }
+}
+
+POPTS_INLINE size_t ArgvIndex::FirstPosition(string_view name) const {
+  size_t position = npos;
+  ForEachPosition(name, [&position](size_t pos) {
+    position = std::min(position, pos);
+  });
+  return position;
+}
+
+POPTS_INLINE bool ArgvIndex::IsSplit(size_t position) const {
+  return position < m_isSplit.size() && m_isSplit[position];
+}
+
+POPTS_INLINE bool ArgvIndex::IsJoined(string_view name) const {
+  auto nodes = m_names.find(name);
+  if (nodes == m_names.cend()) {
+    return false;
+  }
+
+  for (size_t node = nodes->second.first; node != npos;
+       node = m_nodes[node].m_next) {
+    if (m_nodes[node].m_isJoined) {
+      return true;
+    }
+  }
+  return false;
+}
+
+POPTS_INLINE bool ArgvIndex::IsBundle(string_view argument) {
+  return argument.size() > 2 && argument[0] == '-' &&
+         std::all_of(std::next(argument.cbegin()), argument.cend(),
+                     [](char c) {
+                       return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+                     });
+}
+
+POPTS_INLINE string_view ArgvIndex::ShortName(char c) {
+  static const std::array<char, 512> names = [] {
+    std::array<char, 512> names{};
+    for (size_t i = 0; i < 256; ++i) {
+      names[2 * i] = '-';
+      names[2 * i + 1] = static_cast<char>(i);
+    }
+    return names;
+  }();
+
+  return string_view(names.data() + 2 * static_cast<unsigned char>(c), 2);
+}
+
+POPTS_INLINE Option::Option(std::pmr::memory_resource *resource)
+    : m_names(resource), m_description(resource), m_defaultString(resource),
+      m_matches(resource), m_parseErrors(resource),
+      m_environmentName(resource), m_fallbackErrors(resource),
+      m_fallbackSource(resource) {}
+
+POPTS_INLINE void OptionDeleter::operator()(Option *option) const {
+  // the start of the OptionImpl, which need not be where Option is
+  void *block = dynamic_cast<void *>(option);
+  option->~Option();
+  m_resource->deallocate(block, m_size, m_alignment);
+}
+
+POPTS_INLINE unsigned int Option::ParseMatches(const argv_t &argv,
+                                               const ArgvIndex &index) {
+  m_matches.clear();
+  m_parseErrors.clear();
+
+  for (auto name = m_names.cbegin(); name != m_names.cend(); ++name) {
+    if (std::find(m_names.cbegin(), name, *name) != name) {
+      continue;
+    }
+    index.ForEachPosition(*name, [this, &argv, &index](size_t pos) {
+      // a flag takes no value, "--flag=value" is an error
+      if (m_isFlag && index.IsSplit(pos)) {
+        m_parseErrors.push_back(std::next(argv.cbegin(), pos + 1));
+      } else {
+        m_matches.push_back(std::next(argv.cbegin(), pos + 1));
+      }
+    });
+  }
+
+  // several names interleave, restore argv order. A bundle like "-ab" matches
+  // several names at the same position, each counts.
+  if (m_names.size() > 1) {
+    std::sort(m_matches.begin(), m_matches.end());
+    std::sort(m_parseErrors.begin(), m_parseErrors.end());
+  }
+
+  return m_matches.size();
+}
+
+template <>
+// static
+POPTS_INLINE bool OptionTraits<duration_t>::FromString(string_view data,
+                                                       duration_t &out) {
+  // a sequence of <number><unit>, e.g. 5ms, 1.5h or 1h30m
+  using std::chrono::duration;
+
+  const char *it = data.data();
+  const char *last = it + data.size();
+
+  auto unit = [&it, last](string_view symbol) {
+    if (string_view(it, last - it).substr(0, symbol.size()) != symbol) {
+      return false;
+    }
+    it += symbol.size();
+    return true;
+  };
+
+  if (it == last) {
+    return false;
+  }
+
+  duration_t sum(0);
+  while (it != last) {
+    // from_chars would also accept a sign, inf and nan
+    if (!std::isdigit(static_cast<unsigned char>(*it)) && *it != '.') {
+      return false;
+    }
+
+    long double value;
+    auto result = detail::FromChars(it, last, value);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+    it = result.ptr;
+
+    if (unit("d")) {
+      sum += duration<long double, std::ratio<86400>>(value);
+    } else if (unit("h")) {
+      sum += duration<long double, std::ratio<3600>>(value);
+    } else if (unit("ms")) {
+      sum += duration<long double, std::milli>(value);
+    } else if (unit("m")) {
+      sum += duration<long double, std::ratio<60>>(value);
+    } else if (unit("s")) {
+      sum += duration<long double, std::ratio<1>>(value);
+    } else if (unit("us") || unit("\xC2\xB5s") || unit("\xCE\xBCs")) {
+      // 'u', micro sign and greek small letter mu
+      sum += duration<long double, std::micro>(value);
+    } else if (unit("ns")) {
+      sum += duration<long double, std::nano>(value);
+    } else {
+      return false;
+    }
+  }
+
+  out = sum;
+  return true;
+}
+
+template <>
+// static
+POPTS_INLINE bool OptionTraits<std::string>::FromString(string_view data,
+                                                        std::string &out) {
+  out.assign(data.data(), data.size());
+  return true;
+}
+
+template <>
+// static
+POPTS_INLINE bool OptionTraits<bool>::FromString(string_view data, bool &out) {
+  static const string_view truthy[] = {"true", "1", "on", "yes", "y"};
+  static const string_view falsy[] = {"false", "0", "off", "no", "n"};
+
+  // compares without a lowercase copy, so that parsing does not allocate
+  auto equalsData = [data](string_view word) {
+    return data.size() == word.size() &&
+           std::equal(data.cbegin(), data.cend(), word.cbegin(),
+                      [](char lhs, char rhs) {
+                        return ::std::tolower(
+                                   static_cast<unsigned char>(lhs)) == rhs;
+                      });
+  };
+
+  if (std::any_of(std::cbegin(truthy), std::cend(truthy), equalsData)) {
+    out = true;
+    return true;
+  } else if (std::any_of(std::cbegin(falsy), std::cend(falsy), equalsData)) {
+    out = false;
+    return true;
+  } else {
+    out = true;
+    return false;
+  }
+}
+
+template <>
+// static
+POPTS_INLINE std::string
+OptionTraits<duration_t>::ToString(const duration_t &data) {
+  std::stringstream ss;
+  ss << data.count() << "s";
+  return ss.str();
+}
+
+template <> POPTS_INLINE bool OptionTraits<bool>::FlagMatchValue() {
+  return true;
+}
+
+} // namespace popts
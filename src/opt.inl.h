@@ -1,139 +1,534 @@
 #include <algorithm>
-#include <cctype>   //std::tolower
+#include <array>
+#include <cfloat>   //FLT_EVAL_METHOD
 #include <charconv> //std::from_chars
-#include <regex>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// no floating point from_chars in this standard library, streams instead
+#if !defined(__cpp_lib_to_chars) || __cpp_lib_to_chars < 201611L
+#define POPTS_NO_FLOAT_FROM_CHARS
+#include <locale>
 #include <sstream>
+#endif
+
+// define POPTS_NO_SIMD for the portable scalar code only
+#if !defined(POPTS_NO_SIMD) &&                                                \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define POPTS_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 namespace popts {
 
-unsigned int Option::ParseMatches(const argv_t &argv) {
-  auto from = std::next(argv.cbegin());
-  auto to = argv.cend();
+namespace detail {
 
-  for (auto match = from;;) {
-    match = std::find_first_of(match, to, m_names.cbegin(), m_names.cend());
+template <typename T>
+constexpr bool IsCharacter =
+    std::is_same<T, char>::value || std::is_same<T, signed char>::value ||
+    std::is_same<T, unsigned char>::value || std::is_same<T, wchar_t>::value ||
+    std::is_same<T, char16_t>::value || std::is_same<T, char32_t>::value;
 
-    if (match == to) {
-      break;
-    };
+// bool and the character types keep their own or the streaming semantics
+template <typename T>
+constexpr bool IsNumber = std::is_arithmetic<T>::value &&
+                          !std::is_same<T, bool>::value && !IsCharacter<T>;
 
-    m_matches.push_back(++match);
-  }
+// The streams are behind function pointers, only the implementation includes
+// <sstream>. Types without conversions of their own are read and written with
+// operator>> and operator<<, which have to be declared where the option is
+// added.
+POPTS_INLINE bool StreamFromString(string_view data, void *out,
+                                   void (*read)(std::istream &, void *));
+POPTS_INLINE std::string StreamToString(const void *data,
+                                        void (*write)(std::ostream &,
+                                                      const void *));
+// the same text as operator<<
+POPTS_INLINE std::string NumberToString(long long data);
+POPTS_INLINE std::string NumberToString(unsigned long long data);
+POPTS_INLINE std::string NumberToString(long double data);
+// the first character that is not whitespace, like operator>>
+POPTS_INLINE bool CharacterFromString(string_view data, char &out);
 
-  return m_matches.size();
+template <typename T> bool StreamFromString(string_view data, T &out) {
+  return StreamFromString(data, &out, [](std::istream &in, void *out) {
+    in >> *static_cast<T *>(out);
+  });
 }
 
 template <typename T>
-// static
-bool OptionImpl<T>::FromString(const std::string &data, T &out) {
-  std::stringstream ss;
-  ss << data;
-  ss >> out;
-  return !ss.fail();
+std::from_chars_result FromChars(const char *first, const char *last,
+                                 T &value) {
+#ifdef POPTS_NO_FLOAT_FROM_CHARS
+  if constexpr (std::is_floating_point<T>::value) {
+    std::istringstream ss(string(first, last));
+    ss.imbue(std::locale::classic());
+    ss >> std::noskipws >> value;
+    if (ss.fail()) {
+      return {first, std::errc::invalid_argument};
+    }
+    return {ss.eof() ? last : first + ss.tellg(), std::errc()};
+  } else
+#endif
+  {
+    return std::from_chars(first, last, value);
+  }
 }
 
-template <>
-// static
-bool OptionImpl<duration_t>::FromString(const std::string &data,
-                                        duration_t &out) {
-  // since C++20 is not out yet...
-  std::regex durationRe("(\\d+)(d|h|m|s|ms|ns)"s);
-  std::smatch m;
-  if (!std::regex_match(data, m, durationRe)) {
-    return false;
+// Locale independent and strict, the whole string has to be a number.
+template <typename T> bool NumberFromString(string_view data, T &out) {
+  const char *first = data.data();
+  const char *last = first + data.size();
+
+  // from_chars does not accept an explicit plus sign
+  if (last - first > 1 && *first == '+' && first[1] != '-') {
+    ++first;
   }
 
-  std::string numbers = m[1].str();
-  std::string unit = m[2].str();
-
-  long double value;
-  std::from_chars(numbers.data(), numbers.data() + numbers.size(), value);
-
-  if (unit == "d"s) {
-    out = std::chrono::duration<long double, std::ratio<86400>>(value);
-  } else if (unit == "h"s) {
-    out = std::chrono::duration<long double, std::ratio<3600>>(value);
-  } else if (unit == "m"s) {
-    out = std::chrono::duration<long double, std::ratio<60>>(value);
-  } else if (unit == "s"s) {
-    out = std::chrono::duration<long double, std::ratio<1>>(value);
-  } else if (unit == "ms"s) {
-    out = std::chrono::duration<long double, std::milli>(value);
-  } else if (unit == "ns"s) {
-    out = std::chrono::duration<long double, std::nano>(value);
-  } else {
+  T value;
+  auto result = FromChars(first, last, value);
+  if (result.ec != std::errc() || result.ptr != last) {
     return false;
   }
 
+  out = value;
   return true;
 }
 
-template <>
-// static
-bool OptionImpl<std::string>::FromString(const std::string &data,
-                                         std::string &out) {
-  out = data;
+#ifdef POPTS_SSE2
+inline unsigned CountTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// x86 is little-endian, the first character is the lowest byte
+inline bool IsEightDigits(uint64_t chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+          (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+inline uint64_t EightDigitsValue(uint64_t chunk) {
+  chunk -= 0x3030303030303030;
+  chunk = chunk * 10 + (chunk >> 8);
+  return (((chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+          (((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+         32;
+}
+#endif
+
+// Accumulates the digits at it into value, eight at a time where possible,
+// and returns how many there were. More than 19 digits overflow value.
+inline size_t ScanDigits(const char *&it, const char *last, uint64_t &value) {
+  const char *first = it;
+#ifdef POPTS_SSE2
+  for (uint64_t chunk; last - it >= 8; it += 8) {
+    std::memcpy(&chunk, it, sizeof(chunk));
+    if (!IsEightDigits(chunk)) {
+      break;
+    }
+    value = value * 100000000 + EightDigitsValue(chunk);
+  }
+#endif
+  for (; it != last; ++it) {
+    const unsigned digit = static_cast<unsigned char>(*it) - '0';
+    if (digit > 9) {
+      break;
+    }
+    value = value * 10 + digit;
+  }
+  return it - first;
+}
+
+// Like NumberFromString for integers. Anything but a sign and up to 18
+// digits takes the from_chars path.
+template <typename T> bool IntegerFromString(string_view data, T &out) {
+  const char *it = data.data();
+  const char *last = it + data.size();
+
+  const bool isNegative = it != last && *it == '-';
+  if (it != last && (*it == '-' || *it == '+')) {
+    ++it;
+  }
+
+  uint64_t value = 0;
+  const size_t digits = ScanDigits(it, last, value);
+  if (it != last || digits == 0 || digits > 18 ||
+      (isNegative && std::is_unsigned<T>::value)) {
+    return NumberFromString(data, out);
+  }
+
+  const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) +
+                         (isNegative ? 1 : 0);
+  if (value > limit) {
+    return false;
+  }
+
+  out = static_cast<T>(isNegative ? 0 - value : value);
   return true;
 }
 
-template <>
-// static
-bool OptionImpl<bool>::FromString(const std::string &data, bool &out) {
-  static const auto truthy = {"true"s, "1"s, "on"s, "yes"s, "y"s};
-  static const auto falsy = {"false"s, "0"s, "off"s, "no"s, "n"s};
+// The largest power of ten that T represents exactly, at most 10^19.
+template <typename T> constexpr size_t MaxExactPowerOfTen() {
+  // 10^k is exact if 5^k fits into the mantissa
+  const int bits = std::min(std::numeric_limits<T>::digits, 63);
+  uint64_t five = 1;
+  size_t power = 0;
+  while (power < 19 && five * 5 < (uint64_t(1) << bits)) {
+    five *= 5;
+    ++power;
+  }
+  return power;
+}
 
-  std::string lowerdata;
-  lowerdata.reserve(data.size());
+// Like NumberFromString for floating point. A plain decimal with up to 19
+// digits is the quotient of two exactly represented numbers, which the one
+// division rounds correctly, anything else takes the from_chars path.
+template <typename T> bool FloatFromString(string_view data, T &out) {
+#if FLT_EVAL_METHOD == 0
+  constexpr size_t maxPower = MaxExactPowerOfTen<T>();
+  static const auto powers = [] {
+    std::array<T, maxPower + 1> powers{};
+    powers[0] = 1;
+    for (size_t power = 1; power <= maxPower; ++power) {
+      powers[power] = powers[power - 1] * 10;
+    }
+    return powers;
+  }();
 
-  std::transform(data.cbegin(), data.cend(), std::back_inserter(lowerdata),
-                 [](int C) { return ::std::tolower(C); });
+  const char *it = data.data();
+  const char *last = it + data.size();
 
-  if (std::find(std::cbegin(truthy), std::cend(truthy), lowerdata) !=
-      std::cend(truthy)) {
-    out = true;
-    return true;
-  } else if (std::find(std::cbegin(falsy), std::cend(falsy), lowerdata) !=
-             std::cend(falsy)) {
-    out = false;
+  const bool isNegative = it != last && *it == '-';
+  if (it != last && (*it == '-' || *it == '+')) {
+    ++it;
+  }
+
+  uint64_t mantissa = 0;
+  const size_t integerDigits = ScanDigits(it, last, mantissa);
+  size_t fractionDigits = 0;
+  if (it != last && *it == '.') {
+    ++it;
+    fractionDigits = ScanDigits(it, last, mantissa);
+  }
+
+  constexpr int mantissaBits = std::numeric_limits<T>::digits;
+  if (it == last && integerDigits != 0 &&
+      (fractionDigits != 0 || data.back() != '.') &&
+      integerDigits + fractionDigits <= 19 && fractionDigits <= maxPower &&
+      mantissa <= uint64_t(1) << std::min(mantissaBits, 63)) {
+    const T value = static_cast<T>(mantissa) / powers[fractionDigits];
+    out = isNegative ? -value : value;
     return true;
+  }
+#endif
+  return NumberFromString(data, out);
+}
+
+// Calls f with every field of data between separators, 16 characters are
+// compared at a time.
+template <typename F>
+void ForEachField(string_view data, char separator, F &&f) {
+  const char *it = data.data();
+  const char *last = it + data.size();
+  const char *field = it;
+
+#ifdef POPTS_SSE2
+  const __m128i pattern = _mm_set1_epi8(separator);
+  for (; last - it >= 16; it += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+    for (; mask; mask &= mask - 1) {
+      const char *end = it + CountTrailingZeros(mask);
+      f(string_view(field, end - field));
+      field = end + 1;
+    }
+  }
+#endif
+  for (; it != last; ++it) {
+    if (*it == separator) {
+      f(string_view(field, it - field));
+      field = it + 1;
+    }
+  }
+
+  f(string_view(field, last - field));
+}
+
+// Converts every field of a delimited list, one that cannot be converted
+// fails the list but the others are still put.
+template <typename T, typename F>
+bool ListFromString(string_view data, char separator, F &&put) {
+  bool isValid = true;
+
+  ForEachField(data, separator, [&isValid, &put](string_view field) {
+    T value;
+    bool isConverted;
+    if constexpr (std::is_integral<T>::value && IsNumber<T>) {
+      isConverted = IntegerFromString(field, value);
+    } else if constexpr (std::is_floating_point<T>::value) {
+      isConverted = FloatFromString(field, value);
+    } else {
+      isConverted = OptionTraits<T>::FromString(field, value);
+    }
+
+    if (isConverted) {
+      put(value);
+    } else {
+      isValid = false;
+    }
+  });
+
+  return isValid;
+}
+
+} // namespace detail
+
+template <typename T, size_t N>
+SmallVector<T, N>::SmallVector(const SmallVector &other) {
+  reserve(other.size());
+  for (const auto &value : other) {
+    push_back(value);
+  }
+}
+
+template <typename T, size_t N>
+SmallVector<T, N>::SmallVector(SmallVector &&other) noexcept {
+  MoveFrom(other);
+}
+
+template <typename T, size_t N>
+SmallVector<T, N> &SmallVector<T, N>::operator=(const SmallVector &other) {
+  if (this != &other) {
+    clear();
+    reserve(other.size());
+    for (const auto &value : other) {
+      push_back(value);
+    }
+  }
+  return *this;
+}
+
+template <typename T, size_t N>
+SmallVector<T, N> &SmallVector<T, N>::operator=(SmallVector &&other) noexcept {
+  if (this != &other) {
+    clear();
+    if (!IsInline()) {
+      ::operator delete(m_data);
+      m_data = InlineData();
+      m_capacity = N;
+    }
+    MoveFrom(other);
+  }
+  return *this;
+}
+
+template <typename T, size_t N> SmallVector<T, N>::~SmallVector() {
+  clear();
+  if (!IsInline()) {
+    ::operator delete(m_data);
+  }
+}
+
+template <typename T, size_t N>
+void SmallVector<T, N>::reserve(size_t capacity) {
+  if (capacity <= m_capacity) {
+    return;
+  }
+
+  T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+  for (size_t i = 0; i < m_size; ++i) {
+    new (data + i) T(std::move_if_noexcept(m_data[i]));
+    m_data[i].~T();
+  }
+
+  if (!IsInline()) {
+    ::operator delete(m_data);
+  }
+  m_data = data;
+  m_capacity = capacity;
+}
+
+template <typename T, size_t N>
+template <typename... Args>
+T &SmallVector<T, N>::emplace_back(Args &&... args) {
+  if (m_size == m_capacity) {
+    // args may refer to an element, construct before moving the elements
+    T value(std::forward<Args>(args)...);
+    reserve(2 * m_capacity);
+    new (m_data + m_size) T(std::move(value));
   } else {
-    out = true;
-    return false;
+    new (m_data + m_size) T(std::forward<Args>(args)...);
+  }
+  return m_data[m_size++];
+}
+
+template <typename T, size_t N> void SmallVector<T, N>::clear() {
+  for (size_t i = 0; i < m_size; ++i) {
+    m_data[i].~T();
+  }
+  m_size = 0;
+}
+
+template <typename T, size_t N>
+void SmallVector<T, N>::MoveFrom(SmallVector &other) {
+  if (other.IsInline()) {
+    for (size_t i = 0; i < other.m_size; ++i) {
+      new (m_data + i) T(std::move(other.m_data[i]));
+    }
+    m_size = other.m_size;
+    other.clear();
+  } else {
+    m_data = std::exchange(other.m_data, other.InlineData());
+    m_size = std::exchange(other.m_size, 0);
+    m_capacity = std::exchange(other.m_capacity, N);
+  }
+}
+
+template <typename F>
+void ArgvIndex::ForEachPosition(string_view name, F &&f) const {
+  auto nodes = m_names.find(name);
+  if (nodes == m_names.cend()) {
+    return;
+  }
+
+  for (size_t node = nodes->second.first; node != npos;
+       node = m_nodes[node].m_next) {
+    if (!m_nodes[node].m_isJoined) {
+      f(m_nodes[node].m_position);
+    }
   }
 }
 
 template <typename T>
 // static
-std::string OptionImpl<T>::ToString(const T &data) {
-  std::stringstream ss;
-  ss << data;
-  return ss.str();
+bool OptionTraits<T>::FromString(string_view data, T &out) {
+  if constexpr (detail::IsNumber<T>) {
+    return detail::NumberFromString(data, out);
+  } else if constexpr (detail::IsCharacter<T> && sizeof(T) == 1) {
+    char c;
+    if (!detail::CharacterFromString(data, c)) {
+      return false;
+    }
+    out = static_cast<T>(c);
+    return true;
+  } else {
+    return detail::StreamFromString(data, out);
+  }
 }
 
-template <>
+template <typename T>
 // static
-std::string OptionImpl<duration_t>::ToString(const duration_t &data) {
-  std::stringstream ss;
-  ss << data.count() << "s";
-  return ss.str();
+std::string OptionTraits<T>::ToString(const T &data) {
+  if constexpr (std::is_floating_point<T>::value) {
+    return detail::NumberToString(static_cast<long double>(data));
+  } else if constexpr (detail::IsCharacter<T> && sizeof(T) == 1) {
+    return std::string(1, static_cast<char>(data));
+  } else if constexpr (std::is_signed<T>::value) {
+    // bool and the wider characters are written as numbers, too
+    return detail::NumberToString(static_cast<long long>(data));
+  } else if constexpr (std::is_arithmetic<T>::value) {
+    return detail::NumberToString(static_cast<unsigned long long>(data));
+  } else if constexpr (std::is_convertible<const T &, string_view>::value) {
+    return std::string(string_view(data));
+  } else {
+    return detail::StreamToString(&data, [](std::ostream &out,
+                                            const void *data) {
+      out << *static_cast<const T *>(data);
+    });
+  }
+}
+
+template <typename T, typename Storage>
+void OptionImpl<T, Storage>::ParseArguments(const argv_t &argv,
+                                            const ArgvIndex &index,
+                                            const Fallback &fallback) {
+  ParseMatches(argv, index);
+  m_argvEnd = argv.cend();
+
+  if (m_isLazy) {
+    m_fallback = fallback;
+    m_isResolved = false;
+
+    // the handle refers to the element before it is converted
+    if (m_count == Single && m_storage.empty()) {
+      m_storage.push_back(m_defaultArgument);
+    }
+    return;
+  }
+
+  Convert(fallback);
 }
 
-template <typename T> void OptionImpl<T>::ParseArguments(const argv_t &argv) {
-  ParseMatches(argv);
+template <typename T, typename Storage>
+void OptionImpl<T, Storage>::Resolve() {
+  if (!m_isResolved) {
+    Convert(m_fallback);
+    m_fallback.m_values.clear();
+    m_fallback.m_source.clear();
+    m_isResolved = true;
+  }
+}
 
-  m_storage.clear();
-  m_parseErrors.clear();
+template <typename T, typename Storage>
+void OptionImpl<T, Storage>::Convert(const Fallback &fallback) {
+  // ParseMatches put the values given to flags in m_parseErrors
+  m_fallbackErrors.clear();
+  m_fallbackSource.clear();
+
+  // a single option has exactly one element, the first value wins
+  const bool isSingle = m_count == Single;
+  bool hasValue = false;
+  auto put = [this, isSingle, &hasValue](const T &value) {
+    if (!isSingle) {
+      m_storage.push_back(value);
+    } else if (!hasValue && m_storage.empty()) {
+      m_storage.push_back(value);
+    } else if (!hasValue) {
+      m_storage.front() = value;
+    }
+    hasValue = true;
+  };
+
+  // a list option puts every value of the argument
+  auto convert = [this, &put](string_view data) {
+    if (m_separator) {
+      return detail::ListFromString<T>(data, m_separator, put);
+    }
+
+    T value;
+    if (!OptionTraits<T>::FromString(data, value)) {
+      return false;
+    }
+    put(value);
+    return true;
+  };
+
+  if (!isSingle) {
+    m_storage.clear();
+  }
 
   if (m_isFlag) {
-    std::fill_n(std::back_inserter(m_storage), m_matches.size(),
-                FlagMatchValue());
+    for (size_t i = 0; i < m_matches.size(); ++i) {
+      put(OptionTraits<T>::FlagMatchValue());
+    }
   } else {
+    // "--" after a name is the terminator, the first one ends the index
     for (auto match : m_matches) {
-      if (match != argv.cend()) {
-        T value;
-        if (FromString(*match, value)) {
-          m_storage.push_back(value);
-        } else {
+      if (match != m_argvEnd && *match != "--") {
+        if (!convert(*match)) {
           m_parseErrors.push_back(match);
         }
       } else {
@@ -142,13 +537,40 @@ template <typename T> void OptionImpl<T>::ParseArguments(const argv_t &argv) {
     }
   }
 
+  // argv takes precedence over all fallback sources
+  if (m_matches.empty()) {
+    for (auto data : fallback.m_values) {
+      if (!convert(data)) {
+        m_fallbackErrors.push_back(data);
+      }
+    }
+
+    if (!m_fallbackErrors.empty()) {
+      m_fallbackSource = fallback.m_source;
+    }
+  }
+
+  if (isSingle && !hasValue) {
+    put(m_defaultArgument);
+  }
+}
+
+template <typename T, typename Storage>
+const void *OptionImpl<T, Storage>::Value() const {
   if (m_count == Single) {
-    m_storage.push_back(m_defaultArgument);
+    return &m_storage.front();
   }
+  return &m_storage;
 }
 
-template <typename T> T OptionImpl<T>::FlagMatchValue() { return T(); }
+template <typename T, typename Storage>
+std::shared_ptr<const void> OptionImpl<T, Storage>::CopyValue() const {
+  if (m_count == Single) {
+    return std::make_shared<const T>(m_storage.front());
+  }
+  return std::make_shared<const Storage>(m_storage);
+}
 
-template <> bool OptionImpl<bool>::FlagMatchValue() { return true; }
+template <typename T> T OptionTraits<T>::FlagMatchValue() { return T(); }
 
 } // namespace popts
@@ -3,12 +3,70 @@
 #define POPTS_OPTS_H_INCLUDED
 
 #include "opt.h"
+#include "sources.h"
+
+#include <atomic>
 
 namespace popts {
 
+class Snapshot;
+
+// What an argument has been claimed as during parsing, see
+// Options::Ownership().
+struct ArgOwner {
+  enum class Role : uint8_t { None, Name, Argument, Terminator };
+
+  static constexpr uint32_t NoOption = std::numeric_limits<uint32_t>::max();
+
+  // registration index of the option that claimed the argument first
+  uint32_t m_option = NoOption;
+  Role m_role = Role::None;
+  // claimed again, e.g. a name consumed as the argument of another option
+  bool m_isConflict = false;
+};
+
+// What checks and the description need of every option, in arrays indexed
+// by registration order. Walking them touches a few contiguous blocks instead
+// of every Option. The views point into the options, whose names, description
+// and default are not modified after registration.
+struct OptionRegistry {
+  explicit OptionRegistry(std::pmr::memory_resource *resource);
+
+  // Appends a registered option.
+  void Add(const Option &option);
+  // Takes the errors of an option that has been parsed.
+  void Update(size_t index, const Option &option);
+
+  size_t size() const { return m_descriptions.size(); }
+  // The first option from index on that has errors or is lazy, or size().
+  size_t NextToCheck(size_t index) const;
+
+  static bool IsSet(const std::pmr::vector<uint64_t> &bits, size_t index) {
+    return (bits[index / 64] >> (index % 64)) & 1;
+  }
+
+  // the names of option i are [m_nameBegin[i], m_nameBegin[i + 1])
+  std::pmr::vector<string_view> m_names;
+  std::pmr::vector<uint32_t> m_nameBegin;
+  std::pmr::vector<string_view> m_descriptions;
+  std::pmr::vector<string_view> m_defaults;
+  // of "names, ... (...) [=default]"
+  std::pmr::vector<uint32_t> m_namesWidths;
+  // one bit per option
+  std::pmr::vector<uint64_t> m_isFlag;
+  std::pmr::vector<uint64_t> m_isMultiple;
+  std::pmr::vector<uint64_t> m_isLazy;
+  // known after parsing, lazy options only know after Resolve
+  std::pmr::vector<uint64_t> m_hasErrors;
+
+private:
+  static void Assign(std::pmr::vector<uint64_t> &bits, size_t index,
+                     bool value);
+};
+
 class Options {
 public:
-  using argv_t = vector<string>;
+  using argv_t = Option::argv_t;
 
 private:
   struct tail_t {
@@ -17,42 +75,150 @@ private:
     argv_t::const_iterator m_cbegin, m_cend;
   };
 
+  // destroys a subcommand allocated from the resource of its parent
+  struct CommandDeleter {
+    void operator()(Options *command) const;
+
+    std::pmr::memory_resource *m_resource;
+  };
+
+  // an occurrence of the name of a subcommand in the uncut argv
+  struct CommandCandidate {
+    size_t m_position;
+    const Options *m_command;
+    // the value of an option, e.g. "build" in "--name build"
+    bool m_isValue;
+  };
+
 public:
-  Options(const argv_t &argv);
-  Options(int argc, char **argv);
+  // Everything Options keeps is allocated from resource, e.g. a
+  // std::pmr::monotonic_buffer_resource, subcommands included. It has to
+  // outlive the Options. The values handed out and the cached Description use
+  // the default allocator.
+  Options(const vector<string> &argv, std::pmr::memory_resource *resource =
+                                          std::pmr::get_default_resource());
+  Options(int argc, char **argv,
+          std::pmr::memory_resource *resource =
+              std::pmr::get_default_resource());
+  // The references handed out stay valid. Not assignable, the arguments
+  // could be copied to a different resource then.
+  Options(Options &&other);
 
   Options &WithHelp();
 
+  // Replaces every argument '@path' with the arguments in the file at path,
+  // recursively. Call before adding options.
+  Options &WithResponseFiles();
+
+  // Reads every argument of a dash and two or more letters as a bundle of
+  // short options, "-abc" is "-a -b -c". Names of more than one letter need
+  // two dashes then. Call before adding subcommands and options, the
+  // subcommands bundle as well.
+  Options &WithBundles();
+
+  // Takes the environment variables of options from envp, a null-terminated
+  // array of "NAME=value" like the third argument of main, null is empty.
+  // Without it the environment of the process is read when the first option
+  // needs it. Call before adding options.
+  Options &WithEnvironment(const char *const *envp);
+
+  // Reads values for options without matches in argv from the config file at
+  // path, see TokenizeConfigFile. Keys are option names without leading
+  // dashes, "section.key" for keys in sections. argv and the environment take
+  // precedence. Values of earlier files come first, single options take the
+  // first value. Call before adding options.
+  Options &WithConfigFile(const char *path);
+
+  // Adds a subcommand with its own options and returns them, e.g.
+  // `tool [options] build [build options]`. The first argument that is the
+  // name of a subcommand selects it. The options of this table only match
+  // before it, the options of the subcommand only after it, and Tail and
+  // Description are scoped the same way. Call before adding options.
+  Options &Subcommand(const char *name, const string &description);
+  // The selected subcommand or nullptr.
+  const Options *SelectedSubcommand() const;
+
+  // Parses argv again for the options registered so far, without registering
+  // them again. Response files, config files and the process environment are
+  // read again as well.
+  //
+  // The values are updated in place: the reference of a single option sees
+  // the new value, the container of a multiple option is refilled. Reading
+  // values while Reparse runs is a data race, readers on other threads have
+  // to be synchronized with the caller.
+  Options &Reparse(const vector<string> &argv);
+  Options &Reparse(int argc, char **argv);
+
+  // Incremented by every Reparse, readers can poll it to detect a change.
+  uint64_t Generation() const;
+  // Copies all values for readers on other threads, see SnapshotPublisher.
+  std::shared_ptr<const Snapshot> MakeSnapshot() const;
+
   bool HasDuplicateNames(std::ostream *out = nullptr) const;
+  // The option registered first under name or nullptr.
+  const Option *FindOption(string_view name) const;
   bool HasErrorMatches(std::ostream *out = nullptr) const;
   bool HasConsistentTail(std::ostream *out = nullptr) const;
   tail_t Tail() const;
-  string Description() const;
+  // One entry per argument in argv, argv[0] is never claimed.
+  const std::pmr::vector<ArgOwner> &Ownership() const;
+  // The help text, built once and cached until the next option is added.
+  const string &Description() const;
+  // Writes the help text to out without building it in memory first.
+  void Description(std::ostream &out) const;
 
+  // An option without matches in argv takes its value from the environment
+  // variable environmentName if it is set, before falling back to the default.
   template <typename T>
   const T &MakeOption(std::initializer_list<const char *> names,
-                      const T &defaultArgument, const string &description);
+                      const T &defaultArgument, const string &description,
+                      const char *environmentName = nullptr);
+
+  // Storage may be any container OptionImpl accepts, e.g. SmallVector<T>.
+  template <typename T, typename Storage = deque<T>>
+  const Storage &MakeOptions(std::initializer_list<const char *> names,
+                             const string &description,
+                             const char *environmentName = nullptr);
+
+  // Like MakeOptions, but every argument is a list of values separated by
+  // separator, e.g. "--weights 0.1,0.2,0.3". The values are contiguous.
+  template <typename T>
+  const vector<T> &MakeListOptions(std::initializer_list<const char *> names,
+                                   char separator, const string &description,
+                                   const char *environmentName = nullptr);
 
+  // Like MakeOption and MakeOptions, but the arguments are converted on the
+  // first access of the handle. HasErrorMatches converts all lazy options.
   template <typename T>
-  const deque<T> &MakeOptions(std::initializer_list<const char *> names,
-                              const string &description);
+  Lazy<T> MakeLazyOption(std::initializer_list<const char *> names,
+                         const T &defaultArgument, const string &description,
+                         const char *environmentName = nullptr);
+
+  template <typename T, typename Storage = deque<T>>
+  Lazy<Storage> MakeLazyOptions(std::initializer_list<const char *> names,
+                                const string &description,
+                                const char *environmentName = nullptr);
 
   const bool &Flag(std::initializer_list<const char *> names,
-                   const string &description);
+                   const string &description,
+                   const char *environmentName = nullptr);
 
   const deque<bool> &Flags(std::initializer_list<const char *> names,
-                           const string &description);
+                           const string &description,
+                           const char *environmentName = nullptr);
 
 #define DEFINE_OPTION_FUNC(Type, Name)                                         \
-  const Type &Options::Name(std::initializer_list<const char *> names,         \
-                            const Type &defaultArgument,                       \
-                            const string &description) {                       \
-    return MakeOption<Type>(names, defaultArgument, description);              \
+  const Type &Name(std::initializer_list<const char *> names,                  \
+                   const Type &defaultArgument, const string &description,     \
+                   const char *environmentName = nullptr) {                    \
+    return MakeOption<Type>(names, defaultArgument, description,               \
+                            environmentName);                                  \
   }                                                                            \
                                                                                \
-  const deque<Type> &Options::Name##s(                                         \
-      std::initializer_list<const char *> names, const string &description) {  \
-    return MakeOptions<Type>(names, description);                              \
+  const deque<Type> &Name##s(std::initializer_list<const char *> names,        \
+                             const string &description,                        \
+                             const char *environmentName = nullptr) {          \
+    return MakeOptions<Type>(names, description, environmentName);             \
   }
 
   DEFINE_OPTION_FUNC(string, String)
@@ -63,20 +229,133 @@ public:
 
 #undef DEFINE_OPTION_FUNC
 
+// not for bool, vector<bool> has no references to its elements
+#define DEFINE_LIST_OPTION_FUNC(Type, Name)                                    \
+  const vector<Type> &Name##s(std::initializer_list<const char *> names,       \
+                              char separator, const string &description,       \
+                              const char *environmentName = nullptr) {         \
+    return MakeListOptions<Type>(names, separator, description,                \
+                                 environmentName);                             \
+  }
+
+  DEFINE_LIST_OPTION_FUNC(string, String)
+  DEFINE_LIST_OPTION_FUNC(int64_t, Int)
+  DEFINE_LIST_OPTION_FUNC(long double, Double)
+  DEFINE_LIST_OPTION_FUNC(duration_t, Duration)
+
+#undef DEFINE_LIST_OPTION_FUNC
+
 private:
-  template <typename T>
-  OptionImpl<T> &AddOption(std::initializer_list<const char *> names,
-                           const T &defaultArgument, const string &description,
-                           size_t count, bool isFlag);
+  friend class TailReader;
+
+  // a subcommand of parent, with argv[0] the name of the command
+  Options(const Options &parent, const char *name, const string &description);
+
+  void AssignArgv(const vector<string> &argv);
+  // Splits and indexes argv and resets the claims on it.
+  void BuildIndex();
+  void ResetClaims();
+  // Parses the first count options again, from a clean ownership table.
+  void ParseOptions(size_t count);
+  // Cuts argv at the first candidate that is no value and passes the rest to
+  // its subcommand. The others see no arguments, forced parses them again
+  // either way. Returns whether the cut moved.
+  bool SelectSubcommand(bool isForced);
+  // Adds the positions of the name of command to the candidates.
+  void AddCandidates(const Options &command);
+  // Checks the candidates again that a new option can turn into values or
+  // back: those at its names and in the run of values after them. Returns
+  // whether any changed.
+  bool RecheckCandidates(const Option &option);
+  // Whether the argument at position of the uncut argv is the value of an
+  // option of this table, e.g. "build" in "--name build".
+  bool IsOptionValue(size_t position) const;
+  // Whether argument is a name of an option of this table that takes a
+  // value, or a bundle that ends with one.
+  bool TakesValue(string_view argument) const;
+  string CommandPath() const;
+  void ExpandResponseFiles();
+  void ExpandResponseFile(string_view argument, argv_t &expanded,
+                          vector<string> &openFiles);
+
+  void LoadConfigFile(size_t fileIndex);
+
+  // Parses every option again, from scratch, after argv or sources changed.
+  void ReparseAll();
+  // Records the matches of an option in the ownership table, the registry and
+  // the tail.
+  void ClaimMatches(size_t optionIndex);
+  void Claim(size_t position, size_t option, ArgOwner::Role role);
+
+  Fallback FindFallback(const Option &option);
+
+  template <typename Put> void WriteDescription(Put &&put) const;
+
+  template <typename T, typename Storage = deque<T>>
+  OptionImpl<T, Storage> &AddOption(std::initializer_list<const char *> names,
+                                    const T &defaultArgument,
+                                    const string &description, size_t count,
+                                    bool isFlag, const char *environmentName,
+                                    bool isLazy = false, char separator = 0);
 
 private:
-  argv_t m_argv;
+  // first, the members below are allocated from it
+  std::pmr::memory_resource *m_resource;
+  // owns the arguments if they were not passed as argc/argv
+  std::pmr::vector<char> m_argvBuffer{m_resource};
+  argv_t m_argv{m_resource};
   argv_t::const_iterator m_tail = m_argv.cbegin();
-  deque<std::unique_ptr<Option>> m_options;
+  // built on the first registration, constructing Options does not allocate
+  // more than the argument table
+  ArgvIndex m_index{m_resource};
+  bool m_isIndexed = false;
+  // indexed like m_argv, replaces collecting and sorting matches for checks
+  std::pmr::vector<ArgOwner> m_owners{m_resource};
+  mutable string m_description;
+  mutable bool m_isDescriptionCached = false;
+  std::pmr::vector<std::unique_ptr<Option, OptionDeleter>> m_options{
+      m_resource};
+  OptionRegistry m_registry{m_resource};
+  // option index by name, keys point into Option::m_names
+  std::pmr::unordered_map<string_view, size_t> m_nameIndex{m_resource};
+  // names registered more than once, each listed once
+  std::pmr::vector<string_view> m_duplicateNames{m_resource};
+  // response and config files the arguments point into
+  std::pmr::vector<MappedFile> m_mappedFiles{m_resource};
+  bool m_hasResponseFiles = false;
+  // errors of argument sources other than argv, e.g. unreadable files
+  std::pmr::vector<std::pmr::string> m_sourceErrors{m_resource};
+  Environment m_environment{m_resource};
+  // read again by Reparse, unlike an environment passed in
+  bool m_isSystemEnvironment = false;
+  ConfigIndex m_config{m_resource};
+  std::pmr::vector<std::pmr::string> m_configFiles{m_resource};
+  std::atomic<uint64_t> m_generation{0};
+  // subcommands, argv up to the selected one is in m_argv
+  std::pmr::vector<std::unique_ptr<Options, CommandDeleter>> m_commands{
+      m_resource};
+  argv_t m_commandArgv{m_resource};
+  ArgvIndex m_commandIndex{m_resource};
+  // sorted by position, found once per subcommand and argv
+  std::pmr::vector<CommandCandidate> m_commandCandidates{m_resource};
+  const Options *m_selectedCommand = nullptr;
+  size_t m_commandPosition = ArgvIndex::npos;
+  // for a subcommand
+  const Options *m_parent = nullptr;
+  std::pmr::string m_commandName{m_resource};
+  std::pmr::string m_commandDescription{m_resource};
 };
 
 } // namespace popts
 
 #include "opts.inl.h"
 
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include "opts.impl.h"
+#endif
+
+#include "schema.h"
+#include "snapshot.h"
+#include "tail.h"
+
 #endif
@@ -0,0 +1,819 @@
+#include <cassert>
+#include <filesystem>
+#include <ostream>
+
+namespace popts {
+
+POPTS_INLINE OptionRegistry::OptionRegistry(
+    std::pmr::memory_resource *resource)
+    : m_names(resource), m_nameBegin(resource),
+      m_descriptions(resource), m_defaults(resource),
+      m_namesWidths(resource), m_isFlag(resource), m_isMultiple(resource),
+      m_isLazy(resource), m_hasErrors(resource) {}
+
+POPTS_INLINE void OptionRegistry::Add(const Option &option) {
+  const size_t index = size();
+  const bool isMultiple = option.m_count > Option::Single;
+  const bool hasDefault = !option.m_isFlag && !isMultiple;
+
+  size_t width = 0;
+  for (const auto &name : option.m_names) {
+    m_names.push_back(name);
+    width += name.size() + 2;
+  }
+  width -= std::min<size_t>(width, 2);
+  if (isMultiple) {
+    width += string_view(" (...)").size();
+  }
+  if (hasDefault) {
+    width += string_view(" [=]").size() + option.m_defaultString.size();
+  }
+
+  // the sentinel comes with the first option, construction allocates nothing
+  if (m_nameBegin.empty()) {
+    m_nameBegin.push_back(0);
+  }
+  m_nameBegin.push_back(static_cast<uint32_t>(m_names.size()));
+  m_descriptions.push_back(option.m_description);
+  m_defaults.push_back(hasDefault ? string_view(option.m_defaultString)
+                                  : string_view());
+  m_namesWidths.push_back(static_cast<uint32_t>(width));
+  Assign(m_isFlag, index, option.m_isFlag);
+  Assign(m_isMultiple, index, isMultiple);
+  Assign(m_isLazy, index, option.m_isLazy);
+  Assign(m_hasErrors, index, false);
+}
+
+POPTS_INLINE void OptionRegistry::Update(size_t index, const Option &option) {
+  Assign(m_hasErrors, index,
+         !option.m_parseErrors.empty() || !option.m_fallbackErrors.empty() ||
+             (option.m_count == Option::Single &&
+              option.m_matches.size() > 1));
+}
+
+POPTS_INLINE size_t OptionRegistry::NextToCheck(size_t index) const {
+  const size_t count = size();
+  while (index < count) {
+    const uint64_t bits =
+        (m_hasErrors[index / 64] | m_isLazy[index / 64]) >> (index % 64);
+    if (bits & 1) {
+      return index;
+    }
+    // skips the rest of the word if it has no candidates
+    index = bits ? index + 1 : (index / 64 + 1) * 64;
+  }
+  return count;
+}
+
+POPTS_INLINE void OptionRegistry::Assign(std::pmr::vector<uint64_t> &bits,
+                                         size_t index, bool value) {
+  if (index / 64 >= bits.size()) {
+    bits.resize(index / 64 + 1);
+  }
+  const uint64_t mask = uint64_t(1) << (index % 64);
+  bits[index / 64] = value ? bits[index / 64] | mask : bits[index / 64] & ~mask;
+}
+
+// argv outlives main, so the arguments are referenced instead of copied
+POPTS_INLINE Options::Options(int argc, char **argv,
+                              std::pmr::memory_resource *resource)
+    : m_resource(resource), m_argv(argv, argv + argc, resource) {}
+
+POPTS_INLINE Options::Options(const vector<string> &argv,
+                              std::pmr::memory_resource *resource)
+    : m_resource(resource) {
+  AssignArgv(argv);
+}
+
+// std::atomic cannot be moved, the generation is copied
+POPTS_INLINE Options::Options(Options &&other)
+    : m_resource(other.m_resource),
+      m_argvBuffer(std::move(other.m_argvBuffer)),
+      m_argv(std::move(other.m_argv)), m_tail(other.m_tail),
+      m_index(std::move(other.m_index)), m_isIndexed(other.m_isIndexed),
+      m_owners(std::move(other.m_owners)),
+      m_description(std::move(other.m_description)),
+      m_isDescriptionCached(other.m_isDescriptionCached),
+      m_options(std::move(other.m_options)),
+      m_registry(std::move(other.m_registry)),
+      m_nameIndex(std::move(other.m_nameIndex)),
+      m_duplicateNames(std::move(other.m_duplicateNames)),
+      m_mappedFiles(std::move(other.m_mappedFiles)),
+      m_hasResponseFiles(other.m_hasResponseFiles),
+      m_sourceErrors(std::move(other.m_sourceErrors)),
+      m_environment(std::move(other.m_environment)),
+      m_isSystemEnvironment(other.m_isSystemEnvironment),
+      m_config(std::move(other.m_config)),
+      m_configFiles(std::move(other.m_configFiles)),
+      m_generation(other.m_generation.load()),
+      m_commands(std::move(other.m_commands)),
+      m_commandArgv(std::move(other.m_commandArgv)),
+      m_commandIndex(std::move(other.m_commandIndex)),
+      m_commandCandidates(std::move(other.m_commandCandidates)),
+      m_selectedCommand(other.m_selectedCommand),
+      m_commandPosition(other.m_commandPosition), m_parent(other.m_parent),
+      m_commandName(std::move(other.m_commandName)),
+      m_commandDescription(std::move(other.m_commandDescription)) {
+  // the subcommands are not moved, only their parent
+  for (auto &command : m_commands) {
+    command->m_parent = this;
+  }
+  // the first argument of a subcommand is its name
+  if (m_parent && !m_argv.empty()) {
+    m_argv[0] = m_commandName;
+  }
+}
+
+POPTS_INLINE Options::Options(const Options &parent, const char *name,
+                              const string &description)
+    : m_resource(parent.m_resource), m_parent(&parent),
+      m_commandName(name, m_resource),
+      m_commandDescription(description, m_resource) {
+  m_index.m_hasBundles = parent.m_index.m_hasBundles;
+  m_argv.push_back(m_commandName);
+  m_tail = m_argv.cbegin();
+}
+
+POPTS_INLINE void Options::CommandDeleter::operator()(Options *command) const {
+  command->~Options();
+  m_resource->deallocate(command, sizeof(Options), alignof(Options));
+}
+
+POPTS_INLINE void Options::AssignArgv(const vector<string> &argv) {
+  size_t bufferSize = 0;
+  for (const auto &arg : argv) {
+    bufferSize += arg.size() + 1;
+  }
+
+  // one block for all arguments, each null-terminated like argv
+  m_argvBuffer.resize(bufferSize);
+  m_argv.clear();
+  m_argv.reserve(argv.size());
+
+  char *out = m_argvBuffer.data();
+  for (const auto &arg : argv) {
+    m_argv.emplace_back(out, arg.size());
+    out = std::copy(arg.cbegin(), arg.cend(), out);
+    *out++ = '\0';
+  }
+
+  m_tail = m_argv.cbegin();
+}
+
+POPTS_INLINE Options &Options::WithResponseFiles() {
+  assert(m_options.empty() && "expand response files before adding options");
+  assert(m_commands.empty() && "expand response files before subcommands");
+
+  m_hasResponseFiles = true;
+  ExpandResponseFiles();
+
+  return *this;
+}
+
+POPTS_INLINE Options &Options::WithBundles() {
+  assert(m_options.empty() && "enable bundles before adding options");
+  assert(m_commands.empty() && "enable bundles before subcommands");
+
+  m_index.m_hasBundles = true;
+  return *this;
+}
+
+POPTS_INLINE void Options::ExpandResponseFiles() {
+  argv_t expanded(m_resource);
+  expanded.reserve(m_argv.size());
+
+  vector<string> openFiles;
+  auto arg = m_argv.cbegin();
+  if (arg != m_argv.cend()) {
+    expanded.push_back(*arg++);
+  }
+  // behind "--" they are left to TailReader
+  for (; arg != m_argv.cend() && *arg != "--"; ++arg) {
+    ExpandResponseFile(*arg, expanded, openFiles);
+  }
+  expanded.insert(expanded.end(), arg, m_argv.cend());
+
+  m_argv = std::move(expanded);
+  m_tail = m_argv.cbegin();
+  m_isIndexed = false;
+}
+
+POPTS_INLINE Options &Options::WithEnvironment(const char *const *envp) {
+  // the fallbacks of options refer to the loaded environment
+  assert(m_options.empty() && "set the environment before adding options");
+
+  m_environment.Load(envp);
+  return *this;
+}
+
+POPTS_INLINE Options &Options::WithConfigFile(const char *path) {
+  assert(m_options.empty() && "read config files before adding options");
+
+  m_configFiles.emplace_back(path);
+  LoadConfigFile(m_configFiles.size() - 1);
+
+  return *this;
+}
+
+POPTS_INLINE void Options::LoadConfigFile(size_t fileIndex) {
+  const string path(m_configFiles[fileIndex]);
+
+  MappedFile file;
+  if (!file.Open(path.c_str())) {
+    m_sourceErrors.emplace_back("cannot read config file '" + path + "'");
+    return;
+  }
+
+  // typical lines are longer than 32 bytes, this avoids most rehashing
+  m_config.Reserve(file.size() / 32);
+
+  TokenizeConfigFile(
+      file.data(), file.data() + file.size(),
+      [this, fileIndex](string_view section, string_view key,
+                        string_view value) {
+        m_config.Add(section, key, value, fileIndex);
+      },
+      [this, &path](size_t line) {
+        m_sourceErrors.emplace_back("malformed line " +
+                                    std::to_string(line) +
+                                    " in config file '" + path + "'");
+      });
+
+  m_mappedFiles.push_back(std::move(file));
+}
+
+POPTS_INLINE Options &Options::Subcommand(const char *name,
+                                          const string &description) {
+  assert(m_options.empty() && "add subcommands before options");
+
+  if (m_commands.empty()) {
+    m_commandArgv = m_argv;
+    // the subcommand and this table split their slices themselves
+    m_commandIndex.Build(m_commandArgv, false);
+  }
+
+  void *block = m_resource->allocate(sizeof(Options), alignof(Options));
+  m_commands.push_back(std::unique_ptr<Options, CommandDeleter>(
+      new (block) Options(*this, name, description),
+      CommandDeleter{m_resource}));
+  m_isDescriptionCached = false;
+  AddCandidates(*m_commands.back());
+  SelectSubcommand(false);
+
+  return *m_commands.back();
+}
+
+POPTS_INLINE const Options *Options::SelectedSubcommand() const {
+  return m_selectedCommand;
+}
+
+POPTS_INLINE bool Options::SelectSubcommand(bool isForced) {
+  size_t position = m_commandArgv.size();
+  const Options *selected = nullptr;
+  for (const auto &candidate : m_commandCandidates) {
+    if (!candidate.m_isValue) {
+      position = candidate.m_position;
+      selected = candidate.m_command;
+      break;
+    }
+  }
+
+  if (!isForced && position == m_commandPosition &&
+      selected == m_selectedCommand) {
+    return false;
+  }
+
+  m_argv.assign(m_commandArgv.cbegin(), m_commandArgv.cbegin() + position);
+  m_tail = m_argv.cbegin();
+  m_isIndexed = false;
+  m_selectedCommand = selected;
+  m_commandPosition = position;
+
+  for (const auto &command : m_commands) {
+    argv_t argv({command->m_commandName}, m_resource);
+    if (command.get() == selected) {
+      argv.assign(m_commandArgv.cbegin() + position, m_commandArgv.cend());
+    }
+
+    // only the previously and newly selected commands change
+    if (isForced || argv != command->m_argv) {
+      command->m_argv = std::move(argv);
+      command->m_tail = command->m_argv.cbegin();
+      command->ReparseAll();
+    }
+  }
+  return true;
+}
+
+POPTS_INLINE void Options::AddCandidates(const Options &command) {
+  m_commandIndex.ForEachPosition(
+      command.m_commandName, [this, &command](size_t position) {
+        // after the candidates at the same position, the first command wins
+        auto next = std::upper_bound(
+            m_commandCandidates.cbegin(), m_commandCandidates.cend(), position,
+            [](size_t position, const CommandCandidate &candidate) {
+              return position < candidate.m_position;
+            });
+        const bool isValue = IsOptionValue(position);
+        m_commandCandidates.insert(
+            next, CommandCandidate{position, &command, isValue});
+      });
+}
+
+POPTS_INLINE bool Options::RecheckCandidates(const Option &option) {
+  bool isChanged = false;
+  auto recheck = [this, &isChanged](size_t first, size_t last) {
+    auto candidate = std::lower_bound(
+        m_commandCandidates.begin(), m_commandCandidates.end(), first,
+        [](const CommandCandidate &candidate, size_t position) {
+          return candidate.m_position < position;
+        });
+    for (; candidate != m_commandCandidates.end() &&
+           candidate->m_position <= last;
+         ++candidate) {
+      const bool isValue = IsOptionValue(candidate->m_position);
+      isChanged = isChanged || isValue != candidate->m_isValue;
+      candidate->m_isValue = isValue;
+    }
+  };
+
+  for (const auto &name : option.m_names) {
+    // a letter may end any bundle, the index only knows whole arguments
+    if (m_index.m_hasBundles && name.size() == 2) {
+      recheck(0, ArgvIndex::npos);
+      return isChanged;
+    }
+
+    // the name shifts every second value of the run that follows it
+    m_commandIndex.ForEachPosition(name, [this, &recheck](size_t position) {
+      size_t last = position + 1;
+      while (last < m_commandArgv.size() &&
+             TakesValue(m_commandArgv[last])) {
+        ++last;
+      }
+      recheck(position, last);
+    });
+  }
+  return isChanged;
+}
+
+POPTS_INLINE bool Options::TakesValue(string_view argument) const {
+  const Option *option = FindOption(argument);
+  // a bundle may end with an option that takes the next argument
+  if (!option && m_index.m_hasBundles && ArgvIndex::IsBundle(argument)) {
+    option = FindOption(ArgvIndex::ShortName(argument.back()));
+  }
+  return option && !option->m_isFlag;
+}
+
+POPTS_INLINE bool Options::IsOptionValue(size_t position) const {
+  // in a run of arguments that take values, every second one is a value
+  size_t first = position;
+  while (first > 1 && TakesValue(m_commandArgv[first - 1])) {
+    --first;
+  }
+  return (position - first) % 2 == 1;
+}
+
+POPTS_INLINE string Options::CommandPath() const {
+  if (m_parent) {
+    return m_parent->CommandPath().append(" ").append(m_commandName);
+  }
+
+  string_view cmdName = m_argv.empty() ? string_view() : m_argv[0];
+  size_t slashPos = cmdName.find_last_of("/\\");
+  if (slashPos != string_view::npos) {
+    cmdName.remove_prefix(slashPos + 1);
+  }
+  return string(cmdName);
+}
+
+POPTS_INLINE Options &Options::Reparse(const vector<string> &argv) {
+  AssignArgv(argv);
+  ReparseAll();
+  return *this;
+}
+
+POPTS_INLINE Options &Options::Reparse(int argc, char **argv) {
+  m_argvBuffer = std::pmr::vector<char>(m_resource);
+  m_argv.assign(argv, argv + argc);
+  m_tail = m_argv.cbegin();
+  ReparseAll();
+  return *this;
+}
+
+POPTS_INLINE uint64_t Options::Generation() const {
+  return m_generation.load(std::memory_order_acquire);
+}
+
+POPTS_INLINE void Options::BuildIndex() {
+  m_index.Build(m_argv, true, &m_nameIndex);
+  ResetClaims();
+  m_isIndexed = true;
+}
+
+POPTS_INLINE void Options::ResetClaims() {
+  m_tail = m_argv.cbegin();
+  m_owners.assign(m_argv.size(), ArgOwner());
+  if (m_index.m_terminator != ArgvIndex::npos) {
+    m_owners[m_index.m_terminator].m_role = ArgOwner::Role::Terminator;
+  }
+}
+
+POPTS_INLINE void Options::ParseOptions(size_t count) {
+  ResetClaims();
+  for (size_t option = 0; option < count; ++option) {
+    m_options[option]->ParseArguments(m_argv, m_index,
+                                      FindFallback(*m_options[option]));
+    ClaimMatches(option);
+  }
+}
+
+POPTS_INLINE void Options::ReparseAll() {
+  // the old mappings are not referenced once every source is read again
+  m_sourceErrors.clear();
+  m_mappedFiles.clear();
+
+  if (m_hasResponseFiles) {
+    ExpandResponseFiles();
+  }
+
+  m_config = ConfigIndex(m_resource);
+  for (size_t file = 0; file < m_configFiles.size(); ++file) {
+    LoadConfigFile(file);
+  }
+
+  if (m_isSystemEnvironment) {
+    m_environment.Load(SystemEnvironment());
+  }
+
+  if (!m_commands.empty()) {
+    m_commandArgv = m_argv;
+    m_commandIndex.Build(m_commandArgv, false);
+    m_commandCandidates.clear();
+    for (const auto &command : m_commands) {
+      AddCandidates(*command);
+    }
+    SelectSubcommand(true);
+  }
+
+  BuildIndex();
+  m_isDescriptionCached = false;
+  ParseOptions(m_options.size());
+
+  m_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+POPTS_INLINE void Options::ExpandResponseFile(string_view argument,
+                                              argv_t &expanded,
+                                              vector<string> &openFiles) {
+  if (argument.size() < 2 || argument[0] != '@') {
+    expanded.push_back(argument);
+    return;
+  }
+
+  const string path(argument.substr(1));
+
+  std::error_code error;
+  const string canonicalPath =
+      std::filesystem::canonical(path, error).string();
+
+  // kept as it is like GCC and Clang do, e.g. the value of "--mention @bob"
+  MappedFile file;
+  if (error || !file.Open(path.c_str())) {
+    expanded.push_back(argument);
+    return;
+  }
+
+  // the open files are the current nesting, a file inside itself is a cycle
+  if (std::find(openFiles.cbegin(), openFiles.cend(), canonicalPath) !=
+      openFiles.cend()) {
+    m_sourceErrors.emplace_back("response file includes itself: '" + path +
+                                "'");
+    return;
+  }
+
+  openFiles.push_back(canonicalPath);
+  bool isComplete =
+      TokenizeResponseFile(file.data(), file.data() + file.size(),
+                           [this, &expanded, &openFiles](string_view arg) {
+                             ExpandResponseFile(arg, expanded, openFiles);
+                           });
+  openFiles.pop_back();
+
+  if (!isComplete) {
+    m_sourceErrors.emplace_back("unterminated quote in response file '" +
+                                path + "'");
+  }
+
+  m_mappedFiles.push_back(std::move(file));
+}
+
+POPTS_INLINE bool Options::HasDuplicateNames(std::ostream *out) const {
+  if (out) {
+    for (auto name : m_duplicateNames) {
+      (*out) << "Duplicate name: " << name << "\n";
+    }
+  }
+
+  return !m_duplicateNames.empty();
+}
+
+POPTS_INLINE const Option *Options::FindOption(string_view name) const {
+  auto option = m_nameIndex.find(name);
+  return option != m_nameIndex.cend() ? m_options[option->second].get()
+                                      : nullptr;
+}
+
+POPTS_INLINE bool Options::HasErrorMatches(std::ostream *out) const {
+  auto quotedArgument = [this](argv_t::const_iterator it) {
+    if (it == m_argv.cend()) {
+      return "<null>"s;
+    }
+    return "'"s + string(*it) + "'"s;
+  };
+
+  auto commentSeparatedList = [this, quotedArgument](auto *out,
+                                                     const auto &container) {
+    auto from = std::cbegin(container);
+    auto to = std::cend(container);
+
+    if (from == to) {
+      return;
+    }
+
+    (*out) << quotedArgument(*from);
+
+    for (++from; from != to; ++from) {
+      (*out) << ", " << quotedArgument(*from);
+    }
+  };
+
+  bool hasErrors = !m_sourceErrors.empty();
+  if (out) {
+    for (const auto &error : m_sourceErrors) {
+      (*out) << error << "\n";
+    }
+  }
+
+  // options without errors are not looked at
+  for (size_t index = m_registry.NextToCheck(0); index < m_registry.size();
+       index = m_registry.NextToCheck(index + 1)) {
+    const auto &option = m_options[index];
+    option->Resolve();
+
+    // Check for errors
+    if (!option->m_parseErrors.empty()) {
+      hasErrors = true;
+
+      if (!out) {
+        break;
+      }
+      (*out) << "error matches for option '" << option->m_names[0] << "': ";
+      commentSeparatedList(out, option->m_parseErrors);
+      (*out) << "\n";
+    }
+
+    // Only reported if argv did not take precedence
+    if (!option->m_fallbackErrors.empty()) {
+      hasErrors = true;
+      if (!out) {
+        break;
+      }
+
+      (*out) << "error in " << option->m_fallbackSource << " for option '"
+             << option->m_names[0] << "': ";
+      for (auto value = option->m_fallbackErrors.cbegin();
+           value != option->m_fallbackErrors.cend(); ++value) {
+        (*out) << (value == option->m_fallbackErrors.cbegin() ? "'" : ", '")
+               << *value << "'";
+      }
+      (*out) << "\n";
+    }
+
+    // Check if only one is allowed
+    if (option->m_count == Option::Single && option->m_matches.size() > 1) {
+      hasErrors = true;
+      if (!out) {
+        break;
+      }
+
+      (*out) << "multiple matches for single option '" << option->m_names[0]
+             << "'";
+
+      if (!option->m_isFlag) {
+        (*out) << ": ";
+        commentSeparatedList(out, option->m_matches);
+      }
+
+      (*out) << "\n";
+    }
+  }
+
+  // Check the letters of bundles, only the last may take a value
+  for (size_t position : m_index.m_bundles) {
+    if (!out && hasErrors) {
+      break;
+    }
+
+    const string_view bundle = m_argv[position];
+    for (size_t letter = 1; letter < bundle.size(); ++letter) {
+      const string_view name = ArgvIndex::ShortName(bundle[letter]);
+      const Option *option = FindOption(name);
+      if (option && (option->m_isFlag || letter + 1 == bundle.size())) {
+        continue;
+      }
+
+      hasErrors = true;
+      if (!out) {
+        break;
+      }
+      if (option) {
+        (*out) << "option '" << name << "' takes a value, not last in bundle '"
+               << bundle << "'\n";
+      } else {
+        (*out) << "unknown option '" << name << "' in bundle '" << bundle
+               << "'\n";
+      }
+    }
+  }
+
+  // Check if match has been used as a argument value
+  for (size_t pos = 0; pos < m_owners.size() && (out || !hasErrors); ++pos) {
+    if (m_owners[pos].m_isConflict) {
+      hasErrors = true;
+      if (out) {
+        (*out) << "Name consumed as argument before: '" << m_argv[pos]
+               << "'\n";
+      }
+    }
+  }
+
+  return hasErrors;
+}
+
+POPTS_INLINE bool Options::HasConsistentTail(std::ostream *out) const {
+  bool hasHoles = false;
+  bool hasClaimed = false;
+  size_t holeBegin = 0;
+
+  // unclaimed arguments between claimed ones are holes
+  for (size_t pos = 0; pos < m_owners.size(); ++pos) {
+    if (m_owners[pos].m_role == ArgOwner::Role::None) {
+      if (hasClaimed && !holeBegin) {
+        holeBegin = pos;
+      }
+      continue;
+    }
+
+    if (holeBegin) {
+      hasHoles = true;
+
+      if (!out) {
+        break;
+      }
+
+      for (size_t hole = holeBegin; hole < pos; ++hole) {
+        (*out) << "unparsed argument '" << m_argv[hole] << "' before parsed '";
+        (*out) << m_argv[pos] << "'\n";
+      }
+      holeBegin = 0;
+    }
+
+    hasClaimed = true;
+  }
+
+  return !hasHoles;
+}
+
+POPTS_INLINE Options::tail_t Options::Tail() const {
+  // everything after "--" is positional, whatever has been matched before
+  if (m_isIndexed && m_index.m_terminator != ArgvIndex::npos) {
+    return tail_t{std::next(m_argv.cbegin(), m_index.m_terminator + 1),
+                  m_argv.cend()};
+  }
+  return tail_t{m_tail, m_argv.cend()};
+}
+
+POPTS_INLINE const std::pmr::vector<ArgOwner> &Options::Ownership() const {
+  return m_owners;
+}
+
+POPTS_INLINE Fallback Options::FindFallback(const Option &option) {
+  Fallback fallback(m_resource);
+
+  if (!option.m_environmentName.empty()) {
+    if (!m_environment.IsLoaded()) {
+      m_environment.Load(SystemEnvironment());
+      m_isSystemEnvironment = true;
+    }
+    if (auto value = m_environment.Find(option.m_environmentName)) {
+      fallback.m_values.push_back(*value);
+      fallback.m_source.append("environment variable '")
+          .append(option.m_environmentName)
+          .append("'");
+      return fallback;
+    }
+  }
+
+  // the values of the first name that has any
+  for (string_view name : option.m_names) {
+    const size_t dashes = std::min(name.find_first_not_of('-'), name.size());
+    m_config.ForEachValue(name.substr(dashes),
+                          [this, &fallback](string_view value, size_t file) {
+                            if (fallback.m_values.empty()) {
+                              fallback.m_source.append("config file '")
+                                  .append(m_configFiles[file])
+                                  .append("'");
+                            }
+                            fallback.m_values.push_back(value);
+                          });
+    if (!fallback.m_values.empty()) {
+      break;
+    }
+  }
+
+  return fallback;
+}
+
+POPTS_INLINE void Options::ClaimMatches(size_t optionIndex) {
+  const Option &option = *m_options[optionIndex];
+
+  for (auto match : option.m_matches) {
+    const size_t argument = match - m_argv.cbegin();
+    Claim(argument - 1, optionIndex, ArgOwner::Role::Name);
+    if (!option.m_isFlag && match != m_argv.cend() &&
+        m_owners[argument].m_role != ArgOwner::Role::Terminator) {
+      Claim(argument, optionIndex, ArgOwner::Role::Argument);
+    }
+  }
+
+  // a flag given a value claims both, the value is reported as an error
+  if (option.m_isFlag) {
+    for (auto value : option.m_parseErrors) {
+      const size_t argument = value - m_argv.cbegin();
+      Claim(argument - 1, optionIndex, ArgOwner::Role::Name);
+      Claim(argument, optionIndex, ArgOwner::Role::Argument);
+      m_tail = std::max(value + 1, m_tail);
+    }
+  }
+
+  m_registry.Update(optionIndex, option);
+
+  if (option.m_matches.size() > 0) {
+    // a match points past the name. Flags have no argument to skip, nor has
+    // an option whose argument is missing at the end of argv.
+    auto last = option.m_matches.back();
+    if (!option.m_isFlag && last != m_argv.cend()) {
+      ++last;
+    }
+    m_tail = std::max(last, m_tail);
+  }
+}
+
+POPTS_INLINE void Options::Claim(size_t position, size_t option,
+                                 ArgOwner::Role role) {
+  ArgOwner &owner = m_owners[position];
+  if (owner.m_role == ArgOwner::Role::None) {
+    owner.m_option = static_cast<uint32_t>(option);
+    owner.m_role = role;
+  } else if (role != ArgOwner::Role::Name ||
+             owner.m_role != ArgOwner::Role::Name ||
+             !ArgvIndex::IsBundle(m_argv[position])) {
+    // the names in a bundle share its position
+    owner.m_isConflict = true;
+  }
+}
+
+POPTS_INLINE const string &Options::Description() const {
+  if (!m_isDescriptionCached) {
+    m_description.clear();
+    WriteDescription([this](string_view text) { m_description.append(text); });
+    m_isDescriptionCached = true;
+  }
+
+  return m_description;
+}
+
+POPTS_INLINE void Options::Description(std::ostream &out) const {
+  WriteDescription(
+      [&out](string_view text) { out.write(text.data(), text.size()); });
+}
+
+POPTS_INLINE const bool &
+Options::Flag(std::initializer_list<const char *> names,
+              const string &description, const char *environmentName) {
+  auto &option = AddOption(names, false, description, Option::Single, true,
+                           environmentName);
+  return option.m_storage.front();
+}
+
+POPTS_INLINE const deque<bool> &
+Options::Flags(std::initializer_list<const char *> names,
+               const string &description, const char *environmentName) {
+  auto &option = AddOption(names, false, description, Option::Many, true,
+                           environmentName);
+  return option.m_storage;
+}
+
+} // namespace popts
@@ -0,0 +1,4 @@
+// The functions that are not templates, for POPTS_SEPARATE_COMPILATION.
+// Compile this file once and define POPTS_SEPARATE_COMPILATION everywhere.
+#define POPTS_IMPLEMENTATION
+#include "opts.h"
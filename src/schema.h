@@ -0,0 +1,495 @@
+#pragma once
+#ifndef POPTS_SCHEMA_H_INCLUDED
+#define POPTS_SCHEMA_H_INCLUDED
+
+#include "opt.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+///////////////////////////////////////////////////////////////////////////////
+// Compile-time option schema
+//
+// All options are declared up front as one constexpr value. The compiler
+// builds a perfect hash table of all names and every option is stored in a
+// plain member of the parse result, so parsing flags and fixed-size values
+// does not allocate.
+//
+//   constexpr auto schema = popts::MakeSchema(
+//       popts::StaticFlag({"-v", "--verbose"}, "Toggle verbosity"),
+//       popts::StaticOption<int64_t>({"-j", "--jobs"}, 1, "Parallel jobs"),
+//       popts::StaticOptions<string_view, 8>({"-I"}, "Include directory"));
+//
+//   auto opts = schema.Parse(argc, argv);
+//   bool verbose = opts.Get<0>();
+//
+
+namespace popts {
+
+namespace detail {
+
+// Not constexpr on purpose, reaching it during constant evaluation turns an
+// invalid schema into a compile error.
+inline void SchemaError(const char *message) {
+  (void)message;
+  assert(!"invalid schema");
+}
+
+// Writes the parts one after the other, the templates do not need <ostream>.
+POPTS_INLINE void WriteParts(std::ostream &out,
+                             std::initializer_list<string_view> parts);
+
+constexpr uint64_t Hash(string_view name, uint64_t seed) {
+  uint64_t hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+  for (char c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash ^ (hash >> 29);
+}
+
+constexpr size_t NextPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+template <size_t N, size_t... Is>
+constexpr std::array<string_view, N> ToArray(const string_view (&names)[N],
+                                             std::index_sequence<Is...>) {
+  return {{names[Is]...}};
+}
+
+template <typename T> bool StaticFromString(string_view data, T &out) {
+  if constexpr (std::is_same<T, string_view>::value) {
+    out = data;
+    return true;
+  } else {
+    return OptionTraits<T>::FromString(data, out);
+  }
+}
+
+} // namespace detail
+
+// Storage of an option with up to Capacity values.
+template <typename T, size_t Capacity> struct FixedValues {
+  const T *begin() const { return m_values.data(); }
+  const T *end() const { return m_values.data() + m_size; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  const T &operator[](size_t i) const { return m_values[i]; }
+
+  std::array<T, Capacity> m_values{};
+  size_t m_size = 0;
+};
+
+template <typename T, size_t NameCount_, size_t Count_, bool IsFlag_>
+struct SchemaOption {
+  using value_type = T;
+
+  static constexpr size_t NameCount = NameCount_;
+  static constexpr size_t Count = Count_;
+  static constexpr bool IsFlag = IsFlag_;
+
+  // single flags are a bool, multiple flags are counted
+  using storage_type = std::conditional_t<
+      IsFlag, std::conditional_t<Count == Option::Single, bool, size_t>,
+      std::conditional_t<Count == Option::Single, T, FixedValues<T, Count>>>;
+
+  std::array<string_view, NameCount> m_names;
+  T m_defaultArgument;
+  string_view m_description;
+};
+
+template <size_t N>
+constexpr SchemaOption<bool, N, Option::Single, true>
+StaticFlag(const string_view (&names)[N], string_view description) {
+  return {detail::ToArray(names, std::make_index_sequence<N>()), false,
+          description};
+}
+
+template <size_t N>
+constexpr SchemaOption<bool, N, Option::Many, true>
+StaticFlags(const string_view (&names)[N], string_view description) {
+  return {detail::ToArray(names, std::make_index_sequence<N>()), false,
+          description};
+}
+
+template <typename T, size_t N>
+constexpr SchemaOption<T, N, Option::Single, false>
+StaticOption(const string_view (&names)[N], const T &defaultArgument,
+             string_view description) {
+  return {detail::ToArray(names, std::make_index_sequence<N>()),
+          defaultArgument, description};
+}
+
+template <typename T, size_t Capacity, size_t N>
+constexpr SchemaOption<T, N, Capacity, false>
+StaticOptions(const string_view (&names)[N], string_view description) {
+  static_assert(Capacity > 0 && Capacity < Option::Many,
+                "StaticOptions needs a fixed capacity");
+  return {detail::ToArray(names, std::make_index_sequence<N>()), T(),
+          description};
+}
+
+template <typename... Opts> class ParsedOptions;
+
+template <typename... Opts> class Schema {
+public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+  static constexpr size_t OptionCount = sizeof...(Opts);
+  static constexpr size_t NameCount = (Opts::NameCount + ... + 0);
+  // half empty, so that a displacement for every bucket is found quickly
+  static constexpr size_t TableSize = detail::NextPowerOfTwo(2 * NameCount);
+  static constexpr size_t BucketCount = TableSize / 2 + (TableSize == 1);
+
+  constexpr explicit Schema(const Opts &... options);
+
+  // Index of the option with the given name or npos.
+  constexpr size_t Find(string_view name) const;
+
+  ParsedOptions<Opts...> Parse(int argc, const char *const *argv) const;
+
+  std::tuple<Opts...> m_options;
+  std::array<string_view, OptionCount> m_primaryNames{};
+
+  // hash and displace: the bucket of a name selects the seed of its slot
+  std::array<uint64_t, BucketCount> m_seeds{};
+  std::array<string_view, TableSize> m_slotNames{};
+  std::array<size_t, TableSize> m_slotOptions{};
+};
+
+template <typename... Opts>
+constexpr Schema<Opts...> MakeSchema(const Opts &... options) {
+  return Schema<Opts...>(options...);
+}
+
+template <typename... Opts> class ParsedOptions {
+  struct tail_t {
+    const char *const *cbegin() const { return m_cbegin; }
+    const char *const *cend() const { return m_cend; }
+    const char *const *m_cbegin;
+    const char *const *m_cend;
+  };
+
+public:
+  enum class Error : uint8_t {
+    MissingArgument,
+    InvalidArgument,
+    MultipleMatches,
+    TooManyArguments
+  };
+
+  struct ErrorMatch {
+    size_t m_position;
+    size_t m_option;
+    Error m_error;
+  };
+
+  // errors beyond this are counted but not recorded
+  static constexpr size_t MaxRecordedErrors = 8;
+
+  template <size_t I> const auto &Get() const { return std::get<I>(m_values); }
+
+  bool HasErrorMatches(std::ostream *out = nullptr) const;
+  tail_t Tail() const;
+
+private:
+  friend class Schema<Opts...>;
+
+  template <size_t... Is>
+  ParsedOptions(const Schema<Opts...> &schema, int argc,
+                const char *const *argv, std::index_sequence<Is...>);
+
+  template <size_t... Is>
+  size_t Consume(size_t option, size_t pos, std::index_sequence<Is...>);
+
+  template <size_t I> size_t Consume(size_t pos);
+
+  void AddError(size_t pos, size_t option, Error error);
+
+  std::tuple<typename Opts::storage_type...> m_values;
+  std::array<bool, sizeof...(Opts)> m_isMatched{};
+  std::array<string_view, sizeof...(Opts)> m_primaryNames;
+  const char *const *m_argv;
+  size_t m_argc;
+  size_t m_tail = 1;
+
+  std::array<ErrorMatch, MaxRecordedErrors> m_errors{};
+  size_t m_errorCount = 0;
+};
+
+template <typename... Opts>
+constexpr Schema<Opts...>::Schema(const Opts &... options)
+    : m_options(options...) {
+  constexpr size_t tableMask = TableSize - 1;
+
+  // flatten all names, remembering their options
+  std::array<string_view, NameCount> names{};
+  std::array<size_t, NameCount> owners{};
+  size_t nameCount = 0;
+  size_t optionIndex = 0;
+
+  auto addNames = [&](const auto &option) {
+    m_primaryNames[optionIndex] = option.m_names[0];
+    for (string_view name : option.m_names) {
+      names[nameCount] = name;
+      owners[nameCount] = optionIndex;
+      ++nameCount;
+    }
+    ++optionIndex;
+  };
+  (addNames(options), ...);
+
+  // group names by bucket
+  std::array<size_t, NameCount> buckets{};
+  std::array<size_t, BucketCount + 1> bucketStart{};
+  for (size_t i = 0; i < NameCount; ++i) {
+    buckets[i] = detail::Hash(names[i], 0) % BucketCount;
+    ++bucketStart[buckets[i] + 1];
+  }
+
+  size_t largestBucket = 0;
+  for (size_t b = 0; b < BucketCount; ++b) {
+    largestBucket = std::max(largestBucket, bucketStart[b + 1]);
+    bucketStart[b + 1] += bucketStart[b];
+  }
+
+  std::array<size_t, NameCount> byBucket{};
+  std::array<size_t, BucketCount> filled{};
+  for (size_t i = 0; i < NameCount; ++i) {
+    byBucket[bucketStart[buckets[i]] + filled[buckets[i]]++] = i;
+  }
+
+  for (size_t slot = 0; slot < TableSize; ++slot) {
+    m_slotOptions[slot] = npos;
+  }
+
+  // place the largest buckets first, they are the hardest to fit
+  for (size_t size = largestBucket; size > 0; --size) {
+    for (size_t b = 0; b < BucketCount; ++b) {
+      const size_t first = bucketStart[b];
+      const size_t last = bucketStart[b + 1];
+      if (last - first != size) {
+        continue;
+      }
+
+      for (size_t i = first; i < last; ++i) {
+        for (size_t j = i + 1; j < last; ++j) {
+          if (names[byBucket[i]] == names[byBucket[j]]) {
+            detail::SchemaError("duplicate option name");
+          }
+        }
+      }
+
+      bool isPlaced = false;
+      for (uint64_t seed = 1; !isPlaced && seed < (1u << 20); ++seed) {
+        isPlaced = true;
+        for (size_t i = first; isPlaced && i < last; ++i) {
+          size_t slot = detail::Hash(names[byBucket[i]], seed) & tableMask;
+          isPlaced = m_slotOptions[slot] == npos;
+
+          for (size_t j = first; isPlaced && j < i; ++j) {
+            isPlaced = slot != (detail::Hash(names[byBucket[j]], seed) &
+                                tableMask);
+          }
+        }
+
+        if (isPlaced) {
+          m_seeds[b] = seed;
+          for (size_t i = first; i < last; ++i) {
+            size_t slot = detail::Hash(names[byBucket[i]], seed) & tableMask;
+            m_slotNames[slot] = names[byBucket[i]];
+            m_slotOptions[slot] = owners[byBucket[i]];
+          }
+        }
+      }
+
+      if (!isPlaced) {
+        detail::SchemaError("no perfect hash for the option names");
+      }
+    }
+  }
+}
+
+template <typename... Opts>
+constexpr size_t Schema<Opts...>::Find(string_view name) const {
+  if (NameCount == 0) {
+    return npos;
+  }
+
+  uint64_t seed = m_seeds[detail::Hash(name, 0) % BucketCount];
+  size_t slot = detail::Hash(name, seed) & (TableSize - 1);
+
+  return (m_slotOptions[slot] != npos && m_slotNames[slot] == name)
+             ? m_slotOptions[slot]
+             : npos;
+}
+
+template <typename... Opts>
+ParsedOptions<Opts...> Schema<Opts...>::Parse(int argc,
+                                              const char *const *argv) const {
+  ParsedOptions<Opts...> parsed(*this, argc, argv,
+                                std::index_sequence_for<Opts...>());
+
+  for (size_t pos = 1; pos < parsed.m_argc; ++pos) {
+    // "--" ends the options like in Options, the tail starts behind it
+    if (string_view(argv[pos]) == "--") {
+      parsed.m_tail = pos + 1;
+      break;
+    }
+
+    size_t option = Find(argv[pos]);
+    if (option == npos) {
+      continue;
+    }
+
+    pos = parsed.Consume(option, pos, std::index_sequence_for<Opts...>());
+    parsed.m_tail = pos + 1;
+  }
+
+  return parsed;
+}
+
+template <typename... Opts>
+template <size_t... Is>
+ParsedOptions<Opts...>::ParsedOptions(const Schema<Opts...> &schema, int argc,
+                                      const char *const *argv,
+                                      std::index_sequence<Is...>)
+    : m_primaryNames(schema.m_primaryNames), m_argv(argv),
+      m_argc(argc > 0 ? argc : 0) {
+  auto setDefault = [](const auto &option, auto &storage) {
+    using option_t = std::decay_t<decltype(option)>;
+    if constexpr (!option_t::IsFlag && option_t::Count == Option::Single) {
+      storage = option.m_defaultArgument;
+    }
+  };
+  (setDefault(std::get<Is>(schema.m_options), std::get<Is>(m_values)), ...);
+}
+
+template <typename... Opts>
+template <size_t... Is>
+size_t ParsedOptions<Opts...>::Consume(size_t option, size_t pos,
+                                       std::index_sequence<Is...>) {
+  (void)((option == Is && ((pos = Consume<Is>(pos)), true)) || ...);
+  return pos;
+}
+
+template <typename... Opts>
+template <size_t I>
+size_t ParsedOptions<Opts...>::Consume(size_t pos) {
+  using option_t = std::tuple_element_t<I, std::tuple<Opts...>>;
+  auto &storage = std::get<I>(m_values);
+
+  const bool isFirstMatch = !m_isMatched[I];
+  m_isMatched[I] = true;
+
+  if constexpr (option_t::IsFlag) {
+    if constexpr (option_t::Count == Option::Single) {
+      if (!isFirstMatch) {
+        AddError(pos, I, Error::MultipleMatches);
+      }
+      storage = true;
+    } else {
+      ++storage;
+    }
+    return pos;
+  } else {
+    // an option right before "--" has no value
+    if (pos + 1 >= m_argc || string_view(m_argv[pos + 1]) == "--") {
+      AddError(pos + 1, I, Error::MissingArgument);
+      return pos;
+    }
+
+    ++pos;
+    typename option_t::value_type value{};
+    if (!detail::StaticFromString(m_argv[pos], value)) {
+      AddError(pos, I, Error::InvalidArgument);
+      return pos;
+    }
+
+    if constexpr (option_t::Count == Option::Single) {
+      // the first occurrence wins, like Options::MakeOption
+      if (isFirstMatch) {
+        storage = value;
+      } else {
+        AddError(pos, I, Error::MultipleMatches);
+      }
+    } else {
+      if (storage.m_size == option_t::Count) {
+        AddError(pos, I, Error::TooManyArguments);
+      } else {
+        storage.m_values[storage.m_size++] = value;
+      }
+    }
+    return pos;
+  }
+}
+
+template <typename... Opts>
+void ParsedOptions<Opts...>::AddError(size_t pos, size_t option, Error error) {
+  if (m_errorCount < MaxRecordedErrors) {
+    m_errors[m_errorCount] = ErrorMatch{pos, option, error};
+  }
+  ++m_errorCount;
+}
+
+template <typename... Opts>
+bool ParsedOptions<Opts...>::HasErrorMatches(std::ostream *out) const {
+  if (!out) {
+    return m_errorCount > 0;
+  }
+
+  const size_t recorded = std::min(m_errorCount, MaxRecordedErrors);
+  for (size_t i = 0; i < recorded; ++i) {
+    const ErrorMatch &match = m_errors[i];
+    const string_view name = m_primaryNames[match.m_option];
+
+    switch (match.m_error) {
+    case Error::MissingArgument:
+      detail::WriteParts(*out,
+                         {"error matches for option '", name, "': <null>\n"});
+      break;
+    case Error::InvalidArgument:
+      detail::WriteParts(*out, {"error matches for option '", name, "': '",
+                                m_argv[match.m_position], "'\n"});
+      break;
+    case Error::MultipleMatches:
+      detail::WriteParts(
+          *out, {"multiple matches for single option '", name, "'\n"});
+      break;
+    case Error::TooManyArguments:
+      detail::WriteParts(*out, {"too many arguments for option '", name,
+                                "': '", m_argv[match.m_position], "'\n"});
+      break;
+    }
+  }
+
+  if (m_errorCount > recorded) {
+    detail::WriteParts(*out, {"... and ",
+                              std::to_string(m_errorCount - recorded),
+                              " more errors\n"});
+  }
+
+  return m_errorCount > 0;
+}
+
+template <typename... Opts>
+typename ParsedOptions<Opts...>::tail_t ParsedOptions<Opts...>::Tail() const {
+  const size_t tail = std::min(m_tail, m_argc);
+  return tail_t{m_argv + tail, m_argv + m_argc};
+}
+
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include "schema.impl.h"
+#endif
+
+#endif
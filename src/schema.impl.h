@@ -0,0 +1,16 @@
+#include <ostream>
+
+namespace popts {
+
+namespace detail {
+
+POPTS_INLINE void WriteParts(std::ostream &out,
+                             std::initializer_list<string_view> parts) {
+  for (string_view part : parts) {
+    out << part;
+  }
+}
+
+} // namespace detail
+
+} // namespace popts
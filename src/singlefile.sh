@@ -1,6 +1,19 @@
 sed -e '/#[[:space:]]*include "opt.h"/{r opt.h' -e 'd}' opts.h > singleheader.h
 sed -i -e '/#[[:space:]]*include "opt.inl.h"/{r opt.inl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "opt.impl.h"/{r opt.impl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "sources.h"/{r sources.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "sources.inl.h"/{r sources.inl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "sources.impl.h"/{r sources.impl.h' -e 'd}' singleheader.h
 sed -i -e '/#[[:space:]]*include "opts.inl.h"/{r opts.inl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "opts.impl.h"/{r opts.impl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "schema.h"/{r schema.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "schema.impl.h"/{r schema.impl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "snapshot.h"/{r snapshot.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "snapshot.inl.h"/{r snapshot.inl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "snapshot.impl.h"/{r snapshot.impl.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "tail.h"/{r tail.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "tail.impl.h"/{r tail.impl.h' -e 'd}' singleheader.h
 sed -i -e '/#[[:space:]]*include "typedefs.h"/{r typedefs.h' -e 'd}' singleheader.h
+sed -i -e '/#[[:space:]]*include "opt.h"/d' singleheader.h
 clang-format -i -style file -fallback-style llvm singleheader.h
 mv singleheader.h ../include/popts.hpp
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef POPTS_SNAPSHOT_H_INCLUDED
+#define POPTS_SNAPSHOT_H_INCLUDED
+
+#include "opt.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace popts {
+
+class Options;
+
+// An immutable copy of all option values at one generation of Options. Any
+// number of threads can read a snapshot while Options parses again.
+class Snapshot {
+public:
+  uint64_t Generation() const { return m_generation; }
+
+  // The copy of value, which is a reference returned by Options for an option
+  // registered before the snapshot was made, e.g. snapshot.Find(port) for
+  // `auto &port = popts.Int(...)`. nullptr for anything else, e.g. a copy of
+  // the value.
+  template <typename T> const T *Find(const T &value) const;
+
+private:
+  friend class Options;
+
+  struct Entry {
+    const void *m_key;
+    std::shared_ptr<const void> m_value;
+  };
+
+  uint64_t m_generation = 0;
+  // sorted by the address of the value the entry was copied from
+  vector<Entry> m_values;
+};
+
+// Publishes snapshots RCU-style: a control thread publishes a new snapshot
+// after Reparse, readers keep using the one they hold until they look again.
+// The current snapshot is an atomic pointer, SnapshotReader reads it without
+// locks and marks the snapshot it uses so that Publish does not free it.
+class SnapshotPublisher {
+public:
+  // Publishes the first snapshot, readers never see none.
+  explicit SnapshotPublisher(const Options &options);
+
+  // Frees the snapshots no reader uses anymore, takes a lock.
+  void Publish(const Options &options);
+
+  // The latest snapshot, takes a lock.
+  std::shared_ptr<const Snapshot> Load() const;
+  // Incremented by every Publish, cheap to poll.
+  uint64_t Published() const;
+
+private:
+  friend class SnapshotReader;
+
+  mutable std::mutex m_mutex;
+  // the owners of the current and the retired snapshots, guarded by m_mutex
+  std::shared_ptr<const Snapshot> m_snapshot;
+  vector<std::shared_ptr<const Snapshot>> m_retired;
+  // the snapshot every reader uses, guarded by m_mutex
+  mutable vector<const std::atomic<const Snapshot *> *> m_hazards;
+
+  std::atomic<const Snapshot *> m_current;
+  std::atomic<uint64_t> m_published{0};
+};
+
+// The view of one thread on a publisher, which has to outlive it. Reading the
+// current snapshot is a load of the publish counter, the snapshot pointer is
+// loaded only after something has been published. Neither takes a lock.
+class SnapshotReader {
+public:
+  explicit SnapshotReader(const SnapshotPublisher &publisher);
+  ~SnapshotReader();
+
+  const Snapshot &Current();
+
+private:
+  const SnapshotPublisher &m_publisher;
+  uint64_t m_published = 0;
+  // the snapshot this reader uses, Publish does not free it
+  std::atomic<const Snapshot *> m_hazard{nullptr};
+};
+
+} // namespace popts
+
+#include "snapshot.inl.h"
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include "snapshot.impl.h"
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+namespace popts {
+
+POPTS_INLINE std::shared_ptr<const Snapshot> Options::MakeSnapshot() const {
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->m_generation = Generation();
+  snapshot->m_values.reserve(m_options.size());
+
+  for (const auto &option : m_options) {
+    option->Resolve();
+    snapshot->m_values.push_back(
+        Snapshot::Entry{option->Value(), option->CopyValue()});
+  }
+
+  std::sort(snapshot->m_values.begin(), snapshot->m_values.end(),
+            [](const Snapshot::Entry &a, const Snapshot::Entry &b) {
+              return std::less<const void *>()(a.m_key, b.m_key);
+            });
+
+  return snapshot;
+}
+
+POPTS_INLINE SnapshotPublisher::SnapshotPublisher(const Options &options)
+    : m_snapshot(options.MakeSnapshot()), m_current(m_snapshot.get()) {}
+
+POPTS_INLINE void SnapshotPublisher::Publish(const Options &options) {
+  auto snapshot = options.MakeSnapshot();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_retired.push_back(std::move(m_snapshot));
+  m_snapshot = std::move(snapshot);
+  m_current.store(m_snapshot.get());
+  m_published.fetch_add(1, std::memory_order_release);
+
+  // a reader that marked a retired snapshot before the store above is seen
+  // here, one that marks it later sees the new snapshot and marks again
+  m_retired.erase(
+      std::remove_if(m_retired.begin(), m_retired.end(),
+                     [this](const std::shared_ptr<const Snapshot> &retired) {
+                       return std::none_of(
+                           m_hazards.cbegin(), m_hazards.cend(),
+                           [&retired](const auto *hazard) {
+                             return hazard->load() == retired.get();
+                           });
+                     }),
+      m_retired.end());
+}
+
+POPTS_INLINE std::shared_ptr<const Snapshot> SnapshotPublisher::Load() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_snapshot;
+}
+
+POPTS_INLINE uint64_t SnapshotPublisher::Published() const {
+  return m_published.load(std::memory_order_acquire);
+}
+
+POPTS_INLINE SnapshotReader::SnapshotReader(const SnapshotPublisher &publisher)
+    : m_publisher(publisher) {
+  // Publish takes the lock as well, the current snapshot stays until marked
+  std::lock_guard<std::mutex> lock(m_publisher.m_mutex);
+  m_published = m_publisher.Published();
+  m_hazard.store(m_publisher.m_current.load());
+  m_publisher.m_hazards.push_back(&m_hazard);
+}
+
+POPTS_INLINE SnapshotReader::~SnapshotReader() {
+  std::lock_guard<std::mutex> lock(m_publisher.m_mutex);
+  auto &hazards = m_publisher.m_hazards;
+  hazards.erase(std::find(hazards.begin(), hazards.end(), &m_hazard));
+}
+
+POPTS_INLINE const Snapshot &SnapshotReader::Current() {
+  // the counter is incremented after the store, a snapshot loaded early is
+  // only loaded once more
+  const uint64_t published = m_publisher.Published();
+  if (published != m_published) {
+    const Snapshot *current = m_publisher.m_current.load();
+    const Snapshot *marked = nullptr;
+    // the snapshot is safe once it is marked and still current, otherwise
+    // Publish might not have seen the mark before freeing it
+    while (current != marked) {
+      m_hazard.store(current);
+      marked = current;
+      current = m_publisher.m_current.load();
+    }
+    m_published = published;
+  }
+  return *m_hazard.load(std::memory_order_relaxed);
+}
+
+} // namespace popts
@@ -0,0 +1,18 @@
+#include <algorithm>
+
+namespace popts {
+
+template <typename T> const T *Snapshot::Find(const T &value) const {
+  auto entry = std::lower_bound(
+      m_values.cbegin(), m_values.cend(), static_cast<const void *>(&value),
+      [](const Entry &entry, const void *key) {
+        return std::less<const void *>()(entry.m_key, key);
+      });
+
+  if (entry == m_values.cend() || entry->m_key != &value) {
+    return nullptr;
+  }
+  return static_cast<const T *>(entry->m_value.get());
+}
+
+} // namespace popts
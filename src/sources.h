@@ -0,0 +1,143 @@
+#pragma once
+#ifndef POPTS_SOURCES_H_INCLUDED
+#define POPTS_SOURCES_H_INCLUDED
+
+#include "opt.h"
+
+namespace popts {
+
+// A whole file mapped into memory. The mapping is private, writing to it
+// modifies the process' copy only, which lets tokenizers unescape in place.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  ~MappedFile();
+
+  bool Open(const char *path);
+  void Close();
+
+  char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+// Splits a response file into arguments. Arguments are separated by
+// whitespace or newlines and may be quoted shell-style with '...' or "...",
+// a backslash escapes the next character outside single quotes.
+//
+// Quotes and escapes are removed in place, emit is called with a view into
+// [first, last) for every argument. Returns false on an unterminated quote.
+template <typename F>
+bool TokenizeResponseFile(char *first, char *last, F &&emit);
+
+// The end of the last complete argument of a response file in [first, last),
+// just past the last separator outside quotes, or first if there is none. A
+// prefix of a file read in pieces can be tokenized up to here.
+POPTS_INLINE char *ResponseFileBoundary(char *first, char *last);
+
+// Splits a config file in a subset of INI and TOML into values:
+//
+//   # comments start with '#' or ';'
+//   key = value
+//   [section]
+//   key = "quoted \"value\"" # basic strings unescape \" \\ \t \n
+//   key = 'literal'
+//   key = [1, 2, "three"]      # one value per element, may span lines
+//
+// Escapes are removed in place, emit is called with views into [first, last)
+// as emit(section, key, value), error with the line of malformed lines.
+template <typename Emit, typename Error>
+void TokenizeConfigFile(char *first, char *last, Emit &&emit, Error &&error);
+
+// The values of all config files by section and key. Keys repeat, a key
+// has the values of all lines in the order of the files.
+class ConfigIndex {
+public:
+  explicit ConfigIndex(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_slots(resource), m_entries(resource) {}
+
+  void Reserve(size_t values);
+  void Add(string_view section, string_view key, string_view value,
+           size_t file);
+
+  // Calls f(value, file) with every value of name, which is "key" or
+  // "section.key" for a key in a section.
+  template <typename F> void ForEachValue(string_view name, F &&f) const;
+
+private:
+  struct Key {
+    string_view m_section;
+    string_view m_key;
+    bool operator==(const Key &other) const {
+      return m_section == other.m_section && m_key == other.m_key;
+    }
+  };
+
+  struct Entry {
+    Key m_key;
+    string_view m_value;
+    uint32_t m_file;
+    uint32_t m_next;
+  };
+
+  // first and last entry of a key, the entries of a key are chained
+  struct Slot {
+    size_t m_hash;
+    uint32_t m_first;
+    uint32_t m_last;
+  };
+
+  static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+  static size_t Hash(const Key &key);
+  size_t FindSlot(const Key &key, size_t hash) const;
+  void Rehash(size_t slotCount);
+
+  // Open addressing with linear probing, at most half full. A config has
+  // millions of keys, nodes of a std::unordered_map would be allocated and
+  // visited one by one.
+  std::pmr::vector<Slot> m_slots;
+  size_t m_keyCount = 0;
+  std::pmr::vector<Entry> m_entries;
+};
+
+// A copy of the environment taken once and indexed by variable name, so that
+// options look their variable up instead of scanning the environment.
+class Environment {
+public:
+  explicit Environment(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_buffer(resource), m_variables(resource) {}
+
+  // envp is a null-terminated array of "NAME=value" like environ, or null
+  // for an empty environment.
+  void Load(const char *const *envp);
+  bool IsLoaded() const { return m_isLoaded; }
+
+  // The value of the variable or nullptr if it is not set.
+  const string_view *Find(string_view name) const;
+
+private:
+  std::pmr::vector<char> m_buffer;
+  std::pmr::unordered_map<string_view, string_view> m_variables;
+  bool m_isLoaded = false;
+};
+
+// The environment of the process.
+POPTS_INLINE const char *const *SystemEnvironment();
+
+} // namespace popts
+
+#include "sources.inl.h"
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include "sources.impl.h"
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+#include <cstdlib>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+namespace popts {
+
+POPTS_INLINE MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {}
+
+POPTS_INLINE MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    Close();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+POPTS_INLINE MappedFile::~MappedFile() { Close(); }
+
+POPTS_INLINE bool MappedFile::Open(const char *path) {
+  Close();
+
+#ifdef _WIN32
+  HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(file, &size)) {
+    ::CloseHandle(file);
+    return false;
+  }
+
+  // an empty file cannot be mapped, but is a valid empty file
+  if (size.QuadPart > 0) {
+    HANDLE mapping =
+        ::CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping) {
+      m_data = static_cast<char *>(
+          ::MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+      ::CloseHandle(mapping);
+    }
+    m_size = m_data ? static_cast<size_t>(size.QuadPart) : 0;
+  }
+
+  ::CloseHandle(file);
+  return m_data || size.QuadPart == 0;
+#else
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // an empty file cannot be mapped, but is a valid empty file
+  bool isOpen = info.st_size == 0;
+  if (info.st_size > 0) {
+    void *data = ::mmap(nullptr, static_cast<size_t>(info.st_size),
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      ::madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+      m_data = static_cast<char *>(data);
+      m_size = static_cast<size_t>(info.st_size);
+      isOpen = true;
+    }
+  }
+
+  ::close(fd);
+  return isOpen;
+#endif
+}
+
+POPTS_INLINE void MappedFile::Close() {
+  if (m_data) {
+#ifdef _WIN32
+    ::UnmapViewOfFile(m_data);
+#else
+    ::munmap(m_data, m_size);
+#endif
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+POPTS_INLINE void ConfigIndex::Reserve(size_t values) {
+  m_entries.reserve(m_entries.size() + values);
+
+  size_t slotCount = 16;
+  while (slotCount < 2 * (m_keyCount + values)) {
+    slotCount *= 2;
+  }
+  if (slotCount > m_slots.size()) {
+    Rehash(slotCount);
+  }
+}
+
+POPTS_INLINE void ConfigIndex::Add(string_view section, string_view key,
+                                   string_view value, size_t file) {
+  if (2 * (m_keyCount + 1) > m_slots.size()) {
+    Rehash(std::max<size_t>(16, 2 * m_slots.size()));
+  }
+
+  const Key entryKey{section, key};
+  const auto entry = static_cast<uint32_t>(m_entries.size());
+  m_entries.push_back(
+      Entry{entryKey, value, static_cast<uint32_t>(file), npos});
+
+  const size_t hash = Hash(entryKey);
+  Slot &slot = m_slots[FindSlot(entryKey, hash)];
+  if (slot.m_first == npos) {
+    slot = Slot{hash, entry, entry};
+    ++m_keyCount;
+  } else {
+    m_entries[slot.m_last].m_next = entry;
+    slot.m_last = entry;
+  }
+}
+
+POPTS_INLINE size_t ConfigIndex::Hash(const Key &key) {
+  const std::hash<string_view> hash;
+  return hash(key.m_section) * 31 + hash(key.m_key);
+}
+
+POPTS_INLINE size_t ConfigIndex::FindSlot(const Key &key, size_t hash) const {
+  const size_t mask = m_slots.size() - 1;
+  size_t slot = hash & mask;
+  while (m_slots[slot].m_first != npos &&
+         (m_slots[slot].m_hash != hash ||
+          !(m_entries[m_slots[slot].m_first].m_key == key))) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+POPTS_INLINE void ConfigIndex::Rehash(size_t slotCount) {
+  std::pmr::vector<Slot> slots(slotCount, Slot{0, npos, npos},
+                               m_slots.get_allocator());
+  m_slots.swap(slots);
+
+  for (const Slot &slot : slots) {
+    if (slot.m_first != npos) {
+      m_slots[FindSlot(m_entries[slot.m_first].m_key, slot.m_hash)] = slot;
+    }
+  }
+}
+
+POPTS_INLINE void Environment::Load(const char *const *envp) {
+  // environ is null after clearenv, that is an empty environment
+  static const char *const empty[] = {nullptr};
+  if (!envp) {
+    envp = empty;
+  }
+
+  size_t bufferSize = 0;
+  for (auto variable = envp; *variable; ++variable) {
+    bufferSize += std::char_traits<char>::length(*variable);
+  }
+
+  m_buffer.assign(bufferSize, '\0');
+  m_variables.clear();
+
+  // one block for all variables, the views stay valid if the process changes
+  // its environment later
+  char *out = m_buffer.data();
+  for (auto variable = envp; *variable; ++variable) {
+    const size_t size = std::char_traits<char>::length(*variable);
+    const string_view copy(out, size);
+    out = std::copy(*variable, *variable + size, out);
+
+    // Windows has variables like "=C:=C:\dir", the name cannot be empty
+    const size_t equals = copy.find('=', 1);
+    if (equals != string_view::npos) {
+      m_variables.try_emplace(copy.substr(0, equals),
+                              copy.substr(equals + 1));
+    }
+  }
+
+  m_isLoaded = true;
+}
+
+POPTS_INLINE const string_view *Environment::Find(string_view name) const {
+  auto variable = m_variables.find(name);
+  return variable != m_variables.cend() ? &variable->second : nullptr;
+}
+
+POPTS_INLINE const char *const *SystemEnvironment() {
+#ifdef _WIN32
+  return _environ;
+#else
+  return environ;
+#endif
+}
+
+POPTS_INLINE char *ResponseFileBoundary(char *first, char *last) {
+  char *boundary = first;
+  char quote = 0;
+
+  for (char *in = first; in != last; ++in) {
+    if (quote) {
+      if (*in == quote) {
+        quote = 0;
+      } else if (quote == '"' && *in == '\\' && std::next(in) != last &&
+                 (in[1] == '"' || in[1] == '\\')) {
+        ++in;
+      }
+    } else if (*in == '\'' || *in == '"') {
+      quote = *in;
+    } else if (*in == '\\') {
+      if (std::next(in) == last) {
+        break;
+      }
+      ++in;
+    } else if (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n') {
+      boundary = std::next(in);
+    }
+  }
+
+  return boundary;
+}
+
+} // namespace popts
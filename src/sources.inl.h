@@ -0,0 +1,276 @@
+namespace popts {
+
+template <typename Emit, typename Error>
+void TokenizeConfigFile(char *first, char *last, Emit &&emit, Error &&error) {
+  auto isBlank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+
+  char *in = first;
+  size_t line = 1;
+  string_view section;
+
+  auto skipBlanks = [&in, last, &isBlank]() {
+    while (in != last && isBlank(*in)) {
+      ++in;
+    }
+  };
+
+  auto skipLine = [&in, last]() {
+    while (in != last && *in != '\n') {
+      ++in;
+    }
+  };
+
+  // arrays may span lines and contain comments
+  auto skipSpace = [&in, last, &line, &skipBlanks, &skipLine]() {
+    for (skipBlanks(); in != last && (*in == '\n' || *in == '#');
+         skipBlanks()) {
+      if (*in == '\n') {
+        ++line;
+        ++in;
+      } else {
+        skipLine();
+      }
+    }
+  };
+
+  auto isEndOfLine = [&in, last]() {
+    return in == last || *in == '\n' || *in == '#';
+  };
+
+  // a quoted or bare value at in, bare elements of arrays end at ',' or ']'
+  auto parseValue = [&in, last, &isBlank, &isEndOfLine](bool isElement,
+                                                        string_view &value) {
+    char *begin = in;
+    if (*in == '"') {
+      // only write when something has been removed, untouched pages of a
+      // private mapping are then never copied
+      char *out = ++begin;
+      for (++in; in != last && *in != '"' && *in != '\n'; ++in, ++out) {
+        char c = *in;
+        if (c == '\\' && std::next(in) != last) {
+          switch (*++in) {
+          case 'n':
+            c = '\n';
+            break;
+          case 't':
+            c = '\t';
+            break;
+          case '"':
+          case '\\':
+            c = *in;
+            break;
+          default:
+            return false;
+          }
+        }
+        if (out != in) {
+          *out = c;
+        }
+      }
+      if (in == last || *in != '"') {
+        return false;
+      }
+      ++in;
+      value = string_view(begin, out - begin);
+      return true;
+    }
+
+    if (*in == '\'') {
+      for (++begin, ++in; in != last && *in != '\'' && *in != '\n';) {
+        ++in;
+      }
+      if (in == last || *in != '\'') {
+        return false;
+      }
+      value = string_view(begin, in - begin);
+      ++in;
+      return true;
+    }
+
+    while (!isEndOfLine() && !(isElement && (*in == ',' || *in == ']'))) {
+      ++in;
+    }
+    char *end = in;
+    while (end != begin && isBlank(end[-1])) {
+      --end;
+    }
+    value = string_view(begin, end - begin);
+    return !value.empty();
+  };
+
+  while (in != last) {
+    skipBlanks();
+    if (in == last) {
+      break;
+    }
+    if (*in == '\n') {
+      ++line;
+      ++in;
+      continue;
+    }
+    if (*in == '#' || *in == ';') {
+      skipLine();
+      continue;
+    }
+
+    const size_t firstLine = line;
+    bool isValid = true;
+
+    if (*in == '[') {
+      ++in;
+      skipBlanks();
+      char *begin = in;
+      while (in != last && *in != ']' && *in != '\n') {
+        ++in;
+      }
+      char *end = in;
+      while (end != begin && isBlank(end[-1])) {
+        --end;
+      }
+
+      isValid = in != last && *in == ']' && end != begin;
+      if (isValid) {
+        section = string_view(begin, end - begin);
+        ++in;
+      }
+    } else {
+      char *begin = in;
+      while (in != last && *in != '=' && *in != '\n' && !isBlank(*in)) {
+        ++in;
+      }
+      const string_view key(begin, in - begin);
+
+      skipBlanks();
+      isValid = !key.empty() && in != last && *in == '=';
+      if (isValid) {
+        ++in;
+        skipBlanks();
+      }
+
+      string_view value;
+      if (isValid && in != last && *in == '[') {
+        ++in;
+        skipSpace();
+        while (isValid && in != last && *in != ']') {
+          isValid = parseValue(true, value);
+          if (isValid) {
+            emit(section, key, value);
+            skipSpace();
+            if (in != last && *in == ',') {
+              ++in;
+              skipSpace();
+            } else {
+              isValid = in != last && *in == ']';
+            }
+          }
+        }
+        isValid = isValid && in != last;
+        if (isValid) {
+          ++in;
+        }
+      } else if (isValid) {
+        isValid = !isEndOfLine() && parseValue(false, value);
+        if (isValid) {
+          emit(section, key, value);
+        }
+      }
+    }
+
+    skipBlanks();
+    if (!isValid || !isEndOfLine()) {
+      error(firstLine);
+    }
+    skipLine();
+  }
+}
+
+template <typename F>
+void ConfigIndex::ForEachValue(string_view name, F &&f) const {
+  if (m_slots.empty()) {
+    return;
+  }
+
+  auto forEach = [this, &f](const Key &key) {
+    const Slot &slot = m_slots[FindSlot(key, Hash(key))];
+    for (uint32_t entry = slot.m_first; entry != npos;
+         entry = m_entries[entry].m_next) {
+      f(m_entries[entry].m_value, m_entries[entry].m_file);
+    }
+  };
+
+  // any dot may separate the section, "a.b.c" is also key "b.c" in "[a]"
+  forEach(Key{string_view(), name});
+  for (size_t dot = name.find('.'); dot != string_view::npos;
+       dot = name.find('.', dot + 1)) {
+    forEach(Key{name.substr(0, dot), name.substr(dot + 1)});
+  }
+}
+
+template <typename F>
+bool TokenizeResponseFile(char *first, char *last, F &&emit) {
+  auto isSpace = [](char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  };
+
+  char *in = first;
+  char *out = first;
+
+  // only write when something has been removed, untouched pages of a private
+  // mapping are then never copied
+  auto put = [&out, &in]() {
+    if (out != in) {
+      *out = *in;
+    }
+    ++out;
+    ++in;
+  };
+
+  while (in != last) {
+    while (in != last && isSpace(*in)) {
+      ++in;
+    }
+    if (in == last) {
+      break;
+    }
+
+    out = in;
+    char *token = out;
+
+    while (in != last && !isSpace(*in)) {
+      if (*in == '\'') {
+        ++in;
+        while (in != last && *in != '\'') {
+          put();
+        }
+        if (in == last) {
+          return false;
+        }
+        ++in;
+      } else if (*in == '"') {
+        ++in;
+        while (in != last && *in != '"') {
+          if (*in == '\\' && std::next(in) != last &&
+              (in[1] == '"' || in[1] == '\\')) {
+            ++in;
+          }
+          put();
+        }
+        if (in == last) {
+          return false;
+        }
+        ++in;
+      } else {
+        if (*in == '\\' && std::next(in) != last) {
+          ++in;
+        }
+        put();
+      }
+    }
+
+    emit(string_view(token, out - token));
+  }
+
+  return true;
+}
+
+} // namespace popts
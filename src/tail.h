@@ -0,0 +1,78 @@
+#pragma once
+#ifndef POPTS_TAIL_H_INCLUDED
+#define POPTS_TAIL_H_INCLUDED
+
+#include "opt.h"
+
+#include <iosfwd>
+
+namespace popts {
+
+class Options;
+
+// Reads the tail of Options in chunks of at most chunkSize arguments, so a
+// long list of positional arguments can be processed while it is read.
+//
+// An argument '-' is replaced by the NUL-separated arguments read from input,
+// like `xargs -0`. With response files, an argument '@path' behind "--" is
+// replaced by the arguments in the file. Both are read through one buffer
+// that only grows for an argument longer than it, arguments read this way
+// are not expanded again.
+//
+// The reader points into argv of options, Reparse invalidates it.
+class TailReader {
+public:
+  using argv_t = vector<string_view>;
+
+  // Reads '-' from standard input.
+  explicit TailReader(const Options &options, size_t chunkSize = 1024);
+  TailReader(const Options &options, size_t chunkSize, std::istream &input);
+  // where std::istream is complete
+  TailReader(TailReader &&other);
+  ~TailReader();
+
+  // The next chunk, empty when the tail is exhausted. The views are valid
+  // until the next call.
+  const argv_t &Next();
+
+  bool HasErrors(std::ostream *out = nullptr) const;
+
+private:
+  static constexpr size_t BufferSize = 64 * 1024;
+
+  void Open(string_view argument);
+  // Reads until the buffer holds at least one complete argument, false at the
+  // end of the stream. Only waits for the stream while the buffer holds none.
+  bool Refill();
+
+  // the tail of options
+  Option::argv_t::const_iterator m_next, m_end;
+  size_t m_chunkSize;
+  bool m_hasResponseFiles;
+
+  std::istream &m_input;
+  // the response file being read
+  std::unique_ptr<std::istream> m_file;
+  std::istream *m_stream = nullptr;
+  bool m_isNulSeparated = false;
+  string m_path;
+
+  vector<char> m_buffer;
+  // bytes [m_consumed, m_filled) are the start of an incomplete argument
+  size_t m_consumed = 0;
+  size_t m_filled = 0;
+  // complete arguments in the buffer not yet handed out
+  argv_t m_pending;
+  size_t m_pendingIndex = 0;
+
+  argv_t m_chunk;
+  vector<string> m_errors;
+};
+
+} // namespace popts
+
+#ifdef POPTS_HAS_IMPLEMENTATION
+#include "tail.impl.h"
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace popts {
+
+POPTS_INLINE TailReader::TailReader(const Options &options, size_t chunkSize)
+    : TailReader(options, chunkSize, std::cin) {}
+
+POPTS_INLINE TailReader::TailReader(const Options &options, size_t chunkSize,
+                                    std::istream &input)
+    : m_next(options.Tail().cbegin()), m_end(options.Tail().cend()),
+      m_chunkSize(std::max<size_t>(chunkSize, 1)),
+      m_hasResponseFiles(options.m_hasResponseFiles), m_input(input) {
+  m_chunk.reserve(m_chunkSize);
+}
+
+POPTS_INLINE TailReader::TailReader(TailReader &&other) = default;
+
+POPTS_INLINE TailReader::~TailReader() = default;
+
+POPTS_INLINE const TailReader::argv_t &TailReader::Next() {
+  m_chunk.clear();
+
+  while (m_chunk.size() < m_chunkSize) {
+    if (m_pendingIndex < m_pending.size()) {
+      const size_t count = std::min(m_chunkSize - m_chunk.size(),
+                                    m_pending.size() - m_pendingIndex);
+      auto first = std::next(m_pending.cbegin(), m_pendingIndex);
+      m_chunk.insert(m_chunk.end(), first, std::next(first, count));
+      m_pendingIndex += count;
+      continue;
+    }
+
+    if (m_stream) {
+      // refilling moves the buffer the chunk may point into
+      if (!m_chunk.empty()) {
+        break;
+      }
+      if (!Refill()) {
+        m_file.reset();
+        m_stream = nullptr;
+      }
+      continue;
+    }
+
+    if (m_next == m_end) {
+      break;
+    }
+
+    const string_view argument = *m_next++;
+    if (argument == "-" ||
+        (m_hasResponseFiles && argument.size() > 1 && argument[0] == '@')) {
+      Open(argument);
+    } else {
+      m_chunk.push_back(argument);
+    }
+  }
+
+  return m_chunk;
+}
+
+POPTS_INLINE bool TailReader::HasErrors(std::ostream *out) const {
+  if (out) {
+    for (const auto &error : m_errors) {
+      (*out) << error << "\n";
+    }
+  }
+
+  return !m_errors.empty();
+}
+
+POPTS_INLINE void TailReader::Open(string_view argument) {
+  m_consumed = 0;
+  m_filled = 0;
+  if (m_buffer.empty()) {
+    m_buffer.resize(BufferSize);
+  }
+
+  if (argument == "-") {
+    m_stream = &m_input;
+    m_isNulSeparated = true;
+    m_path = "standard input";
+    return;
+  }
+
+  m_path = string(argument.substr(1));
+  m_file = std::make_unique<std::ifstream>(m_path, std::ios::binary);
+  if (!*m_file) {
+    m_errors.push_back("cannot read response file '" + m_path + "'");
+    return;
+  }
+
+  m_stream = m_file.get();
+  m_isNulSeparated = false;
+}
+
+POPTS_INLINE bool TailReader::Refill() {
+  m_pending.clear();
+  m_pendingIndex = 0;
+
+  // keep the incomplete argument at the end
+  std::memmove(m_buffer.data(), m_buffer.data() + m_consumed,
+               m_filled - m_consumed);
+  m_filled -= m_consumed;
+  m_consumed = 0;
+
+  while (m_pending.empty()) {
+    // getline needs room for its terminator
+    if (m_buffer.size() - m_filled < 2) {
+      m_buffer.resize(m_buffer.size() * 2);
+    }
+
+    // takes what the stream has without waiting, a pipe or a terminal is only
+    // waited for when nothing is there
+    char *const out = m_buffer.data() + m_filled;
+    const auto space = static_cast<std::streamsize>(m_buffer.size() - m_filled);
+    std::streamsize count = m_stream->readsome(out, space);
+    if (count == 0 && *m_stream) {
+      if (m_isNulSeparated) {
+        // up to and with the next NUL, which getline stores as its terminator
+        m_stream->getline(out, space, '\0');
+        count = m_stream->gcount();
+        if (m_stream->fail() && !m_stream->eof()) {
+          // the buffer is full, the argument continues
+          m_stream->clear();
+        }
+      } else {
+        m_stream->read(out, 1);
+        count = m_stream->gcount();
+        if (count > 0) {
+          count += m_stream->readsome(out + 1, space - 1);
+        }
+      }
+    }
+    m_filled += static_cast<size_t>(count);
+    const bool isEnd = !*m_stream;
+
+    char *first = m_buffer.data();
+    char *last = first + m_filled;
+    char *boundary = last;
+
+    if (m_isNulSeparated) {
+      if (!isEnd) {
+        auto nul = std::find(std::make_reverse_iterator(last),
+                             std::make_reverse_iterator(first), '\0');
+        boundary = nul.base();
+      }
+
+      for (char *arg = first; arg != boundary;) {
+        char *nul = std::find(arg, boundary, '\0');
+        m_pending.emplace_back(arg, nul - arg);
+        arg = nul == boundary ? nul : std::next(nul);
+      }
+    } else {
+      if (!isEnd) {
+        boundary = ResponseFileBoundary(first, last);
+      }
+
+      if (!TokenizeResponseFile(first, boundary, [this](string_view arg) {
+            m_pending.push_back(arg);
+          })) {
+        m_errors.push_back("unterminated quote in response file '" + m_path +
+                           "'");
+      }
+    }
+
+    m_consumed = boundary - first;
+    if (isEnd) {
+      return !m_pending.empty();
+    }
+  }
+
+  return true;
+}
+
+} // namespace popts
@@ -3,8 +3,11 @@
 #include "catch2/catch.hpp"
 
 #include <complex>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Nomenclature
@@ -43,6 +46,15 @@ TEST_CASE("Parse multiple strings", "[parser]") {
   REQUIRE(s1[1] == "fn2"s);
 }
 
+TEST_CASE("Parse multiple strings with several names", "[parser]") {
+  popts::Options popts(vector<string>(
+      {"path/cmd", "--file", "a", "-f", "b", "--file", "c", "-f", "d"}));
+
+  auto s1 = popts.Strings({"-f", "--file"}, "xx");
+
+  REQUIRE(s1 == deque<string>{"a"s, "b"s, "c"s, "d"s});
+}
+
 TEST_CASE("Parse flags", "[parser]") {
   popts::Options popts(vector<string>({"path/cmd", "-f", "-v", "-v", "-v"}));
 
@@ -68,6 +80,55 @@ TEST_CASE("Parse bools", "[parser]") {
   REQUIRE(c == true);
   REQUIRE(d == true);
   REQUIRE(e == true);
+
+  SECTION("Only whole words") {
+    popts::Options other(
+        vector<string>({"path/cmd", "-a", "OFF", "-b", "yess", "-c", "\xC9"}));
+
+    REQUIRE(other.Bool({"-a"}, true, "") == false);
+    other.Bool({"-b"}, false, "");
+    other.Bool({"-c"}, false, "");
+
+    std::stringstream errors;
+    REQUIRE(other.HasErrorMatches(&errors));
+    REQUIRE(errors.str().find("'-b'") != string::npos);
+    REQUIRE(errors.str().find("'-c'") != string::npos);
+  }
+}
+
+TEST_CASE("Parse numbers", "[parser]") {
+  popts::Options popts(vector<string>({"path/cmd", "-i", "-42", "-j", "+7",
+                                       "-d", "1.5e3", "-e", "-0.25", "-u",
+                                       "65535"}));
+
+  auto i = popts.Int({"-i"}, 0, "");
+  auto j = popts.Int({"-j"}, 0, "");
+  auto d = popts.Double({"-d"}, 0, "");
+  auto e = popts.MakeOption<double>({"-e"}, 0, "");
+  auto u = popts.MakeOption<uint16_t>({"-u"}, 0, "");
+
+  REQUIRE(i == -42);
+  REQUIRE(j == 7);
+  REQUIRE(d == 1500.0L);
+  REQUIRE(e == -0.25);
+  REQUIRE(u == 65535);
+  REQUIRE(!popts.HasErrorMatches());
+}
+
+TEST_CASE("Numbers have to be consumed completely", "[errors]") {
+  popts::Options popts(vector<string>({"path/cmd", "-i", "12abc", "-j", " 3",
+                                       "-u", "65536", "-d", "1.5.3"}));
+
+  auto i = popts.Ints({"-i"}, "");
+  auto j = popts.Ints({"-j"}, "");
+  auto u = popts.MakeOptions<uint16_t>({"-u"}, "");
+  auto d = popts.Doubles({"-d"}, "");
+
+  REQUIRE(i.empty());
+  REQUIRE(j.empty());
+  REQUIRE(u.empty());
+  REQUIRE(d.empty());
+  REQUIRE(popts.HasErrorMatches());
 }
 
 TEST_CASE("Parse durations", "[parser]") {
@@ -90,6 +151,38 @@ TEST_CASE("Parse durations", "[parser]") {
   REQUIRE(d == std::chrono::hours(24 * 47));
 }
 
+TEST_CASE("Parse fractional and compound durations", "[parser]") {
+  popts::Options popts(
+      vector<string>({"path/cmd", "-a", "1.5h", "-b", "1h30m", "-c", "250us",
+                      "-d", "3\xC2\xB5s", "-e", "2m30s500ms", "-f", ".5s"}));
+
+  auto a = popts.Duration({"-a"}, std::chrono::seconds(0), "");
+  auto b = popts.Duration({"-b"}, std::chrono::seconds(0), "");
+  auto c = popts.Duration({"-c"}, std::chrono::seconds(0), "");
+  auto d = popts.Duration({"-d"}, std::chrono::seconds(0), "");
+  auto e = popts.Duration({"-e"}, std::chrono::seconds(0), "");
+  auto f = popts.Duration({"-f"}, std::chrono::seconds(0), "");
+
+  REQUIRE(a == std::chrono::minutes(90));
+  REQUIRE(b == std::chrono::minutes(90));
+  REQUIRE(c.count() == Approx(250e-6));
+  REQUIRE(d.count() == Approx(3e-6));
+  REQUIRE(e == std::chrono::milliseconds(150500));
+  REQUIRE(f == std::chrono::milliseconds(500));
+  REQUIRE(!popts.HasErrorMatches());
+}
+
+TEST_CASE("Invalid durations", "[errors]") {
+  for (auto arg : {"5", "h", "5x", "-1s", "1h 30m", "inf s", "5s5"}) {
+    popts::Options popts(vector<string>({"path/cmd", "-d", arg}));
+    auto d = popts.Duration({"-d"}, std::chrono::seconds(1), "");
+
+    CAPTURE(arg);
+    REQUIRE(popts.HasErrorMatches());
+    REQUIRE(d == std::chrono::seconds(1));
+  }
+}
+
 TEST_CASE("Parsing custom types (std::complex)", "[parser]") {
   popts::Options popts(vector<string>({"path/cmd", "-c", "(4,3)"}));
 
@@ -99,6 +192,18 @@ TEST_CASE("Parsing custom types (std::complex)", "[parser]") {
   REQUIRE(c == compl(4, 3));
 }
 
+TEST_CASE("Arguments are referenced, not copied", "[parser]") {
+  char cmd[] = "path/cmd", f[] = "-f", x[] = "x", y[] = "y";
+  char *argv[] = {cmd, f, x, y};
+  popts::Options popts(4, argv);
+
+  auto s = popts.String({"-f"}, "", "");
+
+  REQUIRE(s == "x"s);
+  REQUIRE(popts.Tail().cbegin()->data() == y);
+  REQUIRE(std::next(popts.Tail().cbegin()) == popts.Tail().cend());
+}
+
 TEST_CASE("Duplicate definitions", "[errors]") {
   popts::Options popts(vector<string>({"path/cmd"}));
 
@@ -121,6 +226,28 @@ TEST_CASE("Duplicate definitions", "[errors]") {
   }
 }
 
+TEST_CASE("Duplicate names are reported once", "[errors]") {
+  popts::Options popts(vector<string>({"path/cmd"}));
+
+  popts.Flag({"--foo", "-f"}, "");
+  const auto &bar = popts.Flag({"--bar"}, "");
+
+  REQUIRE(popts.FindOption("-f") != nullptr);
+  REQUIRE(popts.FindOption("-f") == popts.FindOption("--foo"));
+  REQUIRE(popts.FindOption("--bar") != popts.FindOption("--foo"));
+  REQUIRE(popts.FindOption("-x") == nullptr);
+  REQUIRE(!bar);
+
+#if defined(NDEBUG) || defined(_NDEBUG)
+  popts.Flag({"-f", "-g"}, "");
+  popts.Flag({"-f", "--bar"}, "");
+
+  std::stringstream out;
+  REQUIRE(popts.HasDuplicateNames(&out));
+  REQUIRE(out.str() == "Duplicate name: -f\nDuplicate name: --bar\n");
+#endif
+}
+
 TEST_CASE("Duplicate matches", "[errors]") {
   popts::Options popts(
       vector<string>({"path/cmd", "-f", "-f", "-o", "x", "-o", "y", "-u"}));
@@ -128,6 +255,7 @@ TEST_CASE("Duplicate matches", "[errors]") {
   SECTION("Flags") {
     auto flag = popts.Flag({"--foo", "-f"}, "");
     REQUIRE(popts.HasErrorMatches());
+    REQUIRE(flag == true);
   }
 
   SECTION("Options") {
@@ -150,9 +278,1067 @@ TEST_CASE("Holes in the tail", "[errors]") {
   REQUIRE(!popts.HasConsistentTail());
 }
 
+TEST_CASE("Tail after flags", "[parser]") {
+  // a flag has no argument, the tail starts right after it
+  popts::Options popts(vector<string>({"path/cmd", "-f", "x", "y"}));
+  popts.Flag({"-f"}, "");
+  REQUIRE(vector<string_view>(popts.Tail().cbegin(), popts.Tail().cend()) ==
+          vector<string_view>{"x", "y"});
+
+  // an option without its argument ends argv, the tail is empty
+  popts::Options missing(vector<string>({"path/cmd", "-f", "-n"}));
+  missing.Flag({"-f"}, "");
+  missing.Int({"-n"}, 0, "");
+  REQUIRE(missing.Tail().cbegin() == missing.Tail().cend());
+  REQUIRE(missing.HasErrorMatches());
+}
+
+TEST_CASE("Holes are reported", "[errors]") {
+  popts::Options popts(
+      vector<string>({"path/cmd", "x", "-f", "y", "z", "-g", "v", "w"}));
+  popts.Flag({"-f"}, "");
+  popts.String({"-g"}, "", "");
+
+  std::stringstream out;
+  REQUIRE(!popts.HasConsistentTail(&out));
+  REQUIRE(out.str() == "unparsed argument 'y' before parsed '-g'\n"
+                       "unparsed argument 'z' before parsed '-g'\n");
+  REQUIRE(*popts.Tail().cbegin() == "w");
+}
+
+TEST_CASE("Ownership of arguments", "[errors]") {
+  using Role = popts::ArgOwner::Role;
+
+  popts::Options popts(vector<string>({"path/cmd", "-f", "-g", "x", "y"}));
+  popts.String({"-f"}, "", "");
+  popts.String({"-g"}, "", "");
+
+  const auto &owners = popts.Ownership();
+  REQUIRE(owners.size() == 5);
+  REQUIRE(owners[0].m_role == Role::None);
+  REQUIRE(owners[1].m_role == Role::Name);
+  REQUIRE(owners[1].m_option == 0);
+  REQUIRE(owners[2].m_role == Role::Argument);
+  REQUIRE(owners[2].m_option == 0);
+  REQUIRE(owners[2].m_isConflict);
+  REQUIRE(owners[3].m_role == Role::Argument);
+  REQUIRE(owners[3].m_option == 1);
+  REQUIRE(!owners[3].m_isConflict);
+  REQUIRE(owners[4].m_role == Role::None);
+
+  std::stringstream out;
+  REQUIRE(popts.HasErrorMatches(&out));
+  REQUIRE(out.str() == "Name consumed as argument before: '-g'\n");
+}
+
 TEST_CASE("Name consumed as argument", "[errors]") {
   popts::Options popts(vector<string>({"pathcmd", "-f", "-g", "x"}));
   popts.String({"-f"}, "", "");
   popts.String({"-g"}, "", "");
   REQUIRE(popts.HasErrorMatches());
 }
+
+TEST_CASE("Compile-time schema", "[schema]") {
+  static constexpr auto schema = popts::MakeSchema(
+      popts::StaticFlag({"-v", "--verbose"}, "verbosity"),
+      popts::StaticFlags({"-q"}, "quietness"),
+      popts::StaticOption<int64_t>({"-j", "--jobs"}, 1, "jobs"),
+      popts::StaticOption<popts::duration_t>({"-t"}, std::chrono::seconds(5),
+                                             "timeout"),
+      popts::StaticOptions<string_view, 2>({"-I"}, "include"));
+
+  static_assert(schema.Find("--verbose") == 0, "");
+  static_assert(schema.Find("-q") == 1, "");
+  static_assert(schema.Find("--jobs") == 2, "");
+  static_assert(schema.Find("-I") == 4, "");
+  static_assert(schema.Find("-x") == schema.npos, "");
+
+  SECTION("Values") {
+    const char *argv[] = {"path/cmd", "-q", "--verbose", "-I", "a", "-q",
+                          "-j",       "4",  "-I",        "b", "x"};
+    auto opts = schema.Parse(11, argv);
+
+    REQUIRE(opts.Get<0>() == true);
+    REQUIRE(opts.Get<1>() == 2);
+    REQUIRE(opts.Get<2>() == 4);
+    REQUIRE(opts.Get<3>() == std::chrono::seconds(5));
+    REQUIRE(opts.Get<4>().size() == 2);
+    REQUIRE(opts.Get<4>()[0] == "a"sv);
+    REQUIRE(opts.Get<4>()[1] == "b"sv);
+    REQUIRE(!opts.HasErrorMatches());
+    REQUIRE(opts.Tail().cbegin() == argv + 10);
+  }
+
+  SECTION("Errors") {
+    const char *argv[] = {"path/cmd", "-v", "-v", "-I", "a", "-I",
+                          "b",        "-I", "c",  "-j", "x", "-t"};
+    auto opts = schema.Parse(12, argv);
+
+    REQUIRE(opts.Get<0>() == true);
+    REQUIRE(opts.Get<2>() == 1);
+    REQUIRE(opts.Get<4>().size() == 2);
+    REQUIRE(opts.HasErrorMatches());
+
+    std::stringstream errors;
+    opts.HasErrorMatches(&errors);
+    REQUIRE(errors.str() ==
+            "multiple matches for single option '-v'\n"
+            "too many arguments for option '-I': 'c'\n"
+            "error matches for option '-j': 'x'\n"
+            "error matches for option '-t': <null>\n");
+  }
+
+  SECTION("Terminator") {
+    const char *argv[] = {"path/cmd", "-j", "--", "-v", "x"};
+    auto opts = schema.Parse(5, argv);
+
+    REQUIRE(opts.Get<0>() == false);
+    REQUIRE(opts.Get<2>() == 1);
+    REQUIRE(opts.HasErrorMatches());
+    REQUIRE(opts.Tail().cbegin() == argv + 3);
+  }
+}
+
+TEST_CASE("Response files", "[parser]") {
+  namespace fs = std::filesystem;
+  const fs::path dir = fs::temp_directory_path() / "popts_response_files";
+  fs::create_directories(dir);
+
+  auto write = [&dir](const char *name, const string &content) {
+    std::ofstream(dir / name, std::ios::binary) << content;
+    return "@"s + (dir / name).string();
+  };
+
+  SECTION("Quoting and nesting") {
+    const auto inner = write("inner.rsp", "-v\n-v\n");
+    const auto outer = write(
+        "outer.rsp", "-f 'a b'\n  -g \"c \\\"d\\\"\" " + inner + " e\\ f\n");
+
+    popts::Options popts(vector<string>({"path/cmd", outer, "tail"}));
+    popts.WithResponseFiles();
+
+    auto f = popts.String({"-f"}, "", "");
+    auto g = popts.String({"-g"}, "", "");
+    auto v = popts.Flags({"-v"}, "");
+
+    REQUIRE(f == "a b"s);
+    REQUIRE(g == "c \"d\""s);
+    REQUIRE(v.size() == 2);
+    REQUIRE(vector<string_view>(popts.Tail().cbegin(), popts.Tail().cend()) ==
+            vector<string_view>{"e f", "tail"});
+    REQUIRE(!popts.HasErrorMatches());
+  }
+
+  SECTION("Cycles and missing files") {
+    const auto second = "@"s + (dir / "second.rsp").string();
+    const auto first = write("first.rsp", "-v " + second);
+    write("second.rsp", "-v " + first);
+
+    popts::Options popts(vector<string>(
+        {"path/cmd", first, "@" + (dir / "missing.rsp").string()}));
+    popts.WithResponseFiles();
+
+    auto v = popts.Flags({"-v"}, "");
+
+    REQUIRE(v.size() == 2);
+    REQUIRE(popts.HasErrorMatches());
+  }
+
+  SECTION("Unreadable files are arguments") {
+    const auto missing = "@" + (dir / "bob").string();
+    popts::Options popts(
+        vector<string>({"path/cmd", "--mention", missing, "x"}));
+    popts.WithResponseFiles();
+
+    auto &mention = popts.String({"--mention"}, "", "");
+
+    REQUIRE(mention == missing);
+    REQUIRE(vector<string_view>(popts.Tail().cbegin(), popts.Tail().cend()) ==
+            vector<string_view>{"x"});
+    REQUIRE(!popts.HasErrorMatches());
+  }
+
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Description", "[description]") {
+  popts::Options popts(vector<string>({"path/x1"}));
+
+  popts.Flag({"-h", "--help"}, "Show this help");
+  popts.String({"-i", "--infile"}, "--", "Specify input file");
+  popts.Ints({"-n"}, "Numbers");
+
+  const string expected = "Usage 'x1' [options]\n"
+                          "-h, --help            Show this help\n"
+                          "-i, --infile [=--]    Specify input file\n"
+                          "-n (...)              Numbers\n";
+
+  REQUIRE(popts.Description() == expected);
+  REQUIRE(&popts.Description() == &popts.Description());
+
+  std::stringstream out;
+  popts.Description(out);
+  REQUIRE(out.str() == expected);
+
+  popts.Flag({"-v"}, "Toggle verbosity");
+  REQUIRE(popts.Description() ==
+          expected + "-v                    Toggle verbosity\n");
+}
+
+TEST_CASE("SmallVector storage", "[storage]") {
+  SECTION("inline and heap") {
+    popts::SmallVector<string, 2> values;
+    values.push_back("a");
+    values.push_back("b");
+    REQUIRE(values.capacity() == 2);
+
+    // growing from an element of itself
+    values.push_back(values.front());
+    REQUIRE(values.capacity() == 4);
+    REQUIRE(values.size() == 3);
+    REQUIRE(values[2] == "a");
+
+    auto copy = values;
+    auto moved = std::move(values);
+    REQUIRE(values.empty());
+    REQUIRE(std::equal(copy.cbegin(), copy.cend(), moved.cbegin(),
+                       moved.cend()));
+  }
+
+  SECTION("as option storage") {
+    popts::Options popts(
+        vector<string>({"path/cmd", "-f", "a", "-f", "b", "-f", "c", "-f",
+                        "d", "-f", "e", "-n", "1"}));
+
+    const auto &files =
+        popts.MakeOptions<string, popts::SmallVector<string>>({"-f"}, "");
+    const auto &numbers =
+        popts.MakeOptions<int, popts::SmallVector<int>>({"-n"}, "");
+
+    REQUIRE(files.size() == 5);
+    REQUIRE(files.back() == "e");
+    REQUIRE(&files[4] == &files[0] + 4);
+    REQUIRE(numbers.size() == 1);
+    REQUIRE(numbers.front() == 1);
+  }
+}
+
+TEST_CASE("Environment variables", "[environment]") {
+  const char *envp[] = {"APP_FILE=env.txt", "APP_N=5",   "APP_V=1",
+                        "APP_BAD=abc",      "APP_LIST=x", nullptr};
+
+  popts::Options popts(vector<string>({"path/cmd", "-f", "arg.txt"}));
+  popts.WithEnvironment(envp);
+
+  auto &f = popts.String({"-f"}, "", "", "APP_FILE");
+  auto &n = popts.Int({"-n"}, 0, "", "APP_N");
+  auto &v = popts.Flag({"-v"}, "", "APP_V");
+  auto &m = popts.Int({"-m"}, 7, "", "APP_MISSING");
+  auto &l = popts.Strings({"-l"}, "", "APP_LIST");
+
+  REQUIRE(f == "arg.txt");
+  REQUIRE(n == 5);
+  REQUIRE(v);
+  REQUIRE(m == 7);
+  REQUIRE(l == deque<string>{"x"});
+  REQUIRE(!popts.HasErrorMatches());
+
+  SECTION("Errors name the variable") {
+    popts.Int({"-b"}, 0, "", "APP_BAD");
+
+    std::stringstream out;
+    REQUIRE(popts.HasErrorMatches(&out));
+    REQUIRE(out.str() ==
+            "error in environment variable 'APP_BAD' for option '-b': 'abc'\n");
+  }
+
+  SECTION("argv takes precedence over errors") {
+    popts::Options other(vector<string>({"path/cmd", "-b", "3"}));
+    other.WithEnvironment(envp);
+
+    REQUIRE(other.Int({"-b"}, 0, "", "APP_BAD") == 3);
+    REQUIRE(!other.HasErrorMatches());
+  }
+
+  SECTION("No environment") {
+    popts::Options other(vector<string>({"path/cmd"}));
+    other.WithEnvironment(nullptr);
+
+    REQUIRE(other.Int({"-n"}, 4, "", "APP_N") == 4);
+    REQUIRE(!other.HasErrorMatches());
+  }
+}
+
+TEST_CASE("Config files", "[parser]") {
+  namespace fs = std::filesystem;
+  const fs::path dir = fs::temp_directory_path() / "popts_config_files";
+  fs::create_directories(dir);
+
+  auto write = [&dir](const char *name, const string &content) {
+    std::ofstream(dir / name, std::ios::binary) << content;
+    return (dir / name).string();
+  };
+
+  const string config = write("app.toml", "# generated\n"
+                                          "; ini comment\n"
+                                          "name = \"a \\\"quoted\\\" name\"\n"
+                                          "port = 80 # inline comment\n"
+                                          "verbose = true\n"
+                                          "include = ['x', y,\n"
+                                          "  \"z\", # comment\n"
+                                          "]\n"
+                                          "\n"
+                                          "[server]\n"
+                                          "timeout = 2s\n"
+                                          "n = 1\n"
+                                          "n = 2\n");
+
+  SECTION("Values and precedence") {
+    const char *envp[] = {"APP_PORT=90", nullptr};
+    popts::Options popts(vector<string>({"path/cmd", "--name", "argv"}));
+    popts.WithEnvironment(envp).WithConfigFile(config.c_str());
+
+    auto &name = popts.String({"--name"}, "", "");
+    auto &port = popts.Int({"-p", "--port"}, 0, "", "APP_PORT");
+    auto &verbose = popts.Flag({"-v", "--verbose"}, "");
+    auto &include = popts.Strings({"-I", "--include"}, "");
+    auto &timeout = popts.Duration({"--server.timeout"}, 0s, "");
+    auto &n = popts.Ints({"--server.n"}, "");
+    auto &missing = popts.Int({"--missing"}, 3, "");
+
+    REQUIRE(name == "argv");
+    REQUIRE(port == 90);
+    REQUIRE(verbose);
+    REQUIRE(include == deque<string>{"x", "y", "z"});
+    REQUIRE(timeout == 2s);
+    REQUIRE(n == deque<int64_t>{1, 2});
+    REQUIRE(missing == 3);
+    REQUIRE(!popts.HasErrorMatches());
+  }
+
+  SECTION("Escapes") {
+    popts::Options popts(vector<string>({"path/cmd"}));
+    popts.WithConfigFile(config.c_str());
+    REQUIRE(popts.String({"--name"}, "", "") == "a \"quoted\" name");
+  }
+
+  SECTION("Errors") {
+    const string broken = write("broken.ini", "port = x\n"
+                                              "[server\n"
+                                              "key value\n"
+                                              "ok = 1\n");
+
+    const string missing = (dir / "missing.ini").string();
+
+    popts::Options popts(vector<string>({"path/cmd"}));
+    popts.WithConfigFile(broken.c_str()).WithConfigFile(missing.c_str());
+    popts.Int({"--port"}, 0, "");
+    popts.Int({"--ok"}, 0, "");
+
+    const string expected =
+        "malformed line 2 in config file '" + broken + "'\n" +
+        "malformed line 3 in config file '" + broken + "'\n" +
+        "cannot read config file '" + missing + "'\n" +
+        "error in config file '" + broken + "' for option '--port': 'x'\n";
+
+    std::stringstream out;
+    REQUIRE(popts.HasErrorMatches(&out));
+    REQUIRE(out.str() == expected);
+  }
+
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Reparse", "[reparse]") {
+  popts::Options popts(vector<string>({"path/cmd", "-n", "1", "-f", "a"}));
+
+  auto &n = popts.Int({"-n"}, 0, "");
+  auto &v = popts.Flag({"-v"}, "");
+  auto &f = popts.Strings({"-f"}, "");
+  const int64_t *address = &n;
+
+  REQUIRE(popts.Generation() == 0);
+
+  popts.Reparse(vector<string>({"path/cmd", "-v", "-f", "b", "-f", "c", "t"}));
+
+  REQUIRE(popts.Generation() == 1);
+  REQUIRE(&n == address);
+  REQUIRE(n == 0);
+  REQUIRE(v);
+  REQUIRE(f == deque<string>{"b", "c"});
+  REQUIRE(*popts.Tail().cbegin() == "t");
+  REQUIRE(popts.HasConsistentTail());
+
+  const char *argv[] = {"path/cmd", "-n", "x"};
+  popts.Reparse(3, const_cast<char **>(argv));
+
+  REQUIRE(popts.Generation() == 2);
+  REQUIRE(n == 0);
+  REQUIRE(!v);
+  REQUIRE(f.empty());
+  REQUIRE(popts.HasErrorMatches());
+
+  // moving keeps the references and the generation
+  popts::Options moved(std::move(popts));
+  REQUIRE(moved.Generation() == 2);
+
+  moved.Reparse(vector<string>({"path/cmd", "-n", "3", "-f", "d"}));
+  REQUIRE(moved.Generation() == 3);
+  REQUIRE(n == 3);
+  REQUIRE(f == deque<string>{"d"});
+}
+
+TEST_CASE("Snapshots", "[reparse]") {
+  popts::Options popts(vector<string>({"path/cmd", "-n", "1", "-f", "a"}));
+
+  auto &n = popts.Int({"-n"}, 0, "");
+  auto &f = popts.Strings({"-f"}, "");
+
+  popts::SnapshotPublisher publisher(popts);
+  popts::SnapshotReader reader(publisher);
+
+  auto first = publisher.Load();
+  REQUIRE(*first->Find(n) == 1);
+  REQUIRE(*first->Find(f) == deque<string>{"a"});
+  REQUIRE(first->Find(n) != &n);
+
+  // a copy of a value is not an option
+  const int64_t copy = n;
+  REQUIRE(first->Find(copy) == nullptr);
+
+  popts.Reparse(vector<string>({"path/cmd", "-n", "2"}));
+  REQUIRE(*reader.Current().Find(n) == 1);
+
+  publisher.Publish(popts);
+  REQUIRE(reader.Current().Generation() == 1);
+  REQUIRE(*reader.Current().Find(n) == 2);
+  REQUIRE(reader.Current().Find(f)->empty());
+
+  // readers holding the old snapshot still see the old values
+  REQUIRE(*first->Find(n) == 1);
+  REQUIRE(first->Generation() == 0);
+
+  // a retired snapshot is freed by the first Publish after its last reader
+  // moved on
+  std::weak_ptr<const popts::Snapshot> second = publisher.Load();
+  publisher.Publish(popts);
+  REQUIRE(!second.expired());
+  REQUIRE(reader.Current().Generation() == 1);
+  publisher.Publish(popts);
+  REQUIRE(second.expired());
+}
+
+// counts its conversions, for lazy options
+struct Counted {
+  static inline int s_conversions = 0;
+  string m_value;
+};
+
+namespace popts {
+template <>
+bool OptionTraits<Counted>::FromString(string_view data, Counted &out) {
+  ++Counted::s_conversions;
+  out.m_value = string(data);
+  return !data.empty();
+}
+
+template <> string OptionTraits<Counted>::ToString(const Counted &data) {
+  return data.m_value;
+}
+} // namespace popts
+
+TEST_CASE("Lazy options", "[lazy]") {
+  Counted::s_conversions = 0;
+
+  popts::Options popts(
+      vector<string>({"path/cmd", "-c", "a", "-l", "b", "-l", "c", "-n", "x"}));
+
+  auto c = popts.MakeLazyOption<Counted>({"-c"}, Counted{"default"}, "");
+  auto l = popts.MakeLazyOptions<Counted>({"-l"}, "");
+  auto d = popts.MakeLazyOption<Counted>({"-d"}, Counted{"default"}, "");
+
+  REQUIRE(Counted::s_conversions == 0);
+  REQUIRE(popts.HasConsistentTail());
+
+  REQUIRE(c->m_value == "a");
+  REQUIRE((*c).m_value == "a");
+  REQUIRE(Counted::s_conversions == 1);
+
+  REQUIRE(l->size() == 2);
+  REQUIRE(l->back().m_value == "c");
+  REQUIRE(d->m_value == "default");
+  REQUIRE(Counted::s_conversions == 3);
+
+  auto n = popts.MakeLazyOption<int64_t>({"-n"}, 0, "");
+  REQUIRE(popts.HasErrorMatches());
+  REQUIRE(*n == 0);
+}
+
+TEST_CASE("Subcommands", "[subcommands]") {
+  popts::Options popts(vector<string>(
+      {"path/tool", "-v", "run", "-v", "-n", "2", "build", "file"}));
+
+  auto &build = popts.Subcommand("build", "Build the project");
+  auto &run = popts.Subcommand("run", "Run the project");
+  auto &verbose = popts.Flag({"-v"}, "Verbose");
+
+  auto &buildVerbose = build.Flag({"-v"}, "Verbose build");
+  auto &runVerbose = run.Flag({"-v"}, "Verbose run");
+  auto &n = run.Int({"-n"}, 1, "Count");
+
+  REQUIRE(popts.SelectedSubcommand() == &run);
+  REQUIRE(verbose);
+  REQUIRE(runVerbose);
+  REQUIRE(!buildVerbose);
+  REQUIRE(n == 2);
+
+  REQUIRE(popts.Tail().cbegin() == popts.Tail().cend());
+  REQUIRE(vector<string_view>(run.Tail().cbegin(), run.Tail().cend()) ==
+          vector<string_view>{"build", "file"});
+  REQUIRE(!popts.HasErrorMatches());
+  REQUIRE(!run.HasErrorMatches());
+
+  REQUIRE(popts.Description() == "Usage 'tool' [options] command ...\n"
+                                 "-v       Verbose\n"
+                                 "\n"
+                                 "Commands\n"
+                                 "build    Build the project\n"
+                                 "run      Run the project\n");
+  REQUIRE(run.Description() == "Usage 'tool run' [options]\n"
+                               "-v         Verbose run\n"
+                               "-n [=1]    Count\n");
+
+  popts.Reparse(vector<string>({"path/tool", "build", "-v"}));
+  REQUIRE(popts.SelectedSubcommand() == &build);
+  REQUIRE(!verbose);
+  REQUIRE(buildVerbose);
+  REQUIRE(!runVerbose);
+  REQUIRE(n == 1);
+
+  SECTION("Moving") {
+    popts::Options moved(std::move(popts));
+    REQUIRE(moved.SelectedSubcommand() == &build);
+    REQUIRE(build.Description().rfind("Usage 'tool build'", 0) == 0);
+  }
+
+  SECTION("Values of options are not commands") {
+    popts::Options other(vector<string>(
+        {"path/tool", "-v", "--name", "build", "build", "-j", "2"}));
+    auto &otherBuild = other.Subcommand("build", "");
+    auto &otherVerbose = other.Flag({"-v"}, "");
+    auto &name = other.String({"--name"}, "", "");
+    auto &jobs = otherBuild.Int({"-j"}, 1, "");
+
+    REQUIRE(other.SelectedSubcommand() == &otherBuild);
+    REQUIRE(otherVerbose);
+    REQUIRE(name == "build");
+    REQUIRE(jobs == 2);
+    REQUIRE(!other.HasErrorMatches());
+    REQUIRE(other.HasConsistentTail());
+  }
+
+  SECTION("Options change which name is a value") {
+    popts::Options other(vector<string>(
+        {"path/tool", "--a", "--b", "build", "build", "-n", "1"}));
+    other.WithBundles();
+    auto &otherBuild = other.Subcommand("build", "");
+    auto &jobs = otherBuild.Int({"-n"}, 0, "");
+
+    // "build" after "--b" is its value, until "--b" is the value of "--a"
+    auto &b = other.String({"--b"}, "", "");
+    REQUIRE(b == "build");
+    REQUIRE(jobs == 1);
+    REQUIRE(otherBuild.Ownership().size() == 3);
+    auto &a = other.String({"--a"}, "", "");
+    REQUIRE(a == "--b");
+    REQUIRE(b.empty());
+    REQUIRE(other.SelectedSubcommand() == &otherBuild);
+    // the cut moved to the first "build"
+    REQUIRE(otherBuild.Ownership().size() == 4);
+
+    // a letter ends bundles anywhere
+    popts::Options bundles(
+        vector<string>({"path/tool", "-vn", "build", "build", "-n", "1"}));
+    bundles.WithBundles();
+    auto &bundlesBuild = bundles.Subcommand("build", "");
+    bundles.Flag({"-v"}, "");
+    REQUIRE(bundlesBuild.Tail().cbegin() != bundlesBuild.Tail().cend());
+    auto &n = bundles.String({"-n"}, "", "");
+    REQUIRE(n == "build");
+    REQUIRE(bundlesBuild.Int({"-n"}, 0, "") == 1);
+  }
+}
+
+TEST_CASE("Bundles and inline values", "[parser]") {
+  popts::Options popts(vector<string>({"path/cmd", "-vvv", "-ab", "--out=file",
+                                       "--eq==", "-n", "5", "tail"}));
+  popts.WithBundles();
+
+  auto &v = popts.Flags({"-v"}, "");
+  auto &a = popts.Flag({"-a"}, "");
+  auto &b = popts.Flags({"-b", "--bee"}, "");
+  auto &out = popts.String({"--out"}, "", "");
+  auto &eq = popts.String({"--eq"}, "", "");
+  auto &n = popts.Int({"-n"}, 0, "");
+
+  REQUIRE(v.size() == 3);
+  REQUIRE(a);
+  REQUIRE(b.size() == 1);
+  REQUIRE(out == "file");
+  REQUIRE(eq == "=");
+  REQUIRE(n == 5);
+  REQUIRE(!popts.HasErrorMatches());
+  REQUIRE(popts.HasConsistentTail());
+  REQUIRE(*popts.Tail().cbegin() == "tail");
+
+  SECTION("Unknown flags in bundles") {
+    popts::Options other(vector<string>({"path/cmd", "-vx"}));
+    other.WithBundles();
+    auto &flag = other.Flag({"-v"}, "");
+
+    std::stringstream errors;
+    REQUIRE(flag);
+    REQUIRE(other.HasErrorMatches(&errors));
+    REQUIRE(errors.str() == "unknown option '-x' in bundle '-vx'\n");
+  }
+
+  SECTION("Names that look like bundles") {
+    // without bundles every argument is a name of its own
+    popts::Options other(vector<string>({"path/cmd", "-verbose", "-ofile"}));
+    auto &v = other.Flag({"-v"}, "");
+    auto &verbose = other.Flag({"-verbose"}, "");
+    auto &o = other.Flag({"-o"}, "");
+    auto &f = other.Flag({"-f"}, "");
+    auto &i = other.Flag({"-i"}, "");
+    auto &l = other.Flag({"-l"}, "");
+    auto &e = other.Flag({"-e"}, "");
+
+    REQUIRE(!v);
+    REQUIRE(verbose);
+    REQUIRE((!o && !f && !i && !l && !e));
+    REQUIRE(!other.HasErrorMatches());
+    REQUIRE(*other.Tail().cbegin() == "-ofile");
+  }
+
+  SECTION("Bundles and values") {
+    popts::Options other(vector<string>({"path/cmd", "-vn", "7", "-12"}));
+    other.WithBundles();
+    auto &flag = other.Flag({"-v"}, "");
+    auto &number = other.Int({"-n"}, 0, "");
+
+    REQUIRE(flag);
+    REQUIRE(number == 7);
+    REQUIRE(*other.Tail().cbegin() == "-12");
+    REQUIRE(!other.HasErrorMatches());
+  }
+
+  SECTION("Values inside bundles") {
+    popts::Options other(vector<string>({"path/cmd", "-nv", "7"}));
+    other.WithBundles();
+    other.Flag({"-v"}, "");
+    other.Int({"-n"}, 0, "");
+
+    std::stringstream errors;
+    REQUIRE(other.HasErrorMatches(&errors));
+    REQUIRE(errors.str() ==
+            "option '-n' takes a value, not last in bundle '-nv'\n");
+  }
+
+  SECTION("Inline values of unknown names") {
+    popts::Options other(
+        vector<string>({"path/cmd", "--msg", "--out=x", "--define=X"}));
+    auto &msg = other.String({"--msg"}, "", "");
+
+    REQUIRE(msg == "--out=x");
+    REQUIRE(!other.HasErrorMatches());
+    REQUIRE(other.HasConsistentTail());
+    const vector<string> tail(other.Tail().cbegin(), other.Tail().cend());
+    REQUIRE(tail == vector<string>({"--define=X"}));
+
+    // registered later, the argument is split and the value is taken again
+    auto &out = other.String({"--out"}, "", "");
+    REQUIRE(out == "x");
+    REQUIRE(other.HasErrorMatches());
+  }
+
+  SECTION("Inline values before parsed options") {
+    popts::Options other(
+        vector<string>({"path/cmd", "-a", "--define=X", "-b"}));
+    other.Flag({"-a"}, "");
+    other.Flag({"-b"}, "");
+
+    std::stringstream errors;
+    REQUIRE(!other.HasConsistentTail(&errors));
+    REQUIRE(errors.str() == "unparsed argument '--define=X' before parsed "
+                            "'-b'\n");
+  }
+
+  SECTION("Inline values of flags") {
+    popts::Options other(vector<string>({"path/cmd", "--verbose=yes"}));
+    auto &verbose = other.Flag({"--verbose"}, "");
+
+    std::stringstream errors;
+    REQUIRE(!verbose);
+    REQUIRE(other.HasErrorMatches(&errors));
+    REQUIRE(errors.str() == "error matches for option '--verbose': 'yes'\n");
+    REQUIRE(other.HasConsistentTail());
+    REQUIRE(other.Tail().cbegin() == other.Tail().cend());
+  }
+}
+
+TEST_CASE("End of options", "[parser]") {
+  popts::Options popts(vector<string>(
+      {"path/cmd", "-f", "name", "--", "-f", "--out=x", "-vv", "--"}));
+
+  auto &f = popts.Strings({"-f"}, "");
+  auto &v = popts.Flags({"-v"}, "");
+  auto &out = popts.String({"--out"}, "default", "");
+
+  REQUIRE(f.size() == 1);
+  REQUIRE(f[0] == "name");
+  REQUIRE(v.empty());
+  REQUIRE(out == "default");
+  REQUIRE(!popts.HasErrorMatches());
+  REQUIRE(popts.HasConsistentTail());
+
+  const vector<string> tail(popts.Tail().cbegin(), popts.Tail().cend());
+  REQUIRE(tail == vector<string>({"-f", "--out=x", "-vv", "--"}));
+
+  SECTION("Unparsed arguments before the terminator") {
+    popts::Options other(vector<string>({"path/cmd", "-v", "file", "--", "x"}));
+    other.Flag({"-v"}, "");
+
+    std::stringstream errors;
+    REQUIRE(!other.HasConsistentTail(&errors));
+    REQUIRE(errors.str() == "unparsed argument 'file' before parsed '--'\n");
+    REQUIRE(*other.Tail().cbegin() == "x");
+  }
+
+  SECTION("No value before the terminator") {
+    popts::Options other(vector<string>({"path/cmd", "-n", "--", "5"}));
+    other.Int({"-n"}, 0, "");
+
+    std::stringstream errors;
+    REQUIRE(other.HasErrorMatches(&errors));
+    REQUIRE(errors.str() == "error matches for option '-n': '--'\n");
+    REQUIRE(*other.Tail().cbegin() == "5");
+  }
+}
+
+TEST_CASE("Tail reader", "[parser]") {
+  namespace fs = std::filesystem;
+  const fs::path dir = fs::temp_directory_path() / "popts_tail_reader";
+  fs::create_directories(dir);
+
+  auto readAll = [](popts::TailReader &reader, vector<size_t> *sizes) {
+    vector<string> args;
+    for (auto *chunk = &reader.Next(); !chunk->empty();
+         chunk = &reader.Next()) {
+      sizes->push_back(chunk->size());
+      args.insert(args.end(), chunk->cbegin(), chunk->cend());
+    }
+    return args;
+  };
+
+  SECTION("Standard input") {
+    std::istringstream input("b\0c\0\0d"s);
+    popts::Options popts(vector<string>({"path/cmd", "-v", "a", "-", "e"}));
+    popts.Flag({"-v"}, "");
+
+    popts::TailReader reader(popts, 2, input);
+    vector<size_t> sizes;
+    REQUIRE(readAll(reader, &sizes) ==
+            vector<string>({"a", "b", "c", "", "d", "e"}));
+    // "d" is only complete at the end of the input, after the chunk with ""
+    REQUIRE(sizes == vector<size_t>({1, 2, 1, 1, 1}));
+    REQUIRE(!reader.HasErrors());
+  }
+
+  SECTION("Arguments longer than the buffer") {
+    const string longArgument(100000, 'x');
+    std::istringstream input("a\0"s + longArgument + "\0b\0"s);
+    popts::Options popts(vector<string>({"path/cmd", "-v", "-"}));
+    popts.Flag({"-v"}, "");
+
+    popts::TailReader reader(popts, 1000, input);
+    vector<size_t> sizes;
+    REQUIRE(readAll(reader, &sizes) ==
+            vector<string>({"a", longArgument, "b"}));
+  }
+
+  SECTION("Arguments are handed out as they arrive") {
+    // one piece per read, like a pipe
+    struct Pieces : std::streambuf {
+      int_type underflow() override {
+        if (m_reads == m_pieces.size()) {
+          return traits_type::eof();
+        }
+        string &piece = m_pieces[m_reads++];
+        setg(piece.data(), piece.data(), piece.data() + piece.size());
+        return traits_type::to_int_type(piece[0]);
+      }
+
+      vector<string> m_pieces{"a\0b"s, "\0c\0"s};
+      size_t m_reads = 0;
+    } pieces;
+    std::istream input(&pieces);
+
+    popts::Options popts(vector<string>({"path/cmd", "-v", "-"}));
+    popts.Flag({"-v"}, "");
+
+    popts::TailReader reader(popts, 10, input);
+    REQUIRE(reader.Next() == vector<string_view>{"a"});
+    REQUIRE(pieces.m_reads == 1);
+    REQUIRE(reader.Next() == vector<string_view>{"b"});
+    REQUIRE(reader.Next() == vector<string_view>{"c"});
+    REQUIRE(reader.Next().empty());
+  }
+
+  SECTION("Response files behind the terminator") {
+    const auto list = dir / "list.rsp";
+    string content;
+    for (int i = 0; i < 20000; ++i) {
+      content += "'file " + std::to_string(i) + "'\n";
+    }
+    std::ofstream(list, std::ios::binary) << content;
+
+    popts::Options popts(vector<string>(
+        {"path/cmd", "--", "@" + list.string(), "@missing.rsp", "-f"}));
+    popts.WithResponseFiles();
+    auto &f = popts.Strings({"-f"}, "");
+
+    REQUIRE(f.empty());
+    REQUIRE(*popts.Tail().cbegin() == "@" + list.string());
+
+    popts::TailReader reader(popts, 4096);
+    vector<size_t> sizes;
+    const auto args = readAll(reader, &sizes);
+    REQUIRE(args.size() == 20001);
+    REQUIRE(args[12345] == "file 12345");
+    REQUIRE(args.back() == "-f");
+    REQUIRE(*std::max_element(sizes.cbegin(), sizes.cend()) <= 4096);
+
+    std::stringstream errors;
+    REQUIRE(reader.HasErrors(&errors));
+    REQUIRE(errors.str() == "cannot read response file 'missing.rsp'\n");
+  }
+}
+
+TEST_CASE("Delimited lists", "[parser]") {
+  popts::Options popts(vector<string>(
+      {"path/cmd", "-i", "1,-2,+3,0012345678,123456789012345678",
+       "--doubles", "0.5;-1e3", "-i", "-9223372036854775808,,x", "-s", "a,,b",
+       "-u", "65535,65536"}));
+  const char *environment[] = {"DURATIONS=1s:2ms", nullptr};
+  popts.WithEnvironment(environment);
+
+  auto &ints = popts.Ints({"-i"}, ',', "");
+  auto &doubles = popts.Doubles({"--doubles"}, ';', "");
+  auto &strings = popts.Strings({"-s"}, ',', "");
+  auto &durations = popts.Durations({"-d"}, ':', "", "DURATIONS");
+  auto &bytes = popts.MakeListOptions<uint16_t>({"-u"}, ',', "");
+
+  REQUIRE(ints == vector<int64_t>({1, -2, 3, 12345678, 123456789012345678,
+                                   std::numeric_limits<int64_t>::min()}));
+  REQUIRE(doubles == vector<long double>({0.5, -1e3}));
+  REQUIRE(strings == vector<string>({"a", "", "b"}));
+  REQUIRE(durations.size() == 2);
+  REQUIRE(durations[0] == std::chrono::seconds(1));
+  REQUIRE(durations[1].count() == Approx(0.002));
+  REQUIRE(bytes == vector<uint16_t>({65535}));
+
+  std::stringstream errors;
+  REQUIRE(popts.HasErrorMatches(&errors));
+  REQUIRE(errors.str() ==
+          "error matches for option '-i': '-9223372036854775808,,x'\n"
+          "error matches for option '-u': '65535,65536'\n");
+
+  SECTION("Long lists") {
+    string list;
+    vector<int64_t> expected;
+    for (int64_t i = 0; i < 1000; ++i) {
+      expected.push_back(i * 7919 - 500000);
+      list += (i ? "," : "") + std::to_string(expected.back());
+    }
+
+    popts::Options other(vector<string>({"path/cmd", "-i", list}));
+    REQUIRE(other.Ints({"-i"}, ',', "") == expected);
+  }
+
+  SECTION("Same values as single options") {
+    const vector<string> values = {
+        "0.1",  "-0.0",    "123.456",  "1.",    ".5",    "1e3",  "+2.5",
+        "007",  "0.30000000000000004", "3.14159265358979323846",
+        "18446744073709551615",        "9007199254740993.0",  "inf"};
+
+    string list;
+    for (const auto &value : values) {
+      list += (list.empty() ? "" : ",") + value;
+    }
+
+    popts::Options other(vector<string>({"path/cmd", "-d", list}));
+    auto &doubles = other.Doubles({"-d"}, ',', "");
+
+    REQUIRE(doubles.size() == values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      long double expected;
+      REQUIRE(
+          popts::OptionTraits<long double>::FromString(values[i], expected));
+      REQUIRE(doubles[i] == expected);
+      REQUIRE(std::signbit(doubles[i]) == std::signbit(expected));
+    }
+  }
+}
+
+// counts what is outstanding, for memory resources
+struct CountingResource : std::pmr::memory_resource {
+  size_t m_allocations = 0;
+  size_t m_bytes = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    ++m_allocations;
+    m_bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    m_bytes -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+TEST_CASE("Memory resource", "[storage]") {
+  SECTION("Everything is returned") {
+    CountingResource resource;
+    {
+      popts::Options popts(
+          vector<string>({"path/cmd", "-v", "--name", "value", "build", "-j",
+                          "4", "--", "tail"}),
+          &resource);
+      auto &build = popts.Subcommand("build", "Builds");
+      auto &verbose = popts.Flag({"-v", "--verbose"}, "Be verbose");
+      auto &name = popts.String({"--name"}, "a default that does not fit",
+                                "A description too long for small strings");
+      auto &jobs = build.Int({"-j", "--jobs"}, 1, "");
+
+      REQUIRE(verbose);
+      REQUIRE(name == "value");
+      REQUIRE(jobs == 4);
+      REQUIRE(resource.m_allocations > 0);
+    }
+    REQUIRE(resource.m_bytes == 0);
+  }
+
+  SECTION("Nothing from the default resource") {
+    CountingResource defaults;
+    CountingResource resource;
+    auto *previous = std::pmr::set_default_resource(&defaults);
+    {
+      const char *envp[] = {"APP_N=5", nullptr};
+      popts::Options popts(
+          vector<string>({"path/cmd", "-v", "build", "-j", "4"}), &resource);
+      popts.WithEnvironment(envp);
+      auto &build = popts.Subcommand("build", "Builds");
+      auto &verbose = popts.Flag({"-v"}, "");
+      auto &n = popts.Int({"-n"}, 0, "", "APP_N");
+      auto &jobs = build.Int({"-j"}, 1, "");
+
+      REQUIRE(verbose);
+      REQUIRE(n == 5);
+      REQUIRE(jobs == 4);
+
+      popts.Reparse(vector<string>({"path/cmd", "build", "-j", "2"}));
+      REQUIRE(jobs == 2);
+    }
+    std::pmr::set_default_resource(previous);
+
+    REQUIRE(defaults.m_allocations == 0);
+    REQUIRE(resource.m_bytes == 0);
+  }
+
+  SECTION("Construction only allocates the argument table") {
+    char cmd[] = "path/cmd", v[] = "-v", file[] = "file";
+    char *argv[] = {cmd, v, file};
+    CountingResource resource;
+    popts::Options popts(3, argv, &resource);
+
+    REQUIRE(resource.m_allocations == 1);
+    REQUIRE(resource.m_bytes == 3 * sizeof(popts::string_view));
+  }
+
+  SECTION("A fixed buffer") {
+    // the upstream throws, everything has to fit into the buffer
+    static char buffer[1 << 16];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                              std::pmr::null_memory_resource());
+
+    const char *envp[] = {"APP_N=5", nullptr};
+    popts::Options popts(vector<string>({"path/cmd", "--opt7", "70", "-vv",
+                                         "--list=a,b", "build", "-j", "4"}),
+                         &arena);
+    popts.WithEnvironment(envp).WithBundles();
+    auto &build = popts.Subcommand("build", "Builds");
+    vector<string> names;
+    for (int i = 0; i < 50; ++i) {
+      names.push_back("--opt" + std::to_string(i));
+    }
+    for (int i = 0; i < 50; ++i) {
+      auto &value = popts.Int({names[i].c_str()}, i, "");
+      REQUIRE(value == (i == 7 ? 70 : i));
+    }
+    auto &verbose = popts.Flags({"-v"}, "");
+    auto &list = popts.Strings({"--list"}, ',', "");
+    auto &n = popts.Int({"-n"}, 0, "", "APP_N");
+    auto &jobs = build.Int({"-j"}, 1, "");
+
+    REQUIRE(verbose.size() == 2);
+    REQUIRE(list == vector<string>({"a", "b"}));
+    REQUIRE(n == 5);
+    REQUIRE(jobs == 4);
+    REQUIRE(!popts.HasErrorMatches());
+    REQUIRE(popts.FindOption("--opt49"));
+
+    popts.Reparse(vector<string>({"path/cmd", "build", "-j", "2"}));
+    REQUIRE(jobs == 2);
+    REQUIRE(verbose.empty());
+  }
+}
+
+TEST_CASE("Errors across many options", "[errors]") {
+  // the first, the last, the borders of the 64 bit words and a lazy option
+  const vector<size_t> broken = {0, 63, 64, 127, 128, 150, 199};
+  vector<string> argv = {"path/cmd"};
+  vector<string> names;
+  for (size_t i = 0; i < 200; ++i) {
+    names.push_back("--opt" + std::to_string(i));
+    argv.push_back(names.back());
+    argv.push_back(std::count(broken.cbegin(), broken.cend(), i)
+                       ? "x"
+                       : std::to_string(i));
+  }
+
+  popts::Options popts(argv);
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (i == 150) {
+      popts.MakeLazyOption<int64_t>({names[i].c_str()}, 0, "");
+    } else {
+      popts.Int({names[i].c_str()}, 0, "");
+    }
+  }
+
+  std::stringstream expected;
+  for (size_t i : broken) {
+    expected << "error matches for option '--opt" << i << "': 'x'\n";
+  }
+
+  std::stringstream errors;
+  REQUIRE(popts.HasErrorMatches(&errors));
+  REQUIRE(errors.str() == expected.str());
+
+  popts.Reparse(vector<string>({"path/cmd", "--opt5", "5"}));
+  REQUIRE(!popts.HasErrorMatches());
+}
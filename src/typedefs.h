@@ -4,15 +4,37 @@
 
 #include <chrono>
 #include <deque>
+#include <iosfwd>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+// Header-only by default. With POPTS_SEPARATE_COMPILATION the functions that
+// are not templates are compiled once, in the translation unit that defines
+// POPTS_IMPLEMENTATION, see popts.cpp.
+#if !defined(POPTS_SEPARATE_COMPILATION) || defined(POPTS_IMPLEMENTATION)
+#define POPTS_HAS_IMPLEMENTATION
+#endif
+
+// Header-only, the functions that are not templates are defined in every
+// translation unit and have to be inline.
+#ifdef POPTS_SEPARATE_COMPILATION
+#define POPTS_INLINE
+#else
+#define POPTS_INLINE inline
+#endif
+
 namespace popts {
 
 using namespace std::string_literals;
 
 using std::deque;
 using std::string;
+using std::string_view;
+using std::unordered_map;
 using std::vector;
 
 using duration_t = std::chrono::duration<long double>;